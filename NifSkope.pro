@@ -168,6 +168,7 @@ HEADERS += \
 	src/importex/3ds.h \
 	src/kfmmodel.h \
 	src/message.h \
+	src/nifatom.h \
 	src/nifexpr.h \
 	src/nifitem.h \
 	src/nifmodel.h \
@@ -204,6 +205,7 @@ HEADERS += \
 	src/ui/checkablemessagebox.h \
 	src/ui/settingsdialog.h \
 	src/version.h \
+	src/xmlcache.h \
 	lib/half.h \
 	lib/dds.h \
 	lib/dxgiformat.h \
@@ -238,6 +240,7 @@ SOURCES += \
 	src/kfmmodel.cpp \
 	src/kfmxml.cpp \
 	src/message.cpp \
+	src/nifatom.cpp \
 	src/nifdelegate.cpp \
 	src/nifexpr.cpp \
 	src/nifmodel.cpp \
@@ -291,6 +294,7 @@ SOURCES += \
 	src/ui/checkablemessagebox.cpp \
 	src/ui/settingsdialog.cpp \
 	src/version.cpp \
+	src/xmlcache.cpp \
 	lib/half.cpp \
 	src/gl/bsshape.cpp \
 	src/material.cpp
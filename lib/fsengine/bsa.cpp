@@ -36,13 +36,21 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "lz4frame.h"
 
 #include <QByteArray>
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QDateTime>
 #include <QDebug>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
 #include <QStringBuilder>
 
+#include <algorithm>
+#include <cstring>
+
 
 // see bsa.h
 quint32 BSA::BSAFile::size() const
@@ -87,6 +95,65 @@ static bool BSAReadSizedString( QFile & bsa, QString & s )
 	}
 }
 
+//! Computes the TES4 %BSA hash of a name, lower cased and with backslashes as separators
+/*!
+ * \param s      The name
+ * \param len    The length of the name
+ * \param extLen The length of the extension at the end of the name, including the dot
+ */
+static quint64 bsaHash( const QChar * s, int len, int extLen )
+{
+	auto c = [s]( int i ) -> quint32 {
+		ushort u = s[i].toLower().unicode();
+		return ( u == '/' ) ? '\\' : ( u & 0xFF );
+	};
+
+	const int n = len - extLen;
+
+	quint32 hash1 = 0;
+	if ( n > 0 )
+		hash1 = c( n - 1 ) | ( n > 2 ? c( n - 2 ) << 8 : 0 ) | quint32( n ) << 16 | c( 0 ) << 24;
+
+	auto isExt = [&]( const char * ext ) {
+		if ( int( strlen( ext ) ) != extLen )
+			return false;
+		for ( int i = 0; i < extLen; i++ ) {
+			if ( c( n + i ) != quint32( ext[i] ) )
+				return false;
+		}
+		return true;
+	};
+
+	if ( isExt( ".kf" ) )
+		hash1 |= 0x80;
+	else if ( isExt( ".nif" ) )
+		hash1 |= 0x8000;
+	else if ( isExt( ".dds" ) )
+		hash1 |= 0x8080;
+	else if ( isExt( ".wav" ) )
+		hash1 |= 0x80000000;
+
+	quint32 hash2 = 0;
+	for ( int i = 1; i < n - 2; i++ )
+		hash2 = hash2 * 0x1003F + c( i );
+
+	quint32 hash3 = 0;
+	for ( int i = n; i < len; i++ )
+		hash3 = hash3 * 0x1003F + c( i );
+
+	return ( quint64( hash2 + hash3 ) << 32 ) | hash1;
+}
+
+//! Computes the TES4 %BSA hash of a file name
+static quint64 bsaFileHash( const QChar * s, int len )
+{
+	int dot = len - 1;
+	while ( dot >= 0 && s[dot] != '.' )
+		dot--;
+
+	return bsaHash( s, len, ( dot > 0 ) ? len - dot : 0 );
+}
+
 QByteArray gUncompress( const QByteArray & data, const int size )
 {
 	if ( data.size() <= 4 ) {
@@ -188,6 +255,7 @@ bool BSA::canOpen( const QString & fn )
 // see bsa.h
 bool BSA::open()
 {
+	QWriteLocker mapLocker( & mapLock );
 	QMutexLocker lock( & bsaMutex );
 	
 	try
@@ -199,7 +267,12 @@ bool BSA::open()
 		
 		bsa.read( (char*) &magic, sizeof( magic ) );
 
-		if ( magic == F4_BSAHEADER_FILEID ) {
+		bool useCache = QSettings().value( "Settings/Resources/Index Cache", true ).toBool();
+		bool cached = useCache && loadIndex();
+
+		if ( cached ) {
+			// The tables of an unchanged archive were read from the index cache
+		} else if ( magic == F4_BSAHEADER_FILEID ) {
 			bsa.read( (char*)&version, sizeof( version ) );
 
 			if ( version != F4_BSAHEADER_VERSION )
@@ -427,6 +500,18 @@ bool BSA::open()
 		}
 		else
 			throw QString( "file magic" );
+
+		if ( !cached ) {
+			std::sort( fileIndex.begin(), fileIndex.end() );
+			fileIndex.squeeze();
+
+			if ( useCache )
+				saveIndex();
+		}
+
+		// Map the archive so that files can be read by several threads without seeking
+		bsaSize = bsa.size();
+		mapped = bsa.map( 0, bsaSize );
 	}
 	catch ( QString e )
 	{
@@ -442,14 +527,22 @@ bool BSA::open()
 // see bsa.h
 void BSA::close()
 {
+	// Wait for the reads from the mapping to finish before it is unmapped
+	QWriteLocker mapLocker( & mapLock );
 	QMutexLocker lock( & bsaMutex );
 	
+	mapped = nullptr;
 	bsa.close();
+	qDeleteAll( readers );
+	readers.clear();
 	qDeleteAll( root->children );
-	qDeleteAll( root->files );
 	root->children.clear();
 	root->files.clear();
 	folders.clear();
+	fileIndex.clear();
+	fileData.clear();
+	names.clear();
+	foldersPending = false;
 
 	delete root;
 }
@@ -471,26 +564,27 @@ bool BSA::fileContents( const QString & fn, QByteArray & content )
 	//qDebug() << "entering fileContents for" << fn;
 	if ( const BSAFile * file = getFile( fn ) )
 	{
-		QMutexLocker lock( & bsaMutex );
-		if ( bsa.seek( file->offset ) )
+		quint64 offset = file->offset;
+		if ( offset < quint64( bsaSize ) )
 		{
 			qint64 filesz = file->size();
 			bool ok = true;
 			if (namePrefix) {
 				char len;
-				ok = bsa.read(&len, 1);
+				ok = readAt( offset, &len, 1 );
 				filesz -= len + 1;
-				if (ok) ok = bsa.seek( file->offset + 1 + len );
+				offset += 1 + len;
 			}
 
 			quint32 filesize = filesz;
 			if ( version == SSE_BSAHEADER_VERSION && file->sizeFlags > 0 && (file->compressed() ^ compressToggle) ) {
-				ok = bsa.read( (char*)&filesize, 4 );
+				ok = ok && readAt( offset, (char*)&filesize, 4 );
+				offset += 4;
 				filesz -= 4;
 			}
 
 			content.resize( filesz );
-			if ( ok && bsa.read( content.data(), filesz ) == filesz ) {
+			if ( ok && readAt( offset, content.data(), filesz ) ) {
 				if ( file->sizeFlags > 0 && (file->compressed() ^ compressToggle) ) {
 					// BSA
 					if ( version != SSE_BSAHEADER_VERSION ) {
@@ -608,7 +702,13 @@ bool BSA::fileContents( const QString & fn, QByteArray & content )
 					int texSize = 0; // = file->unpackedLength;
 					int hdrSize = sizeof( ddsHeader ) + 4;
 
+					// Reserve the whole texture so that the chunks are not reallocated as they are appended
+					int reserve = hdrSize + ( dx10 ? sizeof( dx10Header ) : 0 );
+					for ( const F4TexChunk & chunk : file->tex.chunks )
+						reserve += chunk.unpackedSize;
+
 					content.clear();
+					content.reserve( reserve );
 					content.append( QByteArray::fromStdString( "DDS " ) );
 					content.append( QByteArray::fromRawData( dds, sizeof( ddsHeader ) ) );
 					Q_ASSERT( content.size() == hdrSize );
@@ -627,23 +727,26 @@ bool BSA::fileContents( const QString & fn, QByteArray & content )
 					// Start at 1st chunk now
 					for ( int i = 0; i < file->tex.chunks.count(); i++ ) {
 						F4TexChunk chunk = file->tex.chunks[i];
-						if ( bsa.seek( chunk.offset ) ) {
-							QByteArray chunkData;
-
+						if ( chunk.offset < quint64( bsaSize ) ) {
 							if ( chunk.packedSize > 0 ) {
-								chunkData.resize( chunk.packedSize );
-								if ( bsa.read( chunkData.data(), chunk.packedSize ) == chunk.packedSize ) {
+								QByteArray chunkData( chunk.packedSize, Qt::Uninitialized );
+								if ( readAt( chunk.offset, chunkData.data(), chunk.packedSize ) ) {
 									chunkData = gUncompress( chunkData, chunk.packedSize );
 
 									if ( chunkData.size() != chunk.unpackedSize )
 										qCritical() << "Size does not match at " << chunk.offset;
 								}
-							} else if ( !(bsa.read( chunkData.data(), chunk.unpackedSize ) == chunk.unpackedSize) ) {
-								qCritical() << "Size does not match at " << chunk.offset;
+
+								content.append( chunkData );
+							} else {
+								// Read uncompressed chunks straight into the texture
+								int pos = content.size();
+								content.resize( pos + chunk.unpackedSize );
+								if ( !readAt( chunk.offset, content.data() + pos, chunk.unpackedSize ) )
+									qCritical() << "Size does not match at " << chunk.offset;
 							}
 							texSize += chunk.unpackedSize;
 
-							content.append( chunkData );
 							//Q_ASSERT( content.size() - hdrSize == texSize );
 						} else {
 							qCritical() << "Seek error";
@@ -659,6 +762,229 @@ bool BSA::fileContents( const QString & fn, QByteArray & content )
 	return false;
 }
 
+// see bsa.h
+bool BSA::fileIsView( const QString & fn ) const
+{
+	const BSAFile * file = getFile( fn );
+	if ( !file || file->tex.chunks.count() )
+		return false;
+
+	QReadLocker lock( & mapLock );
+	if ( !mapped )
+		return false;
+
+	// Compressed files have to be decoded into a new array
+	return !( file->sizeFlags > 0 ? ( file->compressed() ^ compressToggle ) : file->packedLength > 0 );
+}
+
+// see bsa.h
+bool BSA::fileView( const QString & fn, QByteArray & content )
+{
+	if ( !fileIsView( fn ) )
+		return fileContents( fn, content );
+
+	const BSAFile * file = getFile( fn );
+
+	// The archive may have been closed since
+	QReadLocker lock( & mapLock );
+	if ( !file || !mapped )
+		return false;
+
+	quint64 offset = file->offset;
+	qint64 filesz = file->size();
+	if ( namePrefix && offset < quint64( bsaSize ) ) {
+		quint8 len = mapped[offset];
+		offset += 1 + len;
+		filesz -= 1 + len;
+	}
+
+	if ( filesz < 0 || offset + quint64( filesz ) > quint64( bsaSize ) )
+		return false;
+
+	content = QByteArray::fromRawData( reinterpret_cast<const char *>( mapped + offset ), int( filesz ) );
+	return true;
+}
+
+//! Magic of an index cache file, the literal string "NSBI"
+static const quint32 BSA_INDEX_MAGIC = 0x4942534E;
+//! Version of the index cache layout; increase it when the layout changes
+static const quint32 BSA_INDEX_VERSION = 2;
+
+// see bsa.h
+QString BSA::indexPath() const
+{
+	QByteArray key = QCryptographicHash::hash( bsaPath.toUtf8(), QCryptographicHash::Sha1 ).toHex();
+
+	return QStandardPaths::writableLocation( QStandardPaths::CacheLocation ) % "/archives/" % QString::fromLatin1( key ) % ".idx";
+}
+
+// see bsa.h
+bool BSA::loadIndex()
+{
+	QFile f( indexPath() );
+	if ( !f.open( QIODevice::ReadOnly ) )
+		return false;
+
+	const QByteArray data = f.readAll();
+
+	QDataStream in( data );
+	in.setByteOrder( QDataStream::LittleEndian );
+
+	quint32 magic = 0, indexVersion = 0;
+	in >> magic >> indexVersion;
+	if ( magic != BSA_INDEX_MAGIC || indexVersion != BSA_INDEX_VERSION )
+		return false;
+
+	// The archive is identified by its path, size and modification time
+	QFileInfo info( bsaPath );
+	QString path;
+	qint64 size = 0, modified = 0;
+	in >> path >> size >> modified;
+	if ( path != bsaPath || size != info.size() || modified != info.lastModified().toMSecsSinceEpoch() )
+		return false;
+
+	quint8 compress = 0, prefix = 0;
+	quint32 count = 0;
+	in >> version >> compress >> prefix >> count;
+	if ( in.status() != QDataStream::Ok || count > quint32( data.size() ) )
+		return false;
+
+	compressToggle = compress;
+	namePrefix = prefix;
+	numFiles = count;
+
+	fileData.resize( count );
+	fileIndex.resize( count );
+	for ( quint32 i = 0; i < count; i++ ) {
+		FileHash & hash = fileIndex[i];
+		BSAFile & file = fileData[i];
+
+		quint8 chunks = 0;
+		in >> hash.folder >> hash.file >> file.sizeFlags >> file.packedLength >> file.unpackedLength >> file.offset
+		   >> file.name >> file.nameLength >> chunks;
+		if ( chunks ) {
+			file.tex.chunks.resize( chunks );
+			in.readRawData( (char *)&file.tex.header, sizeof( F4TexInfo ) );
+			in.readRawData( (char *)file.tex.chunks.data(), chunks * sizeof( F4TexChunk ) );
+		}
+
+		hash.data = &file;
+	}
+
+	in >> names;
+
+	bool ok = in.status() == QDataStream::Ok;
+	for ( const BSAFile & file : fileData ) {
+		if ( quint64( file.name ) + file.nameLength > quint64( names.length() ) )
+			ok = false;
+	}
+
+	if ( !ok ) {
+		fileIndex.clear();
+		fileData.clear();
+		names.clear();
+		version = 0;
+		compressToggle = namePrefix = false;
+		return false;
+	}
+
+	foldersPending = true;
+	return true;
+}
+
+// see bsa.h
+void BSA::saveIndex() const
+{
+	QByteArray data;
+	QDataStream out( &data, QIODevice::WriteOnly );
+	out.setByteOrder( QDataStream::LittleEndian );
+
+	QFileInfo info( bsaPath );
+	out << BSA_INDEX_MAGIC << BSA_INDEX_VERSION;
+	out << bsaPath << qint64( info.size() ) << qint64( info.lastModified().toMSecsSinceEpoch() );
+	out << version << quint8( compressToggle ) << quint8( namePrefix ) << quint32( fileIndex.count() );
+
+	for ( int i = 0; i < fileIndex.count(); i++ ) {
+		const FileHash & hash = fileIndex.at( i );
+		const BSAFile * file = hash.data;
+
+		quint8 chunks = quint8( file->tex.chunks.count() );
+		out << hash.folder << hash.file << file->sizeFlags << file->packedLength << file->unpackedLength << file->offset
+		    << file->name << file->nameLength << chunks;
+		if ( chunks ) {
+			out.writeRawData( (const char *)&file->tex.header, sizeof( F4TexInfo ) );
+			out.writeRawData( (const char *)file->tex.chunks.constData(), chunks * sizeof( F4TexChunk ) );
+		}
+	}
+
+	// The folder tree is built from the names when the archive is browsed
+	out << names;
+
+	QString path = indexPath();
+	QDir().mkpath( QFileInfo( path ).absolutePath() );
+
+	QSaveFile f( path );
+	if ( f.open( QIODevice::WriteOnly ) && f.write( data ) == data.size() )
+		f.commit();
+}
+
+// see bsa.h
+void BSA::loadFolders()
+{
+	QMutexLocker lock( & bsaMutex );
+	if ( !foldersPending )
+		return;
+
+	for ( BSAFile & file : fileData ) {
+		const QChar * s = names.constData() + file.name;
+		int sep = int( file.nameLength ) - 1;
+		while ( sep >= 0 && s[sep] != '/' )
+			sep--;
+
+		BSAFolder * folder = insertFolder( ( sep > 0 ) ? QString( s, sep ) : QString() );
+		folder->files.append( &file );
+	}
+
+	foldersPending = false;
+}
+
+// see bsa.h
+bool BSA::readAt( quint64 offset, char * data, qint64 size )
+{
+	if ( size < 0 || offset + quint64( size ) > quint64( bsaSize ) )
+		return false;
+
+	// Held for the whole read, close() waits for it before unmapping and deleting the readers
+	QReadLocker mapLocker( & mapLock );
+
+	if ( mapped ) {
+		memcpy( data, mapped + offset, size );
+		return true;
+	}
+
+	QFile * reader = nullptr;
+	{
+		QMutexLocker lock( & bsaMutex );
+		if ( !readers.isEmpty() )
+			reader = readers.takeLast();
+	}
+
+	if ( !reader ) {
+		reader = new QFile( bsaPath );
+		if ( !reader->open( QIODevice::ReadOnly ) ) {
+			delete reader;
+			return false;
+		}
+	}
+
+	bool ok = reader->seek( offset ) && reader->read( data, size ) == size;
+
+	QMutexLocker lock( & bsaMutex );
+	readers.append( reader );
+
+	return ok;
+}
+
 // see bsa.h
 QString BSA::getAbsoluteFilePath( const QString & fn ) const
 {
@@ -680,6 +1006,7 @@ BSA::BSAFolder * BSA::insertFolder( QString name )
 	if ( !folder ) {
 		folder = new BSAFolder;
 		folder->name = name;
+		folder->hash = bsaHash( name.constData(), name.length(), 0 );
 		folders.insert( name, folder );
 		
 		int p = name.lastIndexOf( "/" );
@@ -698,31 +1025,53 @@ BSA::BSAFolder * BSA::insertFolder( QString name )
 // see bsa.h
 BSA::BSAFile * BSA::insertFile( BSAFolder * folder, QString name, quint32 sizeFlags, quint32 offset )
 {
-	BSAFile * file = new BSAFile;
+	fileData.emplace_back();
+	BSAFile * file = &fileData.back();
 	file->sizeFlags = sizeFlags;
 	file->offset = offset;
-	folder->files.insert( name, file );
+	folder->files.append( file );
+
+	file->name = quint32( names.length() );
+	if ( !folder->name.isEmpty() ) {
+		names.append( folder->name );
+		names.append( '/' );
+	}
+	names.append( name );
+	file->nameLength = quint32( names.length() ) - file->name;
 
-	files.insert( QString( folder->name % "/" % name ).toLower(), file );
+	fileIndex.append( { folder->hash, bsaFileHash( name.constData(), name.length() ), file } );
 	return file;
 }
 
 BSA::BSAFile * BSA::insertFile( BSAFolder * folder, QString name, quint32 packed, quint32 unpacked, quint64 offset, F4Tex dds )
 {
-	BSAFile * file = new BSAFile;
+	fileData.emplace_back();
+	BSAFile * file = &fileData.back();
 	file->tex = dds;
 	file->packedLength = packed;
 	file->unpackedLength = unpacked;
 	file->offset = offset;
-	folder->files.insert( name, file );
+	folder->files.append( file );
+
+	file->name = quint32( names.length() );
+	if ( !folder->name.isEmpty() ) {
+		names.append( folder->name );
+		names.append( '/' );
+	}
+	names.append( name );
+	file->nameLength = quint32( names.length() ) - file->name;
 
-	files.insert( QString( folder->name % "/" % name ).toLower(), file );
+	fileIndex.append( { folder->hash, bsaFileHash( name.constData(), name.length() ), file } );
 	return file;
 }
 
 // see bsa.h
 const BSA::BSAFolder * BSA::getFolder( QString fn ) const
 {
+	// The folders of a cached index are only needed to browse the archive
+	if ( foldersPending )
+		const_cast<BSA *>( this )->loadFolders();
+
 	if ( fn.isEmpty() )
 		return root;
 	else
@@ -730,9 +1079,51 @@ const BSA::BSAFolder * BSA::getFolder( QString fn ) const
 }
 
 // see bsa.h
-const BSA::BSAFile * BSA::getFile( QString fn ) const
+const BSA::BSAFile * BSA::getFile( const QString & fn ) const
 {
-	return files.value( fn.toLower() );
+	const QChar * s = fn.constData();
+	const int len = fn.length();
+
+	int sep = len - 1;
+	while ( sep >= 0 && s[sep] != '/' && s[sep] != '\\' )
+		sep--;
+
+	FileHash key = { bsaHash( s, std::max( sep, 0 ), 0 ), bsaFileHash( s + sep + 1, len - sep - 1 ), nullptr };
+
+	// Compares the path case-insensitively, with either separator
+	auto matches = [this, s, len]( const BSAFile * file ) {
+		if ( int( file->nameLength ) != len )
+			return false;
+
+		const QChar * name = names.constData() + file->name;
+		for ( int i = 0; i < len; i++ ) {
+			QChar c = ( s[i] == '\\' ) ? QChar( '/' ) : s[i];
+			if ( c != name[i] && c.toLower() != name[i].toLower() )
+				return false;
+		}
+		return true;
+	};
+
+	auto it = std::lower_bound( fileIndex.cbegin(), fileIndex.cend(), key );
+	for ( ; it != fileIndex.cend() && it->folder == key.folder && it->file == key.file; ++it ) {
+		if ( matches( it->data ) )
+			return it->data;
+	}
+
+	return nullptr;
+}
+
+// see bsa.h
+QString BSA::fileName( const BSAFile * file ) const
+{
+	const QChar * s = names.constData() + file->name;
+	int len = int( file->nameLength );
+
+	int sep = len - 1;
+	while ( sep >= 0 && s[sep] != '/' )
+		sep--;
+
+	return QString( s + sep + 1, len - sep - 1 );
 }
 
 // see bsa.h
@@ -790,14 +1181,14 @@ bool BSA::scan( const BSA::BSAFolder * folder, QStandardItem * item, QString pat
 
 		// List files
 		if ( i.value()->files.count() ) {
-			QHash<QString, BSAFile *>::const_iterator f;
-			for ( f = i.value()->files.begin(); f != i.value()->files.end(); f++ ) {
-				QString fullpath = path % "/" % i.key() % "/" % f.key();
+			for ( const BSAFile * f : i.value()->files ) {
+				QString name = fileName( f );
+				QString fullpath = path % "/" % i.key() % "/" % name;
 
-				int bytes = f.value()->size();
+				int bytes = f->size();
 				QString filesize = (bytes > 1024) ? QString::number( bytes / 1024 ) + "KB" : QString::number( bytes ) + "B";
 
-				auto fileItem = new QStandardItem( f.key() );
+				auto fileItem = new QStandardItem( name );
 				auto pathItem = new QStandardItem( fullpath );
 				auto sizeItem = new QStandardItem( filesize );
 
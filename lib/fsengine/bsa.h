@@ -44,7 +44,10 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QFileInfo>
 #include <QHash>
 #include <QMutex>
+#include <QReadWriteLock>
+#include <QVector>
 
+#include <deque>
 #include <memory>
 
 using namespace std;
@@ -267,6 +270,10 @@ public:
 	* \return True if successful
 	*/
 	bool fileContents( const QString &, QByteArray & ) override final;
+	//! Returns the contents of the specified file as a view onto the mapped %BSA if it is not compressed
+	bool fileView( const QString &, QByteArray & ) override final;
+	//! Whether the specified file is uncompressed and the %BSA is mapped
+	bool fileIsView( const QString & ) const override final;
 	
 	//! See QFileInfo::ownerId().
 	uint ownerId( const QString & ) const override final;
@@ -295,6 +302,9 @@ public:
 
 		quint64 offset = 0; //!< The offset of the file in the BSA
 
+		quint32 name = 0; //!< Where the path of the file starts in BSA::names
+		quint32 nameLength = 0; //!< The length of the path
+
 		//! The size of the file inside the BSA
 		quint32 size() const;
 
@@ -310,12 +320,13 @@ public:
 		//! Constructor
 		BSAFolder() : parent( 0 ) {}
 		//! Destructor
-		~BSAFolder() { qDeleteAll( children ); qDeleteAll( files ); }
+		~BSAFolder() { qDeleteAll( children ); }
 
 		QString name;
+		quint64 hash = 0; //!< TES4 hash of the folder name
 		BSAFolder * parent; //!< The parent item
 		QHash<QString, BSAFolder*> children; //!< A map of child folders
-		QHash<QString, BSAFile*> files; //!< A map of files inside the folder
+		QVector<BSAFile*> files; //!< The files inside the folder, owned by BSA::fileData; their names are in BSA::names
 	};
 	
 	//! Recursive function to generate the tree structure of folders inside a %BSA
@@ -328,22 +339,53 @@ public:
 	//! Gets the specified folder, or the root folder if not found
 	const BSAFolder * getFolder( QString fn ) const;
 	//! Gets the specified file, or null if not found
-	const BSAFile * getFile( QString fn ) const;
+	/*!
+	 * Looks the file up by the TES4 hashes of its folder and name, whichever the
+	 * format of the archive, and compares the path in BSA::names on a match as the
+	 * hashes may collide. Does not allocate.
+	 */
+	const BSAFile * getFile( const QString & fn ) const;
+	//! Returns the name of a file without its folder
+	QString fileName( const BSAFile * file ) const;
 
 	bool scan( const BSA::BSAFolder *, QStandardItem *, QString );
 	bool fillModel( BSAModel *, const QString & );
 
 protected:
+	//! Reads the tables of the %BSA from the index cache if the archive has not changed
+	bool loadIndex();
+	//! Writes the tables of the %BSA to the index cache
+	void saveIndex() const;
+	//! Builds the folder tree from BSA::names for a cached index
+	void loadFolders();
+	//! Returns the path of the index cache file of the %BSA
+	QString indexPath() const;
+
+	//! Reads bytes at an absolute offset without moving a shared file position
+	/*!
+	 * Safe to call from several threads at once. Reads are copied from BSA::mapped if the
+	 * archive could be mapped, otherwise they use a file handle borrowed from BSA::readers.
+	 * Holds a read lock on BSA::mapLock, so close() cannot unmap the archive meanwhile.
+	 */
+	bool readAt( quint64 offset, char * data, qint64 size );
 	
 	//! The %BSA file
 	QFile bsa;
+	//! The size of the %BSA file
+	qint64 bsaSize = 0;
+	//! The whole %BSA file mapped into memory, or null if it could not be mapped
+	const uchar * mapped = nullptr;
+	//! Idle file handles for BSA::readAt when the %BSA is not mapped
+	QVector<QFile *> readers;
 	//! File info for the %BSA
 	QFileInfo bsaInfo;
 
-	quint32 version;
+	quint32 version = 0;
 
-	//! Mutual exclusion handler
+	//! Mutual exclusion handler for opening, closing and BSA::readers
 	QMutex bsaMutex;
+	//! Read locked while BSA::mapped or BSA::readers are used, write locked to open and close; taken before BSA::bsaMutex
+	mutable QReadWriteLock mapLock;
 	
 	//! The absolute name of the file, e.g. "d:/temp/test.bsa"
 	QString bsaPath;
@@ -357,8 +399,27 @@ protected:
 	//! The root folder
 	BSAFolder * root;
 
-	//! Map of files inside a %BSA
-	QHash<QString, BSAFile *> files;
+	//! An entry of BSA::fileIndex
+	struct FileHash
+	{
+		quint64 folder; //!< Hash of the folder path
+		quint64 file; //!< Hash of the file name
+		BSAFile * data;
+
+		bool operator<( const FileHash & other ) const
+		{
+			return folder < other.folder || ( folder == other.folder && file < other.file );
+		}
+	};
+
+	//! Files inside a %BSA, sorted by the hashes of their folder and name
+	QVector<FileHash> fileIndex;
+	//! Storage for the files inside a %BSA
+	std::deque<BSAFile> fileData;
+	//! The paths of all files, one after another; the folder is lower case and separated by slashes
+	QString names;
+	//! Whether the folder tree of a cached index is still to be built on first use
+	bool foldersPending = false;
 	
 	//! Error string for exception handling
 	QString status;
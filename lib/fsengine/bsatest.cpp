@@ -0,0 +1,148 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#ifdef BSA_TEST
+
+#include "bsa.h"
+
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+
+
+//! \file bsatest.cpp Multi-threaded read throughput benchmark for BSA/BA2 archives
+
+//! Collects the paths of all files in a folder and its subfolders
+static void collectFiles( const BSA & bsa, const BSA::BSAFolder * folder, QStringList & paths )
+{
+	for ( const BSA::BSAFile * file : folder->files )
+		paths << ( folder->name.isEmpty() ? bsa.fileName( file ) : folder->name + "/" + bsa.fileName( file ) );
+
+	for ( const BSA::BSAFolder * child : folder->children )
+		collectFiles( bsa, child, paths );
+}
+
+//! Reads every file of the archive whose index is congruent to the thread number
+class ReadThread final : public QThread
+{
+public:
+	ReadThread( BSA & bsa, const QStringList & paths, int first, int stride )
+		: bsa( bsa ), paths( paths ), first( first ), stride( stride )
+	{
+	}
+
+	qint64 bytes = 0;
+	int failed = 0;
+
+protected:
+	void run() override final
+	{
+		QByteArray content;
+		for ( int i = first; i < paths.count(); i += stride ) {
+			if ( bsa.fileContents( paths.at( i ), content ) )
+				bytes += content.size();
+			else
+				failed++;
+		}
+	}
+
+private:
+	BSA & bsa;
+	const QStringList & paths;
+	int first;
+	int stride;
+};
+
+/*!
+ * Usage: bsatest <archive> [max threads]
+ *
+ * Reads every file in the archive with 1, 2, 4... threads and prints the throughput.
+ * Run it twice to compare warm runs; the first pass also measures the disk.
+ */
+int main( int argc, char * argv[] )
+{
+	QTextStream out( stdout );
+
+	if ( argc < 2 ) {
+		out << "usage: bsatest <archive> [max threads]" << endl;
+		return 1;
+	}
+
+	BSA bsa( QString::fromLocal8Bit( argv[1] ) );
+	if ( !bsa.open() ) {
+		out << "could not open " << argv[1] << ": " << bsa.statusText() << endl;
+		return 1;
+	}
+
+	int maxThreads = ( argc > 2 ) ? QString( argv[2] ).toInt() : QThread::idealThreadCount();
+	maxThreads = std::max( maxThreads, 1 );
+
+	QStringList paths;
+	collectFiles( bsa, bsa.getFolder( QString() ), paths );
+	out << paths.count() << " files in " << bsa.name() << endl;
+
+	for ( int threads = 1; threads <= maxThreads; threads *= 2 ) {
+		QVector<ReadThread *> readers;
+		for ( int t = 0; t < threads; t++ )
+			readers << new ReadThread( bsa, paths, t, threads );
+
+		QElapsedTimer timer;
+		timer.start();
+
+		for ( ReadThread * r : readers )
+			r->start();
+
+		qint64 bytes = 0;
+		int failed = 0;
+		for ( ReadThread * r : readers ) {
+			r->wait();
+			bytes += r->bytes;
+			failed += r->failed;
+		}
+
+		qint64 ms = std::max( timer.elapsed(), qint64( 1 ) );
+		out << threads << " threads: " << bytes / 1048576 << " MiB in " << ms << " ms, "
+		    << ( bytes / 1048576.0 ) / ( ms / 1000.0 ) << " MiB/s";
+		if ( failed )
+			out << ", " << failed << " failed";
+		out << endl;
+
+		qDeleteAll( readers );
+	}
+
+	return 0;
+}
+
+#endif
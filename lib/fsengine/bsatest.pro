@@ -2,14 +2,18 @@ TEMPLATE = app
 LANGUAGE = C++
 TARGET   = bsatest
 
-DEFINES += BSA_TEST
+# Multi-threaded read throughput benchmark, see bsatest.cpp
+DEFINES += BSA_TEST LZ4_STATIC XXH_PRIVATE_API
 
-CONFIG += qt release thread warn_on console
-LIBS += -lmingw32 -lqtmain
+QT += widgets
+CONFIG += qt release thread warn_on console c++11
+win32:LIBS += -lmingw32 -lqtmain
 
 DESTDIR = ./
 
+INCLUDEPATH += .. ../zlib
+
 HEADERS += *.h
-SOURCES += *.cpp
+SOURCES += *.cpp ../lz4frame.c ../xxhash.c ../zlib/*.c
 
 # vim: set filetype=config : 
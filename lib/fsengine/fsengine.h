@@ -86,6 +86,14 @@ public:
 	virtual bool hasFile( const QString & ) const = 0;
 	virtual qint64 fileSize( const QString & ) const = 0;
 	virtual bool fileContents( const QString &, QByteArray & ) = 0;
+	//! Returns the contents of a file, without copying them where the archive allows it
+	/*!
+	 * The array may be a view (see QByteArray::fromRawData) which is only valid while the
+	 * archive is open. Modifying it makes a copy; copy it as well to keep it any longer.
+	 */
+	virtual bool fileView( const QString & fn, QByteArray & content ) { return fileContents( fn, content ); }
+	//! Whether fileView() returns a view for the file rather than a decoded copy
+	virtual bool fileIsView( const QString & fn ) const { Q_UNUSED( fn ); return false; }
 	virtual QString getAbsoluteFilePath( const QString & ) const = 0;
 
 	virtual uint ownerId( const QString & ) const = 0;
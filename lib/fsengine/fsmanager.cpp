@@ -72,10 +72,133 @@ QList <FSArchiveFile *> FSManager::archiveList()
 	return archives;
 }
 
+// see fsmanager.h
+bool FSManager::fileContents( FSArchiveFile * archive, const QString & fn, QByteArray & content )
+{
+	// Views onto a mapped archive cost nothing to read again
+	if ( archive->fileIsView( fn ) )
+		return archive->fileView( fn, content );
+
+	FSManager * mgr = get();
+	QString key = archive->path() + "|" + fn;
+
+	{
+		QMutexLocker lock( &mgr->cacheMutex );
+
+		auto it = mgr->cache.find( key );
+		if ( it != mgr->cache.end() ) {
+			mgr->lru.splice( mgr->lru.begin(), mgr->lru, it->lru );
+			mgr->stats.hits++;
+			content = it->data;
+			return true;
+		}
+
+		mgr->stats.misses++;
+	}
+
+	// Decompress without holding the lock
+	if ( !archive->fileContents( fn, content ) )
+		return false;
+
+	QMutexLocker lock( &mgr->cacheMutex );
+	if ( content.size() > mgr->stats.budget || mgr->cache.contains( key ) )
+		return true;
+
+	mgr->lru.push_front( key );
+	mgr->cache.insert( key, { content, fn, mgr->lru.begin() } );
+	mgr->stats.bytes += content.size();
+	mgr->evict();
+
+	return true;
+}
+
+// see fsmanager.h
+FSManager::CacheStats FSManager::cacheStats()
+{
+	FSManager * mgr = get();
+	QMutexLocker lock( &mgr->cacheMutex );
+
+	CacheStats s = mgr->stats;
+	s.files = mgr->cache.count();
+	for ( const CachedFile & f : mgr->cache ) {
+		if ( mgr->isPinned( f.path ) )
+			s.pinned++;
+	}
+
+	return s;
+}
+
+// see fsmanager.h
+void FSManager::setCacheBudget( qint64 bytes )
+{
+	FSManager * mgr = get();
+	QMutexLocker lock( &mgr->cacheMutex );
+
+	mgr->stats.budget = bytes;
+	mgr->evict();
+}
+
+// see fsmanager.h
+void FSManager::clearCache()
+{
+	FSManager * mgr = get();
+	QMutexLocker lock( &mgr->cacheMutex );
+
+	mgr->cache.clear();
+	mgr->lru.clear();
+	mgr->stats.bytes = 0;
+}
+
+// see fsmanager.h
+void FSManager::pinFiles( const void * owner, const QSet<QString> & paths )
+{
+	// Nothing is cached before the manager exists or after it is deleted
+	FSManager * mgr = theFSManager;
+	if ( !mgr )
+		return;
+
+	QMutexLocker lock( &mgr->cacheMutex );
+
+	if ( paths.isEmpty() )
+		mgr->pins.remove( owner );
+	else
+		mgr->pins.insert( owner, paths );
+
+	mgr->evict();
+}
+
+void FSManager::evict()
+{
+	auto it = lru.end();
+	while ( stats.bytes > stats.budget && it != lru.begin() ) {
+		--it;
+
+		auto file = cache.find( *it );
+		if ( isPinned( file->path ) )
+			continue;
+
+		stats.bytes -= file->data.size();
+		stats.evictions++;
+		cache.erase( file );
+		it = lru.erase( it );
+	}
+}
+
+bool FSManager::isPinned( const QString & path ) const
+{
+	for ( const QSet<QString> & p : pins ) {
+		if ( p.contains( path ) )
+			return true;
+	}
+	return false;
+}
+
 // see fsmanager.h
 FSManager::FSManager( QObject * parent )
 	: QObject( parent ), automatic( false )
 {
+	stats.budget = QSettings().value( "Settings/Resources/Archive Cache", 256 ).toLongLong() * 1048576;
+
 	initialize();
 }
 
@@ -87,6 +210,14 @@ FSManager::~FSManager()
 
 void FSManager::initialize()
 {
+	// The archives are opened again, drop what was read from the old ones
+	{
+		QMutexLocker lock( &cacheMutex );
+		cache.clear();
+		lru.clear();
+		stats.bytes = 0;
+	}
+
 	QSettings cfg;
 	QStringList list = cfg.value( "Settings/Resources/Archives", QStringList() ).toStringList();
 
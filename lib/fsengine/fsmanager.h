@@ -37,8 +37,12 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <QDialog>
 #include <QObject>
+#include <QHash>
 #include <QMap>
+#include <QMutex>
+#include <QSet>
 
+#include <list>
 #include <memory>
 
 class FSArchiveHandler;
@@ -58,6 +62,33 @@ public:
 	//! Gets the list of globally registered BSA files
 	static QList<FSArchiveFile *> archiveList();
 
+	//! Reads a file from an archive, keeping decompressed files in a cache shared by all windows
+	static bool fileContents( FSArchiveFile * archive, const QString & fn, QByteArray & content );
+
+	//! Counters of the decompressed file cache
+	struct CacheStats
+	{
+		qint64 bytes = 0;       //!< Bytes held by the cached files
+		qint64 budget = 0;      //!< Bytes the cache may hold before files are evicted
+		int files = 0;          //!< Number of cached files
+		int pinned = 0;         //!< Number of cached files which are pinned
+		quint64 hits = 0;       //!< Reads answered from the cache
+		quint64 misses = 0;     //!< Reads which had to decompress the file
+		quint64 evictions = 0;  //!< Files evicted to stay within the budget
+	};
+
+	//! Returns the counters of the decompressed file cache
+	static CacheStats cacheStats();
+	//! Sets the byte budget of the cache and evicts files to meet it; 0 disables the cache
+	static void setCacheBudget( qint64 bytes );
+	//! Removes all files from the cache
+	static void clearCache();
+	//! Keeps the files with the given paths inside the archives from being evicted
+	/*!
+	 * Replaces the files previously pinned by the owner; pass an empty set to release them.
+	 */
+	static void pinFiles( const void * owner, const QSet<QString> & paths );
+
 protected:
 	//! Constructor
 	FSManager( QObject * parent = nullptr );
@@ -74,6 +105,30 @@ protected:
 	static QStringList regPathBSAList( QString regKey, QString dataDir );
 
 	void initialize();
+
+	//! A decompressed file in the cache
+	struct CachedFile
+	{
+		QByteArray data;
+		//! The path inside the archive
+		QString path;
+		//! The position in FSManager::lru
+		std::list<QString>::iterator lru;
+	};
+
+	//! Evicts the least recently used files which are not pinned until the cache fits its budget
+	void evict();
+	//! Whether the file is pinned by any owner
+	bool isPinned( const QString & path ) const;
+
+	//! Decompressed files keyed by archive path and file path
+	QHash<QString, CachedFile> cache;
+	//! Keys of the cached files, most recently used first
+	std::list<QString> lru;
+	//! Pinned file paths by owner
+	QHash<const void *, QSet<QString>> pins;
+	CacheStats stats;
+	QMutex cacheMutex;
 	
 	friend class NifSkope;
 	friend class SettingsResources;
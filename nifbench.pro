@@ -0,0 +1,12 @@
+# Load time benchmark for the device and the mapped file paths, see src/nifbench.cpp
+include(NifSkope.pro)
+
+TARGET = nifbench
+
+# The benchmark provides its own main()
+DEFINES += NIF_BENCH
+CONFIG += console
+
+SOURCES += src/nifbench.cpp
+
+# vim: set filetype=config : 
@@ -35,12 +35,21 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "niftypes.h"
 
+#include <QBuffer>
 #include <QByteArray>
 #include <QColor>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
+#include <QRunnable>
+#include <QSettings>
+#include <QThreadPool>
 #include <QTime>
 
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
 
 //! @file basemodel.cpp Abstract base class for NIF data models
 
@@ -50,24 +59,83 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 BaseModel::BaseModel( QObject * p ) : QAbstractItemModel( p )
 {
-	root = new NifItem( 0 );
+	root = nullptr;
+	resetRoot();
 	parentWindow = qobject_cast<QWidget *>(p);
 	msgMode = TstMessage;
 }
 
 BaseModel::~BaseModel()
 {
-	delete root;
+	if ( root )
+		NifItem::destroyTree( root );
 }
 
-QWidget * BaseModel::getWindow()
+//! Destroys a released tree on a pool thread, then drops its arenas
+class NifTreeRelease final : public QRunnable
 {
-	return parentWindow;
+public:
+	NifTreeRelease( NifItem * root, const QVector<std::shared_ptr<NifItemArena>> & arenas )
+		: root( root ), arenas( arenas )
+	{
+	}
+
+	void run() override final
+	{
+		NifItem::destroyTree( root );
+		arenas.clear();
+	}
+
+private:
+	NifItem * root;
+	//! Items still reference their arena, so keep the arenas until the tree is gone
+	QVector<std::shared_ptr<NifItemArena>> arenas;
+};
+
+void BaseModel::resetRoot()
+{
+	auto oldArenas = arenas;
+	NifItem * oldRoot = root;
+	int oldItems = itemStatistics().items;
+
+	resets++;
+	arenas = { std::make_shared<NifItemArena>() };
+	root = new ( arenas.first().get() ) NifItem( nullptr );
+
+	if ( !oldRoot )
+		return;
+
+	// The slots go with the chunks of the arenas; the values and shared data of large trees
+	//	are destroyed off the GUI thread, nothing refers to the items after the reset
+	if ( oldItems < 4096 )
+		NifItem::destroyTree( oldRoot );
+	else
+		QThreadPool::globalInstance()->start( new NifTreeRelease( oldRoot, oldArenas ) );
+}
+
+void BaseModel::adoptArenas( const BaseModel * other )
+{
+	if ( !other || other == this )
+		return;
+
+	for ( const auto & a : other->arenas ) {
+		if ( !arenas.contains( a ) )
+			arenas.append( a );
+	}
 }
 
-void BaseModel::setEmitChanges( bool e )
+NifItemArena::Statistics BaseModel::itemStatistics() const
 {
-	emitChanges = e;
+	NifItemArena::Statistics stats;
+	for ( const auto & a : arenas )
+		stats += a->statistics();
+
+	return stats;
+}
+
+QWidget * BaseModel::getWindow()
+{
+	return parentWindow;
 }
 
 void BaseModel::setMessageMode( MsgMode mode )
@@ -82,6 +150,8 @@ void BaseModel::testMsg( const QString & m ) const
 
 void BaseModel::beginInsertRows( const QModelIndex & parent, int first, int last )
 {
+	invalidateSize( parent.isValid() ? static_cast<NifItem *>( parent.internalPointer() ) : root );
+
 	setState( Inserting );
 	QAbstractItemModel::beginInsertRows( parent, first, last );
 }
@@ -94,6 +164,17 @@ void BaseModel::endInsertRows()
 
 void BaseModel::beginRemoveRows( const QModelIndex & parent, int first, int last )
 {
+	// The items changed by a transaction may be among the removed rows
+	if ( transactionDepth )
+		flushEdits();
+
+	NifItem * parentItem = parent.isValid() ? static_cast<NifItem *>( parent.internalPointer() ) : root;
+	if ( parentItem == root ) {
+		for ( int r = first; r <= last; r++ )
+			invalidateSize( root->child( r ) );
+	}
+	invalidateSize( parentItem );
+
 	setState( Removing );
 	QAbstractItemModel::beginRemoveRows( parent, first, last );
 }
@@ -104,6 +185,238 @@ void BaseModel::endRemoveRows()
 	restoreState();
 }
 
+void BaseModel::recordValue( NifItem * item )
+{
+	if ( edits.positions.contains( item ) )
+		return;
+
+	edits.positions.insert( item, edits.items.count() );
+	edits.items.append( item );
+	edits.values.append( item->value() );
+}
+
+void BaseModel::recordArray( NifItem * array )
+{
+	if ( edits.positions.contains( array ) )
+		return;
+
+	ArrayValues values;
+	values.read( array );
+
+	edits.positions.insert( array, edits.arrays.count() );
+	edits.arrays.append( array );
+	edits.arrayValues.append( values );
+}
+
+//! The type of the elements of an array if all of them are stored inline
+static NifValue::Type inlineType( const NifItem * array )
+{
+	if ( array->childCount() == 0 )
+		return NifValue::tNone;
+
+	NifValue::Type type = array->childValue( 0 ).type();
+	if ( NifValue::inlineSize( type ) == 0 )
+		return NifValue::tNone;
+
+	for ( int i = 1; i < array->childCount(); i++ ) {
+		if ( array->childValue( i ).type() != type )
+			return NifValue::tNone;
+	}
+
+	return type;
+}
+
+void BaseModel::ArrayValues::read( const NifItem * array )
+{
+	// Read the packed storage directly, the element items are not created
+	count = array->childCount();
+	type = inlineType( array );
+	ranges.clear();
+	bytes.clear();
+	values.clear();
+
+	if ( count == 0 )
+		return;
+
+	ranges << 0 << count;
+
+	if ( type != NifValue::tNone ) {
+		int size = NifValue::inlineSize( type );
+		bytes.resize( count * size );
+
+		char * p = bytes.data();
+		for ( int i = 0; i < count; i++, p += size )
+			array->childValue( i ).storeInline( p );
+	} else {
+		values.reserve( count );
+		for ( int i = 0; i < count; i++ )
+			values.append( array->childValue( i ) );
+	}
+}
+
+bool BaseModel::ArrayValues::write( NifItem * array ) const
+{
+	if ( array->childCount() != count )
+		return false;
+
+	int size = NifValue::inlineSize( type );
+	int v = 0;
+
+	for ( int r = 0; r < ranges.count(); r += 2 ) {
+		int last = ranges.at( r ) + ranges.at( r + 1 );
+
+		for ( int i = ranges.at( r ); i < last; i++, v++ ) {
+			if ( type != NifValue::tNone )
+				array->childValue( i ).loadInline( type, bytes.constData() + v * size );
+			else
+				array->childValue( i ) = values.at( v );
+		}
+	}
+
+	return true;
+}
+
+void BaseModel::ArrayValues::diff( const NifItem * array, ArrayValues & after )
+{
+	// Keep everything if the array was resized or its elements changed type
+	if ( type == NifValue::tNone || array->childCount() != count || inlineType( array ) != type ) {
+		after.read( array );
+		return;
+	}
+
+	int size = NifValue::inlineSize( type );
+	QByteArray current( size, Qt::Uninitialized );
+
+	QVector<int> changed;
+	QByteArray before;
+
+	after = ArrayValues();
+	after.count = count;
+	after.type = type;
+
+	for ( int i = 0; i < count; i++ ) {
+		const char * old = bytes.constData() + i * size;
+		array->childValue( i ).storeInline( current.data() );
+
+		if ( memcmp( old, current.constData(), size ) == 0 )
+			continue;
+
+		// Extend the last range or start a new one
+		if ( !changed.isEmpty() && changed.at( changed.count() - 2 ) + changed.last() == i )
+			changed.last()++;
+		else
+			changed << i << 1;
+
+		before.append( old, size );
+		after.bytes.append( current );
+	}
+
+	ranges = changed;
+	bytes = before;
+	after.ranges = changed;
+}
+
+qint64 BaseModel::ArrayValues::byteSize() const
+{
+	qint64 size = sizeof(ArrayValues) + ranges.count() * sizeof(int) + bytes.size();
+
+	for ( const NifValue & v : values ) {
+		size += sizeof(NifValue);
+		if ( v.isString() )
+			size += v.get<QString>().size() * sizeof(QChar);
+		else if ( v.isByteArray() )
+			size += v.get<QByteArray *>()->size();
+	}
+
+	return size;
+}
+
+qint64 BaseModel::Edits::byteSize() const
+{
+	qint64 size = items.count() * ( sizeof(NifItem *) + sizeof(NifValue) )
+		+ positions.count() * ( sizeof(NifItem *) + sizeof(int) );
+
+	for ( const NifValue & v : values ) {
+		if ( v.isString() )
+			size += v.get<QString>().size() * sizeof(QChar);
+		else if ( v.isByteArray() )
+			size += v.get<QByteArray *>()->size();
+	}
+
+	for ( const ArrayValues & array : arrayValues )
+		size += sizeof(NifItem *) + array.byteSize();
+
+	return size;
+}
+
+void BaseModel::valueChanged( NifItem * item )
+{
+	if ( !NifValue::isFixedSize( item->value().type() ) )
+		invalidateSize( item );
+
+	// Emitted once per range when the transaction ends
+	if ( transactionDepth )
+		return;
+
+	if ( state != Processing )
+		emit dataChanged( createIndex( item->row(), ValueCol, item ), createIndex( item->row(), ValueCol, item ) );
+	else
+		changedWhileProcessing = true;
+}
+
+void BaseModel::arrayChanged( NifItem * array )
+{
+	if ( array->childCount() > 0 && !NifValue::isFixedSize( array->childValue( 0 ).type() ) )
+		invalidateSize( array );
+
+	if ( transactionDepth )
+		return;
+
+	int x = array->childCount() - 1;
+
+	if ( x >= 0 )
+		emit dataChanged( createIndex( 0, ValueCol, array->child( 0 ) ), createIndex( x, ValueCol, array->child( x ) ) );
+}
+
+void BaseModel::flushEdits()
+{
+	if ( state == Processing ) {
+		changedWhileProcessing |= !edits.items.isEmpty() || !edits.arrays.isEmpty();
+	} else {
+		// Group the changed rows by parent, one signal per contiguous range
+		QHash<NifItem *, QVector<int>> changed;
+		for ( NifItem * item : edits.items ) {
+			if ( item->parent() )
+				changed[item->parent()].append( item->row() );
+		}
+
+		for ( NifItem * array : edits.arrays ) {
+			QVector<int> & rows = changed[array];
+			for ( int i = 0; i < array->childCount(); i++ )
+				rows.append( i );
+		}
+
+		for ( auto it = changed.begin(); it != changed.end(); ++it ) {
+			NifItem * parent = it.key();
+			QVector<int> & rows = it.value();
+			std::sort( rows.begin(), rows.end() );
+
+			for ( int i = 0; i < rows.count(); ) {
+				int first = rows.at( i );
+				int last = first;
+				while ( ++i < rows.count() && rows.at( i ) <= last + 1 )
+					last = rows.at( i );
+
+				emit dataChanged( createIndex( first, ValueCol, parent->child( first ) ), createIndex( last, ValueCol, parent->child( last ) ) );
+			}
+		}
+	}
+
+	// The items may be removed next, so there is nothing left to undo
+	edits = Edits();
+	edits.structural = true;
+}
+
 bool BaseModel::getProcessingResult()
 {
 	bool result = changedWhileProcessing;
@@ -622,6 +935,14 @@ Qt::ItemFlags BaseModel::flags( const QModelIndex & index ) const
  *  load and save
  */
 
+bool BaseModel::load( const QByteArray & data )
+{
+	QBuffer buf;
+	buf.setData( data );
+
+	return buf.open( QIODevice::ReadOnly ) && load( buf );
+}
+
 bool BaseModel::loadFromFile( const QString & file )
 {
 	QFile f( file );
@@ -629,16 +950,37 @@ bool BaseModel::loadFromFile( const QString & file )
 
 	setState( Loading );
 
-	if ( f.exists() && finfo.isFile() && f.open( QIODevice::ReadOnly ) && load( f ) ) {
+	if ( !f.exists() || !finfo.isFile() || !f.open( QIODevice::ReadOnly ) ) {
+		resetState();
+		return false;
+	}
+
+	QElapsedTimer t;
+	t.start();
+
+	// Decode straight from the mapped file when possible instead of going through QIODevice
+	uchar * mapped = nullptr;
+	if ( QSettings().value( "Memory Map Files", true ).toBool() && f.size() > 0 && f.size() <= INT_MAX )
+		mapped = f.map( 0, f.size() );
+
+	bool loaded = false;
+	if ( mapped ) {
+		loaded = load( QByteArray::fromRawData( (const char *)mapped, int( f.size() ) ) );
+		f.unmap( mapped );
+	} else {
+		loaded = load( f );
+	}
+
+	qCDebug( nsIo ) << "Loaded" << finfo.fileName() << (mapped ? "(mapped)" : "(device)") << "in" << t.elapsed() << "ms";
+
+	if ( loaded ) {
 		fileinfo = finfo;
 		filename = finfo.baseName();
 		folder = finfo.absolutePath();
-		resetState();
-		return true;
 	}
 
 	resetState();
-	return false;
+	return loaded;
 }
 
 bool BaseModel::saveToFile( const QString & filename ) const
@@ -675,6 +1017,11 @@ NifItem * BaseModel::getItem( NifItem * item, const QString & name ) const
 		return getItem( getItem( item, left ), right );
 	}
 
+	if ( item->isPacked() ) {
+		NifItem * child = item->child( name );
+		return ( child && evalCondition( child ) ) ? child : nullptr;
+	}
+
 	for ( int c = 0; c < item->childCount(); c++ ) {
 		NifItem * child = item->child( c );
 
@@ -685,6 +1032,31 @@ NifItem * BaseModel::getItem( NifItem * item, const QString & name ) const
 	return nullptr;
 }
 
+NifItem * BaseModel::getItem( NifItem * item, NifAtom name ) const
+{
+	if ( !item || item == root )
+		return nullptr;
+
+	if ( item->isPacked() ) {
+		NifItem * child = item->child( name );
+		return ( child && evalCondition( child ) ) ? child : nullptr;
+	}
+
+	for ( int c = item->firstRow( name ); c >= 0 && c < item->childCount(); c++ ) {
+		NifItem * child = item->child( c );
+
+		if ( child->atom() == name && evalCondition( child ) )
+			return child;
+	}
+
+	return nullptr;
+}
+
+NifItem * BaseModel::getItem( NifItem * parent, const Expression::Field & field ) const
+{
+	return getItem( parent, field.name );
+}
+
 /*
 *  Uses implicit load order
 */
@@ -734,6 +1106,21 @@ QModelIndex BaseModel::getIndex( const QModelIndex & parent, const QString & nam
 	return QModelIndex();
 }
 
+QModelIndex BaseModel::getIndex( const QModelIndex & parent, NifAtom name ) const
+{
+	NifItem * parentItem = static_cast<NifItem *>( parent.internalPointer() );
+
+	if ( !( parent.isValid() && parentItem && parent.model() == this ) )
+		return QModelIndex();
+
+	NifItem * item = getItem( parentItem, name );
+
+	if ( item )
+		return createIndex( item->row(), 0, item );
+
+	return QModelIndex();
+}
+
 /*
  *  conditions and version
  */
@@ -807,59 +1194,60 @@ BaseModelEval::BaseModelEval( const BaseModel * model, const NifItem * item )
 	this->item  = item;
 }
 
-QVariant BaseModelEval::operator()(const QVariant & v) const
+quint32 BaseModelEval::operator()( const Expression::Field & field ) const
 {
-	if ( v.type() == QVariant::String ) {
-		QString left = v.toString();
-		const NifItem * i = item;
+	const NifItem * i = item;
+	const NifItem * sibling = nullptr;
+	QString left = field.name;
 
-		// resolve "ARG"
+	// resolve "ARG"
+	if ( left == "ARG" ) {
 		while ( left == "ARG" ) {
 			if ( !i->parent() )
-				return false;
+				return 0;
 
 			i = i->parent();
 			left = i->arg();
 		}
 
-		// resolve reference to sibling
-		const NifItem * sibling = model->getItem( i->parent(), left );
-
-		if ( sibling ) {
-			if ( sibling->value().isCount() ) {
-				return QVariant( sibling->value().toCount() );
-			} else if ( sibling->value().isFileVersion() ) {
-				return QVariant( sibling->value().toFileVersion() );
-			// this is tricky to understand
-			// we check whether the reference is an array
-			// if so, we get the current item's row number (i->row())
-			// and get the sibling's child at that row number
-			// this is used for instance to describe array sizes of strips
-			} else if ( sibling->childCount() > 0 ) {
-				const NifItem * i2 = sibling->child( i->row() );
-
-				if ( i2 && i2->value().isCount() )
-					return QVariant( i2->value().toCount() );
-			} else {
-				qDebug() << ("can't convert " + left + " to a count");
-			}
-		}
+		sibling = model->getItem( i->parent(), left );
+	} else {
+		// resolve reference to sibling, using the rows resolved at load
+		sibling = model->getItem( i->parent(), field );
+	}
 
-		// resolve reference to block type
-		// is the condition string a type?
-		if ( model->isAncestorOrNiBlock( left ) ) {
-			// get the type of the current block
-			const NifItem * block = i;
+	if ( sibling ) {
+		if ( sibling->value().isCount() ) {
+			return sibling->value().toCount();
+		} else if ( sibling->value().isFileVersion() ) {
+			return sibling->value().toFileVersion();
+		// this is tricky to understand
+		// we check whether the reference is an array
+		// if so, we get the current item's row number (i->row())
+		// and get the sibling's child at that row number
+		// this is used for instance to describe array sizes of strips
+		} else if ( sibling->childCount() > 0 ) {
+			const NifItem * i2 = sibling->child( i->row() );
+
+			if ( i2 && i2->value().isCount() )
+				return i2->value().toCount();
+		} else {
+			qDebug() << ("can't convert " + left + " to a count");
+		}
+	}
 
-			while ( block->parent() && block->parent()->parent() ) {
-				block = block->parent();
-			}
+	// resolve reference to block type
+	// is the condition string a type?
+	if ( model->isAncestorOrNiBlock( left ) ) {
+		// get the type of the current block
+		const NifItem * block = i;
 
-			return QVariant( model->inherits( block->name(), left ) );
+		while ( block->parent() && block->parent()->parent() ) {
+			block = block->parent();
 		}
 
-		return QVariant( 0 );
+		return model->inherits( block->name(), left );
 	}
 
-	return v;
+	return 0;
 }
@@ -39,12 +39,15 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <QAbstractItemModel> // Inherited
 #include <QFileInfo>
+#include <QHash>
 #include <QIODevice>
 #include <QStack>
 #include <QString>
 #include <QVariant>
 #include <QVector>
 
+#include <memory>
+
 
 //! @file basemodel.h BaseModel, BaseModelEval
 
@@ -74,6 +77,8 @@ public:
 	virtual void clear() = 0;
 	//! Generic load from QIODevice.
 	virtual bool load( QIODevice & device ) = 0;
+	//! Generic load from memory, e.g. a mapped file or archive entry.
+	virtual bool load( const QByteArray & data );
 	//! Generic save to QIODevice.
 	virtual bool save( QIODevice & device ) const = 0;
 	//! Get version as a string
@@ -89,6 +94,10 @@ public:
 	template <typename T> bool set( const QModelIndex & index, const T & d );
 	//! Set an item by name.
 	template <typename T> bool set( const QModelIndex & parent, const QString & name, const T & v );
+	//! Get an item by name atom.
+	template <typename T> T get( const QModelIndex & parent, NifAtom name ) const;
+	//! Set an item by name atom.
+	template <typename T> bool set( const QModelIndex & parent, NifAtom name, const T & v );
 
 	//! Get a model index array as a QVector.
 	template <typename T> QVector<T> getArray( const QModelIndex & iArray ) const;
@@ -187,6 +196,8 @@ public:
 
 	//! Find a branch by name.
 	QModelIndex getIndex( const QModelIndex & parent, const QString & name ) const;
+	//! Get an index by name atom
+	QModelIndex getIndex( const QModelIndex & parent, NifAtom name ) const;
 
 	//! Evaluate condition and version.
 	bool evalCondition( const QModelIndex & idx, bool chkParents = false ) const;
@@ -226,6 +237,9 @@ public:
 	//! Get Messages collected
 	QList<TestMessage> getMessages() const { QList<TestMessage> lst = messages; messages.clear(); return lst; }
 
+	//! Get the allocation statistics of the item arenas
+	NifItemArena::Statistics itemStatistics() const;
+
 	//! Column names
 	enum
 	{
@@ -280,12 +294,6 @@ public:
 
 	// end QAbstractItemModel
 
-	// Terrible hack for atomic-like operations
-	//	Setting this to false will suspend dataChanged in set<T>
-	//	Doing so is necessary for performance reasons with setting thousands of rows at once
-	//	e.g. Update Tangent Space with BSTriShapes
-	void setEmitChanges( bool e );
-
 	enum MsgMode
 	{
 		UserMessage, TstMessage
@@ -302,6 +310,10 @@ signals:
 protected:
 	//! Get an item
 	virtual NifItem * getItem( NifItem * parent, const QString & name ) const;
+	//! Get an item by name atom
+	virtual NifItem * getItem( NifItem * parent, NifAtom name ) const;
+	//! Find a field referenced by an expression
+	virtual NifItem * getItem( NifItem * parent, const Expression::Field & field ) const;
 	//! Set an item value
 	virtual bool setItemValue( NifItem * item, const NifValue & v ) = 0;
 
@@ -326,6 +338,10 @@ protected:
 
 	//! Set an item by name
 	template <typename T> bool set( NifItem * parent, const QString & name, const T & d );
+	//! Get an item by name atom
+	template <typename T> T get( NifItem * parent, NifAtom name ) const;
+	//! Set an item by name atom
+	template <typename T> bool set( NifItem * parent, NifAtom name, const T & d );
 	//! Set an item
 	template <typename T> bool set( NifItem * item, const T & d );
 
@@ -351,11 +367,88 @@ protected:
 	void beginRemoveRows( const QModelIndex & parent, int first, int last );
 	void endRemoveRows();
 
+	/*! Element values of an array recorded by a transaction
+	 *
+	 * Elements which are stored inline, e.g. vectors, are packed as their raw
+	 * storage, the others are kept as values. Only the elements in the recorded
+	 * ranges are held, so a diff of a few changed elements stays small.
+	 */
+	struct ArrayValues
+	{
+		//! The number of elements of the array
+		int count = 0;
+		//! The type of the elements if all of them are stored inline, else NifValue::tNone
+		NifValue::Type type = NifValue::tNone;
+		//! The first element and the length of each recorded range
+		QVector<int> ranges;
+		//! The inline storage of the recorded elements
+		QByteArray bytes;
+		//! The recorded elements if they are not stored inline
+		QVector<NifValue> values;
+
+		//! Record all elements of an array
+		void read( const NifItem * array );
+		//! Set the recorded elements of an array, unless its size changed
+		bool write( NifItem * array ) const;
+		//! Keep only the elements which differ in an array and record their current values in after
+		void diff( const NifItem * array, ArrayValues & after );
+		//! The memory held by the recorded elements
+		qint64 byteSize() const;
+	};
+
+	//! Values changed while a transaction is open
+	struct Edits
+	{
+		//! The changed items in the order of their first change
+		QVector<NifItem *> items;
+		//! The value of each item before its first change
+		QVector<NifValue> values;
+		//! The arrays whose elements were set as a whole
+		QVector<NifItem *> arrays;
+		//! The element values of each array before its first change
+		QVector<ArrayValues> arrayValues;
+		//! The position of each item and array in its list
+		QHash<NifItem *, int> positions;
+		//! Whether rows were removed meanwhile, which leaves nothing to undo
+		bool structural = false;
+
+		//! The memory held by the recorded values
+		qint64 byteSize() const;
+	};
+
+	//! Record the value of an item before it is changed in a transaction
+	void recordValue( NifItem * item );
+	//! Record the element values of an array before they are set in a transaction
+	void recordArray( NifItem * array );
+	//! Notify the views of a changed value, or defer it to the end of the transaction
+	void valueChanged( NifItem * item );
+	//! Notify the views of changed array elements, or defer it to the end of the transaction
+	void arrayChanged( NifItem * array );
+	//! Apply what a transaction deferred, e.g. before rows it changed are removed
+	virtual void flushEdits();
+	//! Forget the size in the file of the block holding an item, see NifModel::fileOffset()
+	virtual void invalidateSize( const NifItem * item ) { Q_UNUSED( item ); }
+
+	//! Counts the resets of the tree; items recorded before one are gone
+	quint32 resets = 0;
+
+	//! The number of open transactions
+	int transactionDepth = 0;
+	//! The values changed by the open transactions
+	Edits edits;
+
 	//! NifSkope window the model belongs to
 	QWidget * parentWindow;
 
+	//! Replace the root item with an empty one, releasing the item arenas in bulk
+	void resetRoot();
+	//! Keep the arenas of another model alive for items moved from it
+	void adoptArenas( const BaseModel * other );
+
 	//! The root item
 	NifItem * root;
+	//! The item arenas; new items are allocated from the first one
+	QVector<std::shared_ptr<NifItemArena>> arenas;
 
 	//! The filepath of the model
 	QString folder;
@@ -364,9 +457,6 @@ protected:
 	//! The file info for the model
 	QFileInfo fileinfo;
 
-	// Whether or not to emit dataChanged() in set<T>
-	bool emitChanges = true;
-
 	//! A list of test messages
 	mutable QList<TestMessage> messages;
 	//! Handle a test message
@@ -391,7 +481,7 @@ public:
 	BaseModelEval( const BaseModel * model, const NifItem * item );
 
 	//! Evaluation function
-	QVariant operator()( const QVariant & v ) const;
+	quint32 operator()( const Expression::Field & field ) const;
 
 private:
 	const BaseModel * model;
@@ -451,6 +541,56 @@ template <typename T> inline bool BaseModel::set( const QModelIndex & parent, co
 	return false;
 }
 
+template <typename T> inline T BaseModel::get( NifItem * parent, NifAtom name ) const
+{
+	NifItem * item = getItem( parent, name );
+
+	if ( item )
+		return item->value().get<T>();
+
+	return T();
+}
+
+template <typename T> inline T BaseModel::get( const QModelIndex & parent, NifAtom name ) const
+{
+	NifItem * parentItem = static_cast<NifItem *>( parent.internalPointer() );
+
+	if ( !( parent.isValid() && parentItem && parent.model() == this ) )
+		return T();
+
+	NifItem * item = getItem( parentItem, name );
+
+	if ( item )
+		return item->value().get<T>();
+
+	return T();
+}
+
+template <typename T> inline bool BaseModel::set( NifItem * parent, NifAtom name, const T & d )
+{
+	NifItem * item = getItem( parent, name );
+
+	if ( item )
+		return set( item, d );
+
+	return false;
+}
+
+template <typename T> inline bool BaseModel::set( const QModelIndex & parent, NifAtom name, const T & d )
+{
+	NifItem * parentItem = static_cast<NifItem *>( parent.internalPointer() );
+
+	if ( !( parent.isValid() && parentItem && parent.model() == this ) )
+		return false;
+
+	NifItem * item = getItem( parentItem, name );
+
+	if ( item )
+		return set( item, d );
+
+	return false;
+}
+
 template <typename T> inline T BaseModel::get( NifItem * item ) const
 {
 	return item->value().get<T>();
@@ -468,12 +608,11 @@ template <typename T> inline T BaseModel::get( const QModelIndex & index ) const
 
 template <typename T> inline bool BaseModel::set( NifItem * item, const T & d )
 {
-	if ( item->value().set( d ) ) {
-		if ( state != Processing )
-			emit dataChanged( createIndex( item->row(), ValueCol, item ), createIndex( item->row(), ValueCol, item ) );
-		else
-			changedWhileProcessing = true;
+	if ( transactionDepth )
+		recordValue( item );
 
+	if ( item->value().set( d ) ) {
+		valueChanged( item );
 		return true;
 	}
 
@@ -510,11 +649,11 @@ template <typename T> inline void BaseModel::setArray( const QModelIndex & iArra
 	NifItem * item = static_cast<NifItem *>( iArray.internalPointer() );
 
 	if ( isArray( iArray ) && item && iArray.model() == this ) {
-		item->setArray<T>( array );
-		int x = item->childCount() - 1;
+		if ( transactionDepth )
+			recordArray( item );
 
-		if ( x >= 0 )
-			emit dataChanged( createIndex( 0, ValueCol, item->child( 0 ) ), createIndex( x, ValueCol, item->child( x ) ) );
+		item->setArray<T>( array );
+		arrayChanged( item );
 	}
 }
 
@@ -523,11 +662,11 @@ template <typename T> inline void BaseModel::setArray( const QModelIndex & iArra
 	NifItem * item = static_cast<NifItem *>(iArray.internalPointer());
 
 	if ( isArray( iArray ) && item && iArray.model() == this ) {
-		item->setArray<T>( val );
-		int x = item->childCount() - 1;
+		if ( transactionDepth )
+			recordArray( item );
 
-		if ( x >= 0 )
-			emit dataChanged( createIndex( 0, ValueCol, item->child( 0 ) ), createIndex( x, ValueCol, item->child( x ) ) );
+		item->setArray<T>( val );
+		arrayChanged( item );
 	}
 }
 
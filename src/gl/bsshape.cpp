@@ -123,27 +123,31 @@ void BSShape::update( const NifModel * nif, const QModelIndex & index )
 		// For compatibility with coords QList
 		QVector<Vector2> coordset;
 
+		static const NifAtom atomVertex( "Vertex" ), atomUV( "UV" ), atomNormal( "Normal" ), atomTangent( "Tangent" ),
+			atomBitangentX( "Bitangent X" ), atomBitangentY( "Bitangent Y" ), atomBitangentZ( "Bitangent Z" ),
+			atomVertexColors( "Vertex Colors" );
+
 		for ( int i = 0; i < numVerts; i++ ) {
 			auto idx = nif->index( i, 0, iVertData );
 
 			if ( !isDynamic )
-				verts << nif->get<Vector3>( idx, "Vertex" );
+				verts << nif->get<Vector3>( idx, atomVertex );
 
-			coordset << nif->get<HalfVector2>( idx, "UV" );
+			coordset << nif->get<HalfVector2>( idx, atomUV );
 
 			// Bitangent X
-			auto bitX = nif->getValue( nif->getIndex( idx, "Bitangent X" ) ).toFloat();
+			auto bitX = nif->getValue( nif->getIndex( idx, atomBitangentX ) ).toFloat();
 			// Bitangent Y/Z
-			auto bitYi = nif->getValue( nif->getIndex( idx, "Bitangent Y" ) ).toCount();
-			auto bitZi = nif->getValue( nif->getIndex( idx, "Bitangent Z" ) ).toCount();
+			auto bitYi = nif->getValue( nif->getIndex( idx, atomBitangentY ) ).toCount();
+			auto bitZi = nif->getValue( nif->getIndex( idx, atomBitangentZ ) ).toCount();
 			auto bitY = (double( bitYi ) / 255.0) * 2.0 - 1.0;
 			auto bitZ = (double( bitZi ) / 255.0) * 2.0 - 1.0;
 
-			norms += nif->get<ByteVector3>( idx, "Normal" );
-			tangents += nif->get<ByteVector3>( idx, "Tangent" );
+			norms += nif->get<ByteVector3>( idx, atomNormal );
+			tangents += nif->get<ByteVector3>( idx, atomTangent );
 			bitangents += Vector3( bitX, bitY, bitZ );
 
-			auto vcIdx = nif->getIndex( idx, "Vertex Colors" );
+			auto vcIdx = nif->getIndex( idx, atomVertexColors );
 			if ( vcIdx.isValid() ) {
 				colors += nif->get<ByteColor4>( vcIdx );
 			}
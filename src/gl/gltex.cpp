@@ -137,16 +137,20 @@ TexCache::TexCache( QObject * parent ) : QObject( parent )
 {
 	watcher = new QFileSystemWatcher( this );
 	connect( watcher, &QFileSystemWatcher::fileChanged, this, &TexCache::fileChanged );
+
+	pinning = QSettings().value( "Settings/Resources/Pin Dependencies", true ).toBool();
 }
 
 TexCache::~TexCache()
 {
 	//flush();
+	FSManager::pinFiles( this, QSet<QString>() );
 }
 
 QString TexCache::find( const QString & file, const QString & nifdir )
 {
-	return find( file, nifdir, *(new QByteArray()) );
+	QByteArray data;
+	return find( file, nifdir, data );
 }
 
 QString TexCache::find( const QString & file, const QString & nifdir, QByteArray & data )
@@ -241,7 +245,7 @@ QString TexCache::find( const QString & file, const QString & nifdir, QByteArray
 				filename = QDir::fromNativeSeparators( filename.toLower() );
 				if ( archive->hasFile( filename ) ) {
 					QByteArray outData;
-					archive->fileContents( filename, outData );
+					FSManager::fileContents( archive, filename, outData );
 
 					if ( !outData.isEmpty() ) {
 						data = outData;
@@ -357,18 +361,27 @@ int TexCache::bind( const QString & fname )
 
 	QByteArray outData;
 
-	if ( tx->filepath.isEmpty() || tx->reload )
+	if ( tx->filepath.isEmpty() || tx->reload ) {
 		tx->filepath = find( tx->filename, nifFolder, outData );
+		tx->archivePath = outData.isEmpty() ? QString() : QDir::fromNativeSeparators( tx->filepath );
+	}
 
 	if ( !outData.isEmpty() || tx->reload ) {
 		tx->data = outData;
 	}
 
+	// Textures shared with the previous file are bound without a lookup, so pin them on every bind
+	if ( !tx->archivePath.isEmpty() )
+		pin( tx->archivePath );
+
 	if ( !tx->id || tx->reload ) {
 		if ( QFile::exists( tx->filepath ) && QFileInfo( tx->filepath ).isWritable() && ( !watcher->files().contains( tx->filepath ) ) )
 			watcher->addPath( tx->filepath );
 
 		tx->load();
+
+		// The data may be a view onto an archive, which is closed when the archives are changed
+		tx->data = QByteArray();
 	}
 
 	glBindTexture( GL_TEXTURE_2D, tx->id );
@@ -434,18 +447,25 @@ int TexCache::bindCube( const QString & fname )
 
 	QByteArray outData;
 
-	if ( tx->filepath.isEmpty() || tx->reload )
+	if ( tx->filepath.isEmpty() || tx->reload ) {
 		tx->filepath = find( tx->filename, nifFolder, outData );
+		tx->archivePath = outData.isEmpty() ? QString() : QDir::fromNativeSeparators( tx->filepath );
+	}
 
-	if ( !outData.isEmpty() ) {
+	if ( !outData.isEmpty() )
 		tx->data = outData;
-	}
+
+	if ( !tx->archivePath.isEmpty() )
+		pin( tx->archivePath );
 
 	if ( !tx->id || tx->reload ) {
 		if ( QFile::exists( tx->filepath ) && QFileInfo( tx->filepath ).isWritable() && (!watcher->files().contains( tx->filepath )) )
 			watcher->addPath( tx->filepath );
 
 		tx->loadCube();
+
+		// The data may be a view onto an archive, which is closed when the archives are changed
+		tx->data = QByteArray();
 	}
 
 	glBindTexture( GL_TEXTURE_CUBE_MAP, tx->id );
@@ -475,6 +495,23 @@ void TexCache::flush()
 	}
 }
 
+void TexCache::pin( const QString & filepath )
+{
+	if ( !pinning || pinned.contains( filepath ) )
+		return;
+
+	pinned.insert( filepath );
+	FSManager::pinFiles( this, pinned );
+}
+
+void TexCache::unpinFiles()
+{
+	pinned.clear();
+	FSManager::pinFiles( this, pinned );
+
+	pinning = QSettings().value( "Settings/Resources/Pin Dependencies", true ).toBool();
+}
+
 void TexCache::setNifFolder( const QString & folder )
 {
 	nifFolder = folder;
@@ -39,6 +39,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QByteArray>
 #include <QHash>
 #include <QPersistentModelIndex>
+#include <QSet>
 #include <QString>
 
 
@@ -67,6 +68,8 @@ class TexCache final : public QObject
 		QString filename;
 		//! The texture file path.
 		QString filepath;
+		//! The path of the file in an archive, empty if it is on disk
+		QString archivePath;
 		//! The texture data (if not in the filesystem)
 		QByteArray data;
 		//! ID for use with GL texture functions
@@ -137,6 +140,9 @@ public slots:
 	 */
 	void setNifFolder( const QString & );
 
+	//! Releases the archive files pinned for the textures of the previous file
+	void unpinFiles();
+
 protected slots:
 	void fileChanged( const QString & filepath );
 
@@ -146,6 +152,14 @@ protected:
 	QFileSystemWatcher * watcher;
 
 	QString nifFolder;
+
+	//! Pins an archive file in the FSManager cache while the file is open
+	void pin( const QString & filepath );
+
+	//! Archive files holding the textures of the open file
+	QSet<QString> pinned;
+	//! The "Pin Dependencies" setting, read again for each file
+	bool pinning;
 };
 
 float get_max_anisotropy();
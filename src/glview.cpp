@@ -1188,6 +1188,9 @@ void GLView::dataChanged( const QModelIndex & idx, const QModelIndex & xdi )
 
 void GLView::modelChanged()
 {
+	// A different file was loaded
+	textures->unpinFiles();
+
 	if ( doCompile )
 		return;
 
@@ -567,6 +567,9 @@ void import3ds( NifModel * nif, const QModelIndex & index )
 
 	//--Translate file structures into NIF ones--//
 
+	// Links, header and footer are updated once at the end. Not undoable, as blocks are inserted.
+	NifTransaction transaction( nif );
+
 	if ( iNode.isValid() == false ) {
 		iNode = nif->insertNiBlock( "NiNode" );
 		nif->set<QString>( iNode, "Name", "Scene Root" );
@@ -756,6 +759,7 @@ void import3ds( NifModel * nif, const QModelIndex & index )
 	settings.endGroup(); // 3DS
 	settings.endGroup(); // Import-Export
 
+	transaction.commit();
 	nif->reset();
 	return;
 }
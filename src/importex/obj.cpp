@@ -715,6 +715,9 @@ void importObj( NifModel * nif, const QModelIndex & index )
 
 	//--Translate file structures into NIF ones--//
 
+	// Links, header and footer are updated once at the end. Not undoable, as blocks are inserted.
+	NifTransaction transaction( nif );
+
 	if ( iNode.isValid() == false ) {
 		iNode = nif->insertNiBlock( "NiNode" );
 		nif->set<QString>( iNode, "Name", "Scene Root" );
@@ -1061,6 +1064,7 @@ void importObj( NifModel * nif, const QModelIndex & index )
 	settings.endGroup(); // OBJ
 	settings.endGroup(); // Import-Export
 
+	transaction.commit();
 	nif->reset();
 }
 
@@ -99,7 +99,7 @@ void KfmModel::clear()
 	fileinfo = QFileInfo();
 	filename = QString();
 	folder = QString();
-	root->killChildren();
+	resetRoot();
 	insertType( root, NifData( "Kfm", "Kfm" ) );
 	kfmroot = root->child( 0 );
 	version = 0x0200000b;
@@ -0,0 +1,67 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#ifndef NIFATOM_H
+#define NIFATOM_H
+
+#include <QHash>
+#include <QString>
+
+
+//! @file nifatom.h NifAtom
+
+//! An interned field name, compared as an integer instead of a string
+class NifAtom final
+{
+public:
+	NifAtom() {}
+	//! Interns a field name
+	explicit NifAtom( const QString & name ) : id( intern( name ) ) {}
+	explicit NifAtom( const char * name ) : id( intern( QLatin1String( name ) ) ) {}
+
+	//! Whether the atom refers to a name
+	bool isValid() const { return id >= 0; }
+	//! The interned name
+	QString name() const;
+
+	bool operator==( const NifAtom & other ) const { return id == other.id; }
+	bool operator!=( const NifAtom & other ) const { return id != other.id; }
+
+	friend inline uint qHash( const NifAtom & atom ) { return uint( atom.id ); }
+
+private:
+	static int intern( const QString & name );
+
+	int id = -1;
+};
+
+#endif
@@ -166,7 +166,8 @@ void Expression::partition( const QString & cond, int offset /*= 0*/ )
 	QRegularExpressionMatch reUnaryMatch = reUnary.match( cond, offset );
 	pos = reUnaryMatch.capturedStart();
 	if ( pos != -1 ) {
-		Expression e( reUnaryMatch.captured( 1 ).trimmed() );
+		Expression e;
+		e.partition( reUnaryMatch.captured( 1 ).trimmed() );
 		opcode = Expression::e_not;
 		rhs = QVariant::fromValue( e );
 		return;
@@ -218,7 +219,7 @@ void Expression::partition( const QString & cond, int offset /*= 0*/ )
 			lhs.setValue( cond );
 
 			if ( reUInt.match( cond ).hasMatch() ) {
-				lhs.convert( QVariant::UInt );
+				lhs.setValue( cond.toUInt( nullptr, 16 ) );
 			} else if ( reInt.match( cond ).hasMatch() ) {
 				lhs.convert( QVariant::Int );
 			} else if ( reVersion.match( cond ).hasMatch() ) {
@@ -233,8 +234,9 @@ void Expression::partition( const QString & cond, int offset /*= 0*/ )
 	rstartpos = oendpos + 1;
 	rendpos = cond.size() - 1;
 
-	Expression lhsexp( cond.mid( lstartpos, lendpos - lstartpos + 1 ).trimmed() );
-	Expression rhsexp( cond.mid( rstartpos, rendpos - rstartpos + 1 ).trimmed() );
+	Expression lhsexp, rhsexp;
+	lhsexp.partition( cond.mid( lstartpos, lendpos - lstartpos + 1 ).trimmed() );
+	rhsexp.partition( cond.mid( rstartpos, rendpos - rstartpos + 1 ).trimmed() );
 
 	if ( lhsexp.opcode == Expression::e_nop ) {
 		lhs = lhsexp.lhs;
@@ -300,22 +302,84 @@ QString Expression::toString() const
 	return QString();
 }
 
-void Expression::NormalizeVariants( QVariant & l, QVariant & r ) const
+void Expression::compile()
 {
-	if ( l.isValid() && r.isValid() ) {
-		if ( l.type() != r.type() ) {
-			if ( l.type() == QVariant::String && l.canConvert( r.type() ) )
-				l.convert( r.type() );
-			else if ( r.type() == QVariant::String && r.canConvert( l.type() ) )
-				r.convert( l.type() );
-			else {
-				QVariant::Type t = l.type() > r.type() ? l.type() : r.type();
-
-				if ( r.canConvert( t ) && l.canConvert( t ) ) {
-					l.convert( t );
-					r.convert( t );
-				}
-			}
+	nodes.clear();
+	fields.clear();
+
+	if ( opcode == Expression::e_nop && !lhs.isValid() )
+		return;
+
+	compile( *this );
+	nodes.squeeze();
+	fields.squeeze();
+}
+
+int Expression::compile( const Expression & e )
+{
+	if ( e.opcode == Expression::e_nop )
+		return compile( e.lhs );
+
+	int l = ( e.opcode == Expression::e_not ) ? -1 : compile( e.lhs );
+	int r = compile( e.rhs );
+
+	// Fold constant operands, they are always the last nodes emitted
+	if ( ( l == -1 || nodes.at( l ).kind == Node::Constant ) && nodes.at( r ).kind == Node::Constant ) {
+		quint32 v = apply( e.opcode, ( l == -1 ) ? 0 : nodes.at( l ).value, nodes.at( r ).value );
+		nodes.resize( ( l == -1 ) ? r : l );
+		return addNode( Node::Constant, v );
+	}
+
+	return addNode( Node::Operation, 0, e.opcode, l, r );
+}
+
+int Expression::compile( const QVariant & v )
+{
+	if ( v.type() == QVariant::UserType && v.canConvert<Expression>() )
+		return compile( v.value<Expression>() );
+
+	if ( v.type() == QVariant::String ) {
+		QString name = v.toString();
+
+		for ( int i = 0; i < fields.count(); i++ ) {
+			if ( fields.at( i ).name == name )
+				return addNode( Node::Reference, i );
+		}
+
+		Field f;
+		f.name = name;
+		fields.append( f );
+		return addNode( Node::Reference, fields.count() - 1 );
+	}
+
+	return addNode( Node::Constant, v.toUInt() );
+}
+
+int Expression::addNode( Node::Kind kind, quint32 value, Operator op, int left, int right )
+{
+	Node n;
+	n.kind = kind;
+	n.op = op;
+	n.value = value;
+	n.left = left;
+	n.right = right;
+	nodes.append( n );
+	return nodes.count() - 1;
+}
+
+void Expression::resolveFields( const QStringList & layout )
+{
+	for ( Field & f : fields ) {
+		// "ARG" and paths are only known per item
+		if ( f.name == "ARG" || f.name.contains( "/" ) )
+			continue;
+
+		f.atom = NifAtom( f.name );
+		f.rows.clear();
+		for ( int row = 0; row < layout.count(); row++ ) {
+			if ( layout.at( row ) == f.name )
+				f.rows.append( row );
 		}
+		f.span = layout.count();
 	}
 }
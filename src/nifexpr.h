@@ -34,8 +34,12 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define NIFEXPR_H
 #pragma once
 
+#include "nifatom.h"
+
 #include <QRegularExpression>
 #include <QString>
+#include <QStringList>
+#include <QVector>
 #include <QVariant>
 
 
@@ -53,6 +57,22 @@ class Expression final
 	Operator opcode;
 
 public:
+	//! A reference to another field by name
+	struct Field
+	{
+		//! Name of the field
+		QString name;
+		//! Name of the field as an atom, valid once resolved
+		NifAtom atom;
+		//! Rows of the siblings with this name, in the layout the field was resolved against
+		QVector<int> rows;
+		//! Row count of that layout, or -1 if the field is unresolved
+		int span = -1;
+
+		//! Whether the sibling rows have been resolved
+		bool isResolved() const { return span >= 0; }
+	};
+
 	explicit Expression()
 	{
 		opcode = Expression::e_nop;
@@ -62,55 +82,109 @@ public:
 	{
 		opcode = Expression::e_nop;
 		partition( cond.mid( startpos, endpos - startpos + 1 ) );
+		compile();
 	}
 
 	Expression( const QString & cond )
 	{
 		opcode = Expression::e_nop;
 		partition( cond );
+		compile();
 	}
 
 	QString toString() const;
 
+	//! Resolves the field references to rows of a layout of sibling names
+	void resolveFields( const QStringList & layout );
+
+	//! The fields the expression reads
+	const QVector<Field> & references() const { return fields; }
+
 public:
+	/*! Evaluates the compiled expression.
+	 *
+	 * @param resolve	Functor returning the value of an Expression::Field
+	 */
+	template <class F>
+	quint32 evaluate( const F & resolve ) const
+	{
+		if ( nodes.isEmpty() )
+			return 0;
+
+		return evaluateNode( nodes.count() - 1, resolve );
+	}
+
 	template <class F>
-	QVariant evaluateValue( const F & convert ) const
+	bool evaluateBool( const F & resolve ) const
 	{
-		QVariant l = convertValue( lhs, convert );
-		QVariant r = convertValue( rhs, convert );
-		NormalizeVariants( l, r );
+		return evaluate( resolve ) != 0;
+	}
+
+	template <class F>
+	int evaluateUInt( const F & resolve ) const
+	{
+		return evaluate( resolve );
+	}
+
+private:
+	//! A node of the compiled expression, operands are stored before their operation
+	struct Node
+	{
+		enum Kind : quint8 { Constant, Reference, Operation };
+
+		Kind kind;
+		Operator op;
+		//! Constant value or index into fields
+		quint32 value;
+		//! Operand node indices, -1 if unused
+		int left;
+		int right;
+	};
+
+	QVector<Node> nodes;
+	QVector<Field> fields;
 
-		switch ( opcode ) {
+	static Operator operatorFromString( const QString & str );
+	void partition( const QString & cond, int offset = 0 );
+
+	void compile();
+	int compile( const Expression & e );
+	int compile( const QVariant & v );
+	int addNode( Node::Kind kind, quint32 value, Operator op = e_nop, int left = -1, int right = -1 );
+
+	static quint32 apply( Operator op, quint32 l, quint32 r )
+	{
+		switch ( op ) {
 		case Expression::e_not:
-			return QVariant::fromValue( !r.toBool() );
+			return !r;
 		case Expression::e_not_eq:
-			return QVariant::fromValue( l != r );
+			return l != r;
 		case Expression::e_eq:
-			return QVariant::fromValue( l == r );
+			return l == r;
 		case Expression::e_gte:
-			return QVariant::fromValue( l.toUInt() >= r.toUInt() );
+			return l >= r;
 		case Expression::e_lte:
-			return QVariant::fromValue( l.toUInt() <= r.toUInt() );
+			return l <= r;
 		case Expression::e_gt:
-			return QVariant::fromValue( l.toUInt() > r.toUInt() );
+			return l > r;
 		case Expression::e_lt:
-			return QVariant::fromValue( l.toUInt() < r.toUInt() );
+			return l < r;
 		case Expression::e_bit_and:
-			return QVariant::fromValue( l.toUInt() & r.toUInt() );
+			return l & r;
 		case Expression::e_bit_or:
-			return QVariant::fromValue( l.toUInt() | r.toUInt() );
+			return l | r;
 		case Expression::e_add:
-			return QVariant::fromValue( l.toUInt() + r.toUInt() );
+			return l + r;
 		case Expression::e_sub:
-			return QVariant::fromValue( l.toUInt() - r.toUInt() );
+			return l - r;
 		case Expression::e_div:
-			return QVariant::fromValue( l.toUInt() / r.toUInt() );
+			return r ? l / r : 0;
 		case Expression::e_mul:
-			return QVariant::fromValue( l.toUInt() * r.toUInt() );
+			return l * r;
 		case Expression::e_bool_and:
-			return QVariant::fromValue( l.toBool() && r.toBool() );
+			return l && r;
 		case Expression::e_bool_or:
-			return QVariant::fromValue( l.toBool() || r.toBool() );
+			return l || r;
 		case Expression::e_nop:
 			return l;
 		}
@@ -119,31 +193,32 @@ public:
 	}
 
 	template <class F>
-	bool evaluateBool( const F & convert ) const
+	quint32 evaluateNode( int n, const F & resolve ) const
 	{
-		return evaluateValue( convert ).toBool();
-	}
-
-	template <class F>
-	int evaluateUInt( const F & convert ) const
-	{
-		return evaluateValue( convert ).toUInt();
-	}
-
-private:
-	static Operator operatorFromString( const QString & str );
-	void partition( const QString & cond, int offset = 0 );
-	void NormalizeVariants( QVariant & l, QVariant & r ) const;
+		const Node & node = nodes.at( n );
+
+		switch ( node.kind ) {
+		case Node::Constant:
+			return node.value;
+		case Node::Reference:
+			return resolve( fields.at( node.value ) );
+		case Node::Operation:
+			break;
+		}
 
-	template <class F>
-	QVariant convertValue( const QVariant & v, const F & convert ) const
-	{
-		if ( v.type() == QVariant::UserType ) {
-			if ( v.canConvert<Expression>() )
-				return v.value<Expression>().evaluateValue( convert );
+		switch ( node.op ) {
+		case Expression::e_not:
+			return !evaluateNode( node.right, resolve );
+		case Expression::e_bool_and:
+			return evaluateNode( node.left, resolve ) && evaluateNode( node.right, resolve );
+		case Expression::e_bool_or:
+			return evaluateNode( node.left, resolve ) || evaluateNode( node.right, resolve );
+		default:
+			break;
 		}
 
-		return convert( v );
+		quint32 l = evaluateNode( node.left, resolve );
+		return apply( node.op, l, evaluateNode( node.right, resolve ) );
 	}
 };
 
@@ -33,6 +33,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef NIFITEM_H
 #define NIFITEM_H
 
+#include "nifatom.h"
 #include "nifexpr.h"
 #include "nifvalue.h"
 
@@ -41,8 +42,15 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QString>
 #include <QVector>
 
+#include <memory>
+#include <new>
+#include <vector>
 
-//! @file nifitem.h NifItem, NifBlock, NifData, NifSharedData
+
+//! @file nifitem.h NifItem, NifItemArena, NifBlock, NifDependents, NifData, NifSharedData
+
+struct NifBlock;
+struct NifDependents;
 
 /*! Shared data for NifData.
  *
@@ -71,22 +79,24 @@ private:
 
 	NifSharedData( const QString & n, const QString & t, const QString & tt, const QString & a, const QString & a1,
 				   const QString & a2, const QString & c, quint32 v1, quint32 v2, NifSharedData::DataFlags f )
-		: QSharedData(), name( n ), type( t ), temp( tt ), arg( a ), arr1( a1 ), arr2( a2 ),
+		: QSharedData(), name( n ), atom( n ), type( t ), temp( tt ), arg( a ), arr1( a1 ), arr2( a2 ),
 		cond( c ), ver1( v1 ), ver2( v2 ), condexpr( c ), arr1expr( a1 ), flags( f )
 	{
 	}
 
 	NifSharedData( const QString & n, const QString & t )
-		: QSharedData(), name( n ), type( t ) {}
+		: QSharedData(), name( n ), atom( n ), type( t ) {}
 
 	NifSharedData( const QString & n, const QString & t, const QString & txt )
-		: QSharedData(), name( n ), type( t ), text( txt ) {}
+		: QSharedData(), name( n ), atom( n ), type( t ), text( txt ) {}
 
 	NifSharedData()
 		: QSharedData() {}
 
 	//! Name.
 	QString name;
+	//! Name as an atom.
+	NifAtom atom;
 	//! Type.
 	QString type;
 	//! Template type.
@@ -113,6 +123,8 @@ private:
 	QString vercond;
 	//! Version condition as an expression.
 	Expression verexpr;
+	//! The compound or block type whose field rows and dependents apply; kept alive while items use it.
+	std::shared_ptr<const NifBlock> fieldIndex;
 
 	DataFlags flags = None;
 };
@@ -137,6 +149,8 @@ public:
 
 	//! Get the name of the data.
 	inline const QString & name() const { return d->name; }
+	//! Get the name of the data as an atom.
+	inline NifAtom atom() const { return d->atom; }
 	//! Get the type of the data.
 	inline const QString & type() const { return d->type; }
 	//! Get the template type of the data.
@@ -163,6 +177,12 @@ public:
 	inline const QString & vercond() const { return d->vercond; }
 	//! Get the version condition attribute of the data, as an expression.
 	inline const Expression & verexpr() const { return d->verexpr; }
+	//! Get the compound or block type whose fields are indexed.
+	inline const std::shared_ptr<const NifBlock> & fieldIndex() const { return d->fieldIndex; }
+	//! Get the first rows of the fields of the compound or block type, by name.
+	inline const QHash<NifAtom, int> * fieldRows() const;
+	//! Get the rows of the compound or block type which read its fields.
+	inline const NifDependents * dependents() const;
 	//! Get the abstract attribute of the data.
 	inline bool isAbstract() const { return d->flags & NifSharedData::Abstract; }
 	//! Is the data binary. Binary means the data is being treated as one blob.
@@ -179,7 +199,11 @@ public:
 	inline bool isConditionless() const { return d->flags & NifSharedData::Conditionless; }
 
 	//! Sets the name of the data.
-	void setName( const QString & name ) { d->name = name; }
+	void setName( const QString & name )
+	{
+		d->name = name;
+		d->atom = NifAtom( name );
+	}
 	//! Sets the type of the data.
 	void setType( const QString & type ) { d->type = type; }
 	//! Sets the template type of the data.
@@ -212,6 +236,16 @@ public:
 		d->vercond = cond;
 		d->verexpr = Expression( cond );
 	}
+	//! Sets the compound or block type whose field rows and dependents apply.
+	void setFieldIndex( const std::shared_ptr<const NifBlock> & type ) { d->fieldIndex = type; }
+
+	//! Resolves the field references of the expressions to rows of the sibling and header layouts.
+	void resolveFields( const QStringList & siblings, const QStringList & header )
+	{
+		d->condexpr.resolveFields( siblings );
+		d->arr1expr.resolveFields( siblings );
+		d->verexpr.resolveFields( header );
+	}
 
 	inline void setFlag( NifSharedData::DataFlags flag, bool val )
 	{
@@ -241,6 +275,23 @@ public:
 	NifValue value;
 };
 
+/*! The fields read by the expressions of a compound or block type
+ *
+ * Built with the field rows, so that changing a value only reevaluates the
+ * conditions of the rows which read it instead of walking every sibling.
+ */
+struct NifDependents
+{
+	//! Name of each row of the layout
+	QVector<NifAtom> layout;
+	//! Rows whose condition reads each field
+	QHash<NifAtom, QVector<int>> conditions;
+	//! Compound rows which pass each field on as their argument
+	QHash<NifAtom, QVector<int>> arguments;
+	//! Rows which read fields that are only known per item, e.g. paths
+	QVector<int> unresolved;
+};
+
 //! A block representing a niobject in XML.
 struct NifBlock
 {
@@ -254,9 +305,173 @@ struct NifBlock
 	bool abstract = false;
 	//! Data present.
 	QList<NifData> types;
+	//! First row of each field name, including the fields of ancestors.
+	QHash<NifAtom, int> fieldRows;
+	//! Rows which read the other fields, including the fields of ancestors.
+	NifDependents dependents;
 };
 
-//! An item which contains NifData
+inline const QHash<NifAtom, int> * NifData::fieldRows() const
+{
+	return d->fieldIndex ? &d->fieldIndex->fieldRows : nullptr;
+}
+
+inline const NifDependents * NifData::dependents() const
+{
+	return d->fieldIndex ? &d->fieldIndex->dependents : nullptr;
+}
+
+//! Contiguous element storage of an array of fixed size values
+struct NifPackedArray
+{
+	//! The data shared by all elements, without a value.
+	NifData data;
+	//! The element values in row order.
+	QVector<NifValue> values;
+};
+
+/*! Allocates the NifItems of a model from large chunks of equally sized slots
+ *
+ * A tree is released a few chunks at a time instead of one item at a time, and
+ * items created together lie close together in memory. Each slot is prefixed
+ * by the arena owning it, so an item can be returned to its arena after it was
+ * moved into the tree of another model; that model then keeps the arena alive.
+ * An arena is not thread-safe, it belongs to the thread of its model.
+ */
+class NifItemArena final
+{
+public:
+	//! Allocation statistics
+	struct Statistics
+	{
+		//! Bytes reserved for items
+		qint64 bytes = 0;
+		//! Chunks reserved
+		int chunks = 0;
+		//! Items alive
+		int items = 0;
+		//! Most items alive at once in one arena
+		int peakItems = 0;
+		//! Items allocated in total
+		qint64 allocations = 0;
+
+		Statistics & operator+=( const Statistics & other )
+		{
+			bytes += other.bytes;
+			chunks += other.chunks;
+			items += other.items;
+			// The arenas peak at different times, their sum would overstate the peak
+			peakItems = qMax( peakItems, other.peakItems );
+			allocations += other.allocations;
+			return *this;
+		}
+	};
+
+	NifItemArena() {}
+	NifItemArena( const NifItemArena & ) = delete;
+	NifItemArena & operator=( const NifItemArena & ) = delete;
+
+	~NifItemArena()
+	{
+		for ( char * chunk : chunks )
+			::operator delete( chunk );
+	}
+
+	//! Allocate a slot of the given size
+	void * allocate( size_t size )
+	{
+		// All slots have the size of the first, i.e. of a NifItem
+		if ( !slotSize )
+			slotSize = ( Header + size + Header - 1 ) & ~size_t( Header - 1 );
+
+		Q_ASSERT( Header + size <= slotSize );
+
+		char * slot = freeSlots;
+		if ( slot ) {
+			freeSlots = *reinterpret_cast<char **>( slot );
+		} else {
+			if ( next == end ) {
+				next = static_cast<char *>( ::operator new( ChunkSlots * slotSize ) );
+				end = next + ChunkSlots * slotSize;
+				chunks.push_back( next );
+
+				stats.bytes += ChunkSlots * slotSize;
+				stats.chunks++;
+			}
+
+			slot = next;
+			next += slotSize;
+		}
+
+		*reinterpret_cast<NifItemArena **>( slot ) = this;
+
+		stats.allocations++;
+		if ( ++stats.items > stats.peakItems )
+			stats.peakItems = stats.items;
+
+		return slot + Header;
+	}
+
+	//! Allocate a slot of the given size from the heap, for items outside of any arena
+	static void * allocateHeap( size_t size )
+	{
+		char * slot = static_cast<char *>( ::operator new( Header + size ) );
+		*reinterpret_cast<NifItemArena **>( slot ) = nullptr;
+		return slot + Header;
+	}
+
+	//! Return a slot to the arena it was allocated from, or to the heap
+	static void release( void * ptr )
+	{
+		char * slot = static_cast<char *>( ptr ) - Header;
+		NifItemArena * arena = *reinterpret_cast<NifItemArena **>( slot );
+
+		if ( !arena ) {
+			::operator delete( slot );
+			return;
+		}
+
+		*reinterpret_cast<char **>( slot ) = arena->freeSlots;
+		arena->freeSlots = slot;
+		arena->stats.items--;
+	}
+
+	//! The arena a slot was allocated from, or null if it is on the heap
+	static NifItemArena * of( const void * ptr )
+	{
+		return *reinterpret_cast<NifItemArena * const *>( static_cast<const char *>( ptr ) - Header );
+	}
+
+	//! Get the allocation statistics
+	const Statistics & statistics() const { return stats; }
+
+private:
+	//! The size of the slot prefix, which keeps the items aligned
+	enum { Header = 16 };
+	//! The number of slots in a chunk
+	enum { ChunkSlots = 1024 };
+
+	//! The chunks of slots
+	std::vector<char *> chunks;
+	//! The next unused slot of the last chunk
+	char * next = nullptr;
+	//! The end of the last chunk
+	char * end = nullptr;
+	//! Released slots, linked through their prefix
+	char * freeSlots = nullptr;
+	//! The size of a slot including its prefix
+	size_t slotSize = 0;
+
+	Statistics stats;
+};
+
+/*! An item which contains NifData
+ *
+ * Arrays of fixed size values may be packed: the element values are then stored
+ * contiguously in the array item, and the element items are only created when
+ * they are first requested through child(). Created element items read and write
+ * their value in the packed storage.
+ */
 class NifItem
 {
 public:
@@ -269,6 +484,50 @@ public:
 	~NifItem()
 	{
 		qDeleteAll( childItems );
+		delete packedArray;
+	}
+
+	//! Allocate an item in an arena, or on the heap if the arena is null
+	static void * operator new( size_t size, NifItemArena * arena )
+	{
+		return arena ? arena->allocate( size ) : NifItemArena::allocateHeap( size );
+	}
+
+	static void * operator new( size_t size )
+	{
+		return NifItemArena::allocateHeap( size );
+	}
+
+	static void operator delete( void * ptr )
+	{
+		if ( ptr )
+			NifItemArena::release( ptr );
+	}
+
+	static void operator delete( void * ptr, NifItemArena * )
+	{
+		NifItemArena::release( ptr );
+	}
+
+	/*! Destroy a tree without returning the slots of its items to their arenas
+	 *
+	 * The payloads of the items are destroyed, the slots are only released in bulk
+	 * with the chunks of their arena. As no arena is modified, this may run on
+	 * another thread once nothing else refers to the tree.
+	 */
+	static void destroyTree( NifItem * item )
+	{
+		for ( NifItem * c : item->childItems ) {
+			if ( c )
+				destroyTree( c );
+		}
+
+		item->childItems.clear();
+
+		if ( NifItemArena::of( item ) )
+			item->~NifItem();
+		else
+			delete item;
 	}
 
 	//! Return the parent item.
@@ -298,12 +557,78 @@ public:
 		childItems.reserve( childItems.count() + e );
 	}
 
-	//! Get child items
+	//! Get child items; creates all element items of a packed array
 	const QVector<NifItem *> & children()
 	{
+		if ( packedArray ) {
+			for ( int i = 0; i < childItems.count(); i++ )
+				packedChild( i );
+		}
+
 		return childItems;
 	}
 
+	//! Whether the element values of this array are packed
+	bool isPacked() const
+	{
+		return packedArray != nullptr;
+	}
+
+	/*! Append packed elements
+	 *
+	 * Only valid for an array without children or one which is already packed.
+	 *
+	 * @param data	The element data; its value is the initial element value
+	 * @param count The number of elements to append
+	 */
+	void appendPacked( const NifData & data, int count )
+	{
+		Q_ASSERT( packedArray || childItems.isEmpty() );
+
+		if ( !packedArray ) {
+			packedArray = new NifPackedArray;
+			packedArray->data = data;
+			packedArray->data.value = NifValue();
+		}
+
+		packedArray->values.insert( packedArray->values.end(), count, data.value );
+		childItems.insert( childItems.end(), count, nullptr );
+	}
+
+	//! Convert a packed array to regular element items owning their values
+	void unpack()
+	{
+		if ( !packedArray )
+			return;
+
+		for ( int i = 0; i < childItems.count(); i++ ) {
+			NifItem * item = packedChild( i );
+			item->itemData.value = packedArray->values.at( i );
+			item->packedIndex = -1;
+		}
+
+		delete packedArray;
+		packedArray = nullptr;
+	}
+
+	//! Return the value of the child item at the specified row, without creating a packed element item
+	NifValue & childValue( int row )
+	{
+		if ( packedArray )
+			return packedArray->values[row];
+
+		return childItems.at( row )->value();
+	}
+
+	//! Return the value of the child item at the specified row, without creating a packed element item
+	const NifValue & childValue( int row ) const
+	{
+		if ( packedArray )
+			return packedArray->values.at( row );
+
+		return childItems.at( row )->value();
+	}
+
 	/*! Insert child data item
 	 *
 	 * @param data	The data to insert
@@ -312,7 +637,9 @@ public:
 	 */
 	NifItem * insertChild( const NifData & data, int at = -1 )
 	{
-		NifItem * item = new NifItem( data, this );
+		unpack();
+
+		NifItem * item = new ( NifItemArena::of( this ) ) NifItem( data, this );
 
 		if ( data.isConditionless() )
 			item->setCondition( true );
@@ -337,6 +664,8 @@ public:
 	 */
 	int insertChild( NifItem * child, int at = -1 )
 	{
+		unpack();
+
 		child->parentItem = this;
 
 		if ( at < 0 || at > childItems.count() ) {
@@ -351,12 +680,42 @@ public:
 		return child->row();
 	}
 
+	/*! Append copies of the children of another item
+	 *
+	 * The copies are allocated from the arena of this item. The source is only
+	 * read, so several threads may copy from the same item at once.
+	 *
+	 * @param source The item to copy the children of
+	 */
+	void insertCopies( const NifItem * source )
+	{
+		unpack();
+		prepareInsert( source->childItems.count() );
+
+		NifItemArena * arena = NifItemArena::of( this );
+		for ( const NifItem * c : source->childItems ) {
+			NifItem * item = c->copy( arena );
+			item->parentItem = this;
+			item->rowIdx = childItems.count();
+			childItems.append( item );
+
+			populateLinksUp( item );
+		}
+	}
+
 	//! Inform the parent and its ancestors of any links
 	void populateLinksUp( NifItem * item )
 	{
-		if ( item->value().type() == NifValue::tLink || item->value().type() == NifValue::tUpLink ) {
-			// Add this child's row to the item's link vector
-			linkRows << item->row();
+		bool isLink = item->value().type() == NifValue::tLink || item->value().type() == NifValue::tUpLink;
+
+		// A subtree which was built elsewhere may hold links already
+		if ( isLink || !item->linkRows.isEmpty() || !item->linkAncestorRows.isEmpty() ) {
+			if ( isLink ) {
+				// Add this child's row to the item's link vector
+				linkRows << item->row();
+			} else if ( !linkAncestorRows.contains( item->row() ) ) {
+				linkAncestorRows << item->row();
+			}
 	
 			// Inform the parent that this item's rows have links
 			auto p = parentItem;
@@ -380,6 +739,8 @@ public:
 	 */
 	NifItem * takeChild( int row )
 	{
+		unpack();
+
 		NifItem * item = child( row );
 		invalidateRowCounts();
 		if ( item ) {
@@ -396,6 +757,8 @@ public:
 	 */
 	void removeChild( int row )
 	{
+		unpack();
+
 		NifItem * item = child( row );
 		invalidateRowCounts();
 		if ( item ) {
@@ -419,23 +782,42 @@ public:
 		}
 
 		childItems.remove( row, count );
+
+		if ( packedArray ) {
+			packedArray->values.remove( row, count );
+
+			for ( int i = row; i < childItems.count(); i++ ) {
+				if ( childItems.at( i ) )
+					childItems.at( i )->packedIndex = i;
+			}
+		}
 	}
 
 	//! Return the child item at the specified row
 	NifItem * child( int row )
 	{
+		if ( packedArray && row >= 0 && row < childItems.count() )
+			return packedChild( row );
+
 		return childItems.value( row );
 	}
 
 	//! Return the child item at the specified row
 	const NifItem * child( int row ) const
 	{
+		if ( packedArray && row >= 0 && row < childItems.count() )
+			return packedChild( row );
+
 		return childItems.value( row );
 	}
 
 	//! Return the child item with the specified name
 	NifItem * child( const QString & name )
 	{
+		// Packed elements all share one name
+		if ( packedArray )
+			return ( packedArray->data.name() == name ) ? child( 0 ) : nullptr;
+
 		for ( NifItem * child : childItems ) {
 			if ( child->name() == name )
 				return child;
@@ -446,6 +828,9 @@ public:
 	//! Return the child item with the specified name
 	const NifItem * child( const QString & name ) const
 	{
+		if ( packedArray )
+			return ( packedArray->data.name() == name ) ? child( 0 ) : nullptr;
+
 		for ( const NifItem * child : childItems ) {
 			if ( child->name() == name )
 				return child;
@@ -453,6 +838,34 @@ public:
 		return nullptr;
 	}
 
+	//! Return the first child item with the specified name
+	NifItem * child( NifAtom name )
+	{
+		int row = firstRow( name );
+		return ( row >= 0 ) ? child( row ) : nullptr;
+	}
+
+	//! Return the row of the first child item with the specified name, or -1
+	int firstRow( NifAtom name ) const
+	{
+		if ( packedArray )
+			return ( packedArray->data.atom() == name && childItems.count() ) ? 0 : -1;
+
+		// Use the rows of the type's fields while the children follow its layout
+		const QHash<NifAtom, int> * rows = itemData.fieldRows();
+		if ( rows && !itemData.isArray() ) {
+			int row = rows->value( name, -1 );
+			if ( row < 0 || ( row < childItems.count() && childItems.at( row )->atom() == name ) )
+				return row;
+		}
+
+		for ( int row = 0; row < childItems.count(); row++ ) {
+			if ( childItems.at( row )->atom() == name )
+				return row;
+		}
+		return -1;
+	}
+
 	//! Return a count of the number of child items
 	int childCount() const
 	{
@@ -464,6 +877,9 @@ public:
 	{
 		qDeleteAll( childItems );
 		childItems.clear();
+
+		delete packedArray;
+		packedArray = nullptr;
 	}
 
 	const QVector<int> & getLinkAncestorRows() const
@@ -489,7 +905,7 @@ public:
 			return;
 
 		arrConds.clear();
-		arrConds.resize( childItems.at( 0 )->childCount() );
+		arrConds.resize( child( 0 )->childCount() );
 		arrConds.fill( false );
 	}
 
@@ -567,7 +983,8 @@ public:
 	{
 		invalidateRow();
 		for ( NifItem * c : childItems ) {
-			c->invalidateRow();
+			if ( c )
+				c->invalidateRow();
 		}
 	}
 
@@ -577,7 +994,8 @@ public:
 		if ( at < childCount() ) {
 			invalidateRow();
 			for ( int i = at; i < childCount(); i++ ) {
-				childItems.value( i )->invalidateRow();
+				if ( NifItem * c = childItems.value( i ) )
+					c->invalidateRow();
 			}
 		} else {
 			invalidateRowCounts();
@@ -586,12 +1004,26 @@ public:
 	}
 
 	//! Return the value of the item data (const version)
-	inline const NifValue & value() const { return itemData.value; }
+	inline const NifValue & value() const
+	{
+		return ( packedIndex < 0 ) ? itemData.value : parentItem->packedArray->values.at( packedIndex );
+	}
 	//! Return the value of the item data
-	inline NifValue & value() { return itemData.value; }
+	inline NifValue & value()
+	{
+		return ( packedIndex < 0 ) ? itemData.value : parentItem->packedArray->values[packedIndex];
+	}
 
 	//! Return the name of the data
 	inline QString name() const {   return itemData.name(); }
+	//! Return the name of the data as an atom
+	inline NifAtom atom() const {   return itemData.atom(); }
+	//! Return the compound or block type whose fields are indexed
+	inline const std::shared_ptr<const NifBlock> & fieldIndex() const {   return itemData.fieldIndex(); }
+	//! Return the first rows of the fields of the item's compound or block type
+	inline const QHash<NifAtom, int> * fieldRows() const {   return itemData.fieldRows(); }
+	//! Return the rows of the item's compound or block type which read its fields
+	inline const NifDependents * dependents() const {   return itemData.dependents(); }
 	//! Return the type of the data
 	inline QString type() const {   return itemData.type(); }
 	//! Return the template type of the data
@@ -634,6 +1066,44 @@ public:
 	//! Is the item data conditionless. Conditionless means no expression evaluation is necessary.
 	inline bool isConditionless() const { return itemData.isConditionless(); }
 
+	/*! Replace the data of the item, keeping its value
+	 *
+	 * Used when the item is moved to another layout of its type, e.g. the full
+	 * template instead of the one pruned for a version.
+	 */
+	void setData( const NifData & data )
+	{
+		NifValue v = itemData.value;
+		itemData = data;
+		itemData.value = v;
+
+		invalidateCondition();
+		invalidateVersionCondition();
+	}
+
+	//! Set the compound or block type whose field rows and dependents apply
+	inline void setFieldIndex( const std::shared_ptr<const NifBlock> & type ) {   itemData.setFieldIndex( type );   }
+
+	//! Collect the rows of the children holding links again, e.g. after rows were inserted in between
+	void updateLinkRows()
+	{
+		linkRows.clear();
+		linkAncestorRows.clear();
+
+		// Packed elements never hold links
+		for ( int i = 0; i < childItems.count(); i++ ) {
+			const NifItem * c = childItems.at( i );
+			if ( !c )
+				continue;
+
+			NifValue::Type t = c->value().type();
+			if ( t == NifValue::tLink || t == NifValue::tUpLink )
+				linkRows << i;
+			else if ( !c->linkRows.isEmpty() || !c->linkAncestorRows.isEmpty() )
+				linkAncestorRows << i;
+		}
+	}
+
 	//! Set the name
 	inline void setName( const QString & name ) {   itemData.setName( name );   }
 	//! Set the type
@@ -665,34 +1135,88 @@ public:
 		return ( ( ver1() == 0 || ver1() <= v ) && ( ver2() == 0 || v <= ver2() ) );
 	}
 
-	//! Get the child items as an array
+	//! Get the child items as an array; reads packed values without creating element items
 	template <typename T> QVector<T> getArray() const
 	{
 		QVector<T> array;
-		for ( NifItem * child : childItems ) {
-			array.append( child->itemData.value.get<T>() );
+
+		// Compound values of a packed array are copied without going through each element
+		if ( packedArray && NifValue::getPacked<T>( packedArray->values, array ) )
+			return array;
+
+		array.reserve( childItems.count() );
+		for ( int i = 0; i < childItems.count(); i++ ) {
+			array.append( childValue( i ).get<T>() );
 		}
 		return array;
 	}
 
-	//! Set the child items from an array
+	//! Set the child items from an array; writes packed values without creating element items
 	template <typename T> void setArray( const QVector<T> & array )
 	{
-		int x = 0;
-		for ( NifItem * child : childItems ) {
-			child->itemData.value.set<T>( array.value( x++ ) );
+		if ( packedArray && NifValue::setPacked<T>( packedArray->values, array ) )
+			return;
+
+		for ( int i = 0; i < childItems.count(); i++ ) {
+			childValue( i ).set<T>( array.value( i ) );
 		}
 	}
 
 	//! Set the child items from a single value
 	template <typename T> void setArray( const T & val )
 	{
-		for ( NifItem * child : childItems ) {
-			child->itemData.value.set<T>( val );
+		for ( int i = 0; i < childItems.count(); i++ ) {
+			childValue( i ).set<T>( val );
 		}
 	}
 
 private:
+	//! Deep copy of the item and its children, allocated from an arena or the heap if the arena is null
+	NifItem * copy( NifItemArena * arena ) const
+	{
+		NifItem * item = new ( arena ) NifItem( itemData, nullptr );
+		item->conditionStatus = conditionStatus;
+		item->vercondStatus = vercondStatus;
+		item->arrConds = arrConds;
+		item->linkRows = linkRows;
+		item->linkAncestorRows = linkAncestorRows;
+		item->packedIndex = packedIndex;
+
+		if ( packedArray )
+			item->packedArray = new NifPackedArray( *packedArray );
+
+		// Packed elements which were never requested stay null
+		item->childItems.resize( childItems.count() );
+		for ( int i = 0; i < childItems.count(); i++ ) {
+			const NifItem * c = childItems.at( i );
+			if ( !c )
+				continue;
+
+			NifItem * child = c->copy( arena );
+			child->parentItem = item;
+			child->rowIdx = i;
+			item->childItems[i] = child;
+		}
+
+		return item;
+	}
+
+	//! Return the packed element item at row, creating it if needed
+	NifItem * packedChild( int row ) const
+	{
+		NifItem * self = const_cast<NifItem *>( this );
+		NifItem *& item = self->childItems[row];
+
+		if ( !item ) {
+			item = new ( NifItemArena::of( self ) ) NifItem( packedArray->data, self );
+			item->packedIndex = row;
+			item->rowIdx = row;
+			item->setCondition( true );
+		}
+
+		return item;
+	}
+
 	//! The data held by the item
 	NifData itemData;
 	//! The parent of this item
@@ -713,6 +1237,11 @@ private:
 	mutable int rowIdx = -1;
 	//! If item is array with fixed compounds, the conditions are stored here for reuse
 	QVector<bool> arrConds;
+
+	//! Packed element storage, if this is a packed array
+	NifPackedArray * packedArray = nullptr;
+	//! Index of the value in the parent's packed storage, -1 if the item owns its value
+	int packedIndex = -1;
 };
 
 #endif
@@ -40,11 +40,22 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QByteArray>
 #include <QColor>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QRunnable>
+#include <QSemaphore>
 #include <QSettings>
+#include <QThread>
+#include <QThreadPool>
 #include <QTime>
+#include <QTimer>
 #include <QtEndian>
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
 
 //! @file nifmodel.cpp The NIF data model.
 
@@ -180,10 +191,27 @@ bool NifModel::evalVersion( NifItem * item, bool chkParents ) const
 void NifModel::clear()
 {
 	beginResetModel();
+	templates.reset();
 	fileinfo = QFileInfo();
 	filename = QString();
 	folder = QString();
-	root->killChildren();
+	unparsedBlocks.clear();
+	childLinks.clear();
+	parentLinks.clear();
+	rootLinks.clear();
+	referrers.clear();
+	droppedCycles = false;
+	pendingLinks.clear();
+	rootSizes.clear();
+	rootOffsets.clear();
+	stringTable = StringTable();
+	displayStrings.clear();
+	// The items of an open transaction are gone
+	edits = Edits();
+	edits.structural = transactionDepth > 0;
+	conditionEdits.clear();
+	conditionParents.clear();
+	resetRoot();
 
 	NifData headerData = NifData( "NiHeader", "Header" );
 	NifData footerData = NifData( "NiFooter", "Footer" );
@@ -192,6 +220,13 @@ void NifModel::clear()
 	footerData.setIsCompound( true );
 	footerData.setIsConditionless( true );
 
+	if ( NifBlockPtr header = compounds.value( headerData.type() ) ) {
+		headerData.setFieldIndex( header );
+	}
+	if ( NifBlockPtr footer = compounds.value( footerData.type() ) ) {
+		footerData.setFieldIndex( footer );
+	}
+
 	insertType( root, headerData );
 	insertType( root, footerData );
 	version = version2number( cfg.startupVersion );
@@ -339,7 +374,14 @@ void NifModel::updateHeader()
 
 			if ( version >= 0x14020000 && idxBlockSize ) {
 				updateArrays( block );
-				blocksizes.append( blockSize( block ) );
+				int size = blockSize( block );
+				blocksizes.append( size );
+
+				// Exact, the header is written from them
+				if ( rootSizes.value( block, -1 ) != size ) {
+					rootSizes.insert( block, size );
+					rootOffsets.clear();
+				}
 			}
 
 		}
@@ -360,6 +402,9 @@ void NifModel::updateHeader()
 			idxBlockSize->setArray<int>( blocksizes );
 		restoreState();
 
+		// The block types are strings
+		invalidateSize( header );
+
 		// For 20.1 and above strings are saved in the header.  Max String Length must be updated.
 		if ( version >= 0x14010003 ) {
 			int maxlen = 0;
@@ -389,6 +434,9 @@ NifItem * NifModel::getItem( NifItem * item, const QString & name ) const
 	if ( !item || item == root )
 		return nullptr;
 
+	if ( !unparsedBlocks.isEmpty() )
+		parseBlock( item );
+
 	if ( item->isArray() || item->parent()->isArray() ) {
 		int slash = name.indexOf( "/" );
 		if ( slash > 0 ) {
@@ -403,6 +451,11 @@ NifItem * NifModel::getItem( NifItem * item, const QString & name ) const
 		}
 	}
 
+	if ( item->isPacked() ) {
+		NifItem * child = item->child( name );
+		return ( child && evalCondition( child ) ) ? child : nullptr;
+	}
+
 	for ( auto child : item->children() ) {
 		if ( child && child->name() == name && evalCondition( child ) )
 			return child;
@@ -411,6 +464,54 @@ NifItem * NifModel::getItem( NifItem * item, const QString & name ) const
 	return nullptr;
 }
 
+NifItem * NifModel::getItem( NifItem * item, NifAtom name ) const
+{
+	if ( !item || item == root )
+		return nullptr;
+
+	if ( !unparsedBlocks.isEmpty() )
+		parseBlock( item );
+
+	if ( item->isPacked() ) {
+		NifItem * child = item->child( name );
+		return ( child && evalCondition( child ) ) ? child : nullptr;
+	}
+
+	for ( int c = item->firstRow( name ); c >= 0 && c < item->childCount(); c++ ) {
+		NifItem * child = item->child( c );
+
+		if ( child->atom() == name && evalCondition( child ) )
+			return child;
+	}
+
+	return nullptr;
+}
+
+NifItem * NifModel::getItem( NifItem * parent, const Expression::Field & field ) const
+{
+	if ( !field.isResolved() || !parent || parent == root || parent->isPacked() )
+		return getItem( parent, field.name );
+
+	// Check the candidate rows resolved against the XML layout
+	int rows = parent->childCount();
+	for ( int row : field.rows ) {
+		NifItem * child = ( row < rows ) ? parent->child( row ) : nullptr;
+
+		// The item does not follow the layout, search by name
+		if ( !child || child->atom() != field.atom )
+			return getItem( parent, field.name );
+
+		if ( evalCondition( child ) )
+			return child;
+	}
+
+	// Rows past the layout, e.g. fields of a descendant block, may still match
+	if ( rows > field.span )
+		return getItem( parent, field.name );
+
+	return nullptr;
+}
+
 /*
  *  array functions
  */
@@ -534,13 +635,22 @@ bool NifModel::updateArrayItem( NifItem * array )
 		data.setIsConditionless( true );
 		data.setIsCompound( array->isCompound() );
 		data.setIsArray( array->isMultiArray() );
+		data.setFieldIndex( array->fieldIndex() );
 
 		beginInsertRows( createIndex( array->row(), 0, array ), itemRows, rows - 1 );
 
-		array->prepareInsert( rows - itemRows );
+		// Store fixed size values contiguously, element items are created on demand
+		NifValue::Type t = data.value.type();
+		bool packable = !data.isCompound() && !data.isArray() && NifValue::isFixedSize( t ) && !NifValue::isLink( t );
+
+		if ( array->isPacked() || (itemRows == 0 && packable) ) {
+			array->appendPacked( data, rows - itemRows );
+		} else {
+			array->prepareInsert( rows - itemRows );
 
-		for ( int c = itemRows; c < rows; c++ )
-			insertType( array, data );
+			for ( int c = itemRows; c < rows; c++ )
+				insertType( array, data );
+		}
 
 		endInsertRows();
 	}
@@ -561,7 +671,7 @@ bool NifModel::updateArrayItem( NifItem * array )
 			parent = parent->parent();
 
 		if ( parent != getFooterItem() ) {
-			updateLinks();
+			updateLinks( getBlockNumber( parent ) );
 			updateFooter();
 			emit linksChanged();
 		}
@@ -575,6 +685,10 @@ bool NifModel::updateArrays( NifItem * parent )
 	if ( !parent )
 		return false;
 
+	// Packed elements are leaves
+	if ( parent->isPacked() )
+		return true;
+
 	for ( auto child : parent->children() ) {
 		if ( evalCondition( child ) ) {
 			if ( isArray( child ) ) {
@@ -590,18 +704,264 @@ bool NifModel::updateArrays( NifItem * parent )
 	return true;
 }
 
+/*
+ *  version templates
+ */
+
+QMutex NifModel::versionTemplatesLock;
+QHash<NifVersionKey, NifVersionTemplatesPtr> NifModel::versionTemplateCache;
+
+//! Resolves the header fields referenced by vercond from a NifVersionKey
+class NifVersionEval
+{
+public:
+	NifVersionEval( const NifVersionKey & key ) : key( key ) {}
+
+	quint32 operator()( const Expression::Field & field ) const
+	{
+		if ( field.name == QLatin1String( "Version" ) )
+			return key.fileVersion;
+		if ( field.name == QLatin1String( "User Version" ) )
+			return key.userVersion;
+		if ( field.name == QLatin1String( "User Version 2" ) )
+			return key.userVersion2;
+
+		unknown = true;
+		return 0;
+	}
+
+	//! Whether the expression referenced a field the key does not cover
+	mutable bool unknown = false;
+
+private:
+	const NifVersionKey & key;
+};
+
+//! Whether pruneTemplate() keeps a field of a template for a version
+static bool keptInVersion( const NifData & data, const NifVersionKey & key )
+{
+	if ( ( data.ver1() && key.version < data.ver1() ) || ( data.ver2() && key.version > data.ver2() ) )
+		return false;
+
+	if ( !data.vercond().isEmpty() ) {
+		NifVersionEval eval( key );
+		bool present = data.verexpr().evaluateBool( eval );
+
+		if ( !eval.unknown && !present )
+			return false;
+	}
+
+	return true;
+}
+
+//! Copy a template without the fields absent from a version, marking the others as always present
+static NifBlockPtr pruneTemplate( const NifBlockPtr & blk, const NifVersionKey & key )
+{
+	auto pruned = std::make_shared<NifBlock>( *blk );
+	pruned->types.clear();
+
+	for ( NifData data : blk->types ) {
+		if ( !keptInVersion( data, key ) )
+			continue;
+
+		if ( data.ver1() || data.ver2() ) {
+			data.setVer1( 0 );
+			data.setVer2( 0 );
+		}
+
+		if ( !data.vercond().isEmpty() ) {
+			NifVersionEval eval( key );
+			data.verexpr().evaluateBool( eval );
+
+			if ( !eval.unknown )
+				data.setVerCond( QString() );
+		}
+
+		if ( !data.isConditionless() && data.cond().isEmpty() && data.vercond().isEmpty() )
+			data.setIsConditionless( true );
+
+		pruned->types.append( data );
+	}
+
+	return pruned;
+}
+
+NifVersionKey NifModel::versionKey( NifItem * header ) const
+{
+	NifModelEval eval( this, header );
+	Expression::Field field;
+	auto headerValue = [&eval, &field]( const char * name ) {
+		field.name = QLatin1String( name );
+		return eval( field );
+	};
+
+	NifVersionKey key;
+	key.version = version;
+	key.fileVersion = headerValue( "Version" );
+	key.userVersion = headerValue( "User Version" );
+	key.userVersion2 = headerValue( "User Version 2" );
+	return key;
+}
+
+NifVersionTemplatesPtr NifModel::versionTemplates( NifItem * header ) const
+{
+	NifVersionKey key = versionKey( header );
+
+	QMutexLocker lock( &versionTemplatesLock );
+
+	NifVersionTemplatesPtr cached = versionTemplateCache.value( key );
+	if ( cached )
+		return cached;
+
+	auto pruned = std::make_shared<NifVersionTemplates>();
+	pruned->key = key;
+	for ( const NifBlockPtr & c : compounds )
+		pruned->compounds.insert( c->id, pruneTemplate( c, key ) );
+	for ( const NifBlockPtr & blk : blocks )
+		pruned->blocks.insert( blk->id, pruneTemplate( blk, key ) );
+
+	// The rows changed, index them again for the pruned layouts
+	indexTemplates( pruned->compounds, pruned->blocks );
+
+	versionTemplateCache.insert( key, pruned );
+	return pruned;
+}
+
+void NifModel::clearVersionTemplates()
+{
+	QMutexLocker lock( &versionTemplatesLock );
+	versionTemplateCache.clear();
+}
+
+void NifModel::unpruneTemplates()
+{
+	if ( !templates )
+		return;
+
+	// The bytes of the deferred blocks follow the pruned layout
+	parseAllBlocks();
+
+	NifVersionKey key = templates->key;
+	templates.reset();
+
+	emit layoutAboutToBeChanged();
+
+	for ( int r = 0; r < root->childCount(); r++ ) {
+		NifItem * item = root->child( r );
+		int row = 0;
+
+		if ( item == getHeaderItem() || item == getFooterItem() ) {
+			// Inserted from the full compound, only the compounds below it were pruned
+			if ( NifBlockPtr compound = compounds.value( item->type() ) )
+				unpruneItem( item, compound->types, key, row, false );
+		} else if ( NifBlockPtr block = blocks.value( item->name() ) ) {
+			QList<NifBlockPtr> chain;
+			for ( NifBlockPtr b = block; b; b = blocks.value( b->ancestor ) )
+				chain.prepend( b );
+
+			for ( const NifBlockPtr & b : chain )
+				unpruneItem( item, b->types, key, row, true );
+
+			item->setFieldIndex( block );
+		}
+
+		item->updateLinkRows();
+		invalidateSize( item );
+	}
+
+	// The items were kept, only the rows of their siblings moved
+	const QModelIndexList indices = persistentIndexList();
+	for ( const QModelIndex & idx : indices ) {
+		NifItem * item = static_cast<NifItem *>( idx.internalPointer() );
+		if ( item )
+			changePersistentIndex( idx, createIndex( item->row(), idx.column(), item ) );
+	}
+
+	emit layoutChanged();
+
+	// Rows were inserted, the recorded values cannot be set again by row
+	if ( transactionDepth )
+		edits.structural = true;
+
+	updateLinks();
+	emit linksChanged();
+}
+
+void NifModel::unpruneItem( NifItem * item, const QList<NifData> & types, const NifVersionKey & key, int & row, bool pruned )
+{
+	for ( const NifData & data : types ) {
+		if ( pruned && !keptInVersion( data, key ) ) {
+			insertType( item, data, row++ );
+			continue;
+		}
+
+		NifItem * child = item->child( row++ );
+		if ( !child )
+			return;
+
+		// Keep the types which were filled in for a template
+		NifData full( data );
+		if ( data.isTemplated() ) {
+			full.setType( child->type() );
+			full.setTemp( child->temp() );
+			full.setTemplated( child->isTemplated() );
+		}
+
+		child->setData( full );
+		unpruneChildren( child, key );
+	}
+}
+
+void NifModel::unpruneChildren( NifItem * item, const NifVersionKey & key )
+{
+	// Packed elements have no fields
+	if ( item->isPacked() )
+		return;
+
+	if ( item->isArray() ) {
+		// The elements share the layout of the array
+		for ( NifItem * c : item->children() ) {
+			c->setFieldIndex( item->fieldIndex() );
+			unpruneChildren( c, key );
+		}
+	} else if ( item->isCompound() ) {
+		if ( NifBlockPtr compound = compounds.value( item->type() ) ) {
+			int row = 0;
+			unpruneItem( item, compound->types, key, row, true );
+		}
+	}
+
+	item->updateLinkRows();
+}
+
+NifBlockPtr NifModel::blockTemplate( const QString & id ) const
+{
+	return templates ? templates->blocks.value( id ) : blocks.value( id );
+}
+
+NifBlockPtr NifModel::compoundTemplate( const QString & type ) const
+{
+	return templates ? templates->compounds.value( type ) : compounds.value( type );
+}
+
 /*
  *  block functions
  */
 
 QModelIndex NifModel::insertNiBlock( const QString & identifier, int at )
 {
-	NifBlockPtr block = blocks.value( identifier );
+	NifBlockPtr block = blockTemplate( identifier );
 
 	if ( block ) {
+		if ( state != Loading )
+			parseAllBlocks();
+
 		if ( at < 0 || at > getBlockCount() )
 			at = -1;
 
+		// Appending moves no block numbers, so only the new block needs its links collected
+		bool append = ( at < 0 || at == getBlockCount() );
+
 		if ( at >= 0 )
 			adjustLinks( root, at, 1 );
 
@@ -612,23 +972,27 @@ QModelIndex NifModel::insertNiBlock( const QString & identifier, int at )
 
 		beginInsertRows( QModelIndex(), at, at );
 
-		NifItem * branch = insertBranch( root, NifData( identifier, "NiBlock", block->text ), at );
+		NifData blockData( identifier, "NiBlock", block->text );
+		blockData.setFieldIndex( block );
+
+		NifItem * branch = insertBranch( root, blockData, at );
 		branch->setCondition( true );
 
 		endInsertRows();
 
-		if ( !block->ancestor.isEmpty() )
-			insertAncestor( branch, block->ancestor );
-
-		branch->prepareInsert( block->types.count() );
-
-		for ( const NifData& data : block->types ) {
-			insertType( branch, data );
-		}
+		insertBlockTypes( branch, block );
 
 		if ( state != Loading ) {
 			updateHeader();
-			updateLinks();
+
+			if ( append ) {
+				// Nothing links to the new block yet
+				rootLinks.append( at - 1 );
+				updateLinks( at - 1 );
+			} else {
+				updateLinks();
+			}
+
 			updateFooter();
 			emit linksChanged();
 		}
@@ -650,6 +1014,8 @@ void NifModel::removeNiBlock( int blocknum )
 	if ( blocknum < 0 || blocknum >= getBlockCount() )
 		return;
 
+	parseAllBlocks();
+
 	adjustLinks( root, blocknum, 0 );
 	adjustLinks( root, blocknum, -1 );
 	beginRemoveRows( QModelIndex(), blocknum + 1, blocknum + 1 );
@@ -665,6 +1031,8 @@ void NifModel::moveNiBlock( int src, int dst )
 	if ( src < 0 || src >= getBlockCount() )
 		return;
 
+	parseAllBlocks();
+
 	beginRemoveRows( QModelIndex(), src + 1, src + 1 );
 	NifItem * block = root->takeChild( src + 1 );
 	endRemoveRows();
@@ -709,6 +1077,10 @@ void NifModel::updateStrings( NifModel * src, NifModel * tgt, NifItem * item )
 		tgt->assignString( tgt->createIndex( 0, 0, item ), str, false );
 	}
 
+	// Packed arrays hold no strings
+	if ( item->isPacked() )
+		return;
+
 	for ( auto child : item->children() ) {
 		updateStrings( src, tgt, child );
 	}
@@ -716,12 +1088,17 @@ void NifModel::updateStrings( NifModel * src, NifModel * tgt, NifItem * item )
 
 QMap<qint32, qint32> NifModel::moveAllNiBlocks( NifModel * targetnif, bool update )
 {
+	parseAllBlocks();
+
 	int bcnt = getBlockCount();
 
 	bool doStringUpdate = (  this->getVersionNumber() >= 0x14010003 || targetnif->getVersionNumber() >= 0x14010003 );
 
 	QMap<qint32, qint32> map;
 
+	// The moved items still live in this model's arenas
+	targetnif->adoptArenas( this );
+
 	beginRemoveRows( QModelIndex(), 1, bcnt );
 	targetnif->beginInsertRows( QModelIndex(), targetnif->getBlockCount(), targetnif->getBlockCount() + bcnt - 1 );
 
@@ -794,6 +1171,8 @@ void NifModel::reorderBlocks( const QVector<qint32> & order )
 	if ( linkMap.isEmpty() )
 		return;
 
+	parseAllBlocks();
+
 	// take all the blocks
 	beginRemoveRows( QModelIndex(), 1, root->childCount() - 2 );
 	QList<NifItem *> temp;
@@ -820,6 +1199,7 @@ void NifModel::reorderBlocks( const QVector<qint32> & order )
 
 void NifModel::mapLinks( const QMap<qint32, qint32> & map )
 {
+	parseAllBlocks();
 	mapLinks( root, map );
 	updateLinks();
 	emit linksChanged();
@@ -945,7 +1325,11 @@ NifItem * NifModel::getBlockItem( int x ) const
 	if ( x < 0 || x >= getBlockCount() )
 		return nullptr;
 
-	return root->child( x + 1 );
+	NifItem * block = root->child( x + 1 );
+	if ( !unparsedBlocks.isEmpty() )
+		parseBlock( block );
+
+	return block;
 }
 
 int NifModel::getBlockCount() const
@@ -963,7 +1347,7 @@ void NifModel::insertAncestor( NifItem * parent, const QString & identifier, int
 	setState( Inserting );
 
 	Q_UNUSED( at );
-	NifBlockPtr ancestor = blocks.value( identifier );
+	NifBlockPtr ancestor = blockTemplate( identifier );
 
 	if ( ancestor ) {
 		if ( !ancestor->ancestor.isEmpty() )
@@ -986,6 +1370,62 @@ void NifModel::insertAncestor( NifItem * parent, const QString & identifier, int
 	restoreState();
 }
 
+void NifModel::insertBlockTypes( NifItem * branch, const NifBlockPtr & block )
+{
+	std::shared_ptr<const NifItem> prototype = blockPrototype( block );
+
+	if ( prototype ) {
+		branch->insertCopies( prototype.get() );
+		return;
+	}
+
+	if ( !block->ancestor.isEmpty() )
+		insertAncestor( branch, block->ancestor );
+
+	branch->prepareInsert( block->types.count() );
+
+	for ( const NifData & data : block->types ) {
+		insertType( branch, data );
+	}
+}
+
+std::shared_ptr<const NifItem> NifModel::blockPrototype( const NifBlockPtr & block )
+{
+	// The full templates are shared by all versions, which the prototypes depend on
+	if ( !templates )
+		return nullptr;
+
+	QMutexLocker lock( &templates->prototypesLock );
+
+	std::shared_ptr<const NifItem> prototype = templates->prototypes.value( block->id );
+	if ( prototype )
+		return prototype;
+
+	// Build without holding the lock, another thread may build the same type meanwhile
+	lock.unlock();
+
+	// On the heap rather than in an arena, other models on other threads copy from it
+	std::shared_ptr<NifItem> item( new NifItem( NifData( block->id, "NiBlock", block->text ), nullptr ) );
+	item->setCondition( true );
+
+	if ( !block->ancestor.isEmpty() )
+		insertAncestor( item.get(), block->ancestor );
+
+	item->prepareInsert( block->types.count() );
+
+	for ( const NifData & data : block->types ) {
+		insertType( item.get(), data );
+	}
+
+	lock.relock();
+
+	std::shared_ptr<const NifItem> & cached = templates->prototypes[block->id];
+	if ( !cached )
+		cached = item;
+
+	return cached;
+}
+
 bool NifModel::inherits( const QString & name, const QString & aunty ) const
 {
 	if ( name == aunty )
@@ -1029,7 +1469,7 @@ void NifModel::insertType( NifItem * parent, const NifData & data, int at )
 	if ( data.isArray() ) {
 		NifItem * item = insertBranch( parent, data, at );
 	} else if ( data.isCompound() ) {
-		NifBlockPtr compound = compounds.value( data.type() );
+		NifBlockPtr compound = compoundTemplate( data.type() );
 		if ( !compound )
 			return;
 		NifItem * branch = insertBranch( parent, data, at );
@@ -1081,8 +1521,11 @@ void NifModel::insertType( NifItem * parent, const NifData & data, int at )
 
 bool NifModel::setItemValue( NifItem * item, const NifValue & val )
 {
+	if ( transactionDepth )
+		recordValue( item );
+
 	item->value() = val;
-	emit dataChanged( createIndex( item->row(), ValueCol, item ), createIndex( item->row(), ValueCol, item ) );
+	valueChanged( item );
 
 	if ( itemIsLink( item ) ) {
 		NifItem * parent = item;
@@ -1091,9 +1534,10 @@ bool NifModel::setItemValue( NifItem * item, const NifValue & val )
 			parent = parent->parent();
 
 		if ( parent != getFooterItem() ) {
-			updateLinks();
+			updateLinks( getBlockNumber( parent ) );
 			updateFooter();
-			emit linksChanged();
+			if ( !lockUpdates )
+				emit linksChanged();
 		}
 	}
 
@@ -1104,6 +1548,47 @@ bool NifModel::setItemValue( NifItem * item, const NifValue & val )
  *  QAbstractModel interface
  */
 
+QString NifModel::displayString( const NifItem * item ) const
+{
+	const NifValue & value = item->value();
+
+	// Values stored inline are cheap to compare and their text depends on nothing else
+	int size = NifValue::inlineSize( value.type() );
+	bool cacheable = size > 0;
+	if ( cacheable ) {
+		auto cached = displayStrings.constFind( item );
+		if ( cached != displayStrings.constEnd() && cached->value.type() == value.type() && cached->type == item->type() ) {
+			// Compare the stored bytes, operator== rounds colors to what QColor can hold
+			char current[sizeof(Vector4)], recorded[sizeof(Vector4)];
+			value.storeInline( current );
+			cached->value.storeInline( recorded );
+			if ( memcmp( current, recorded, size_t( size ) ) == 0 )
+				return cached->text;
+		}
+	}
+
+	QString text;
+
+	if ( value.isCount() ) {
+		text = NifValue::enumOptionName( item->type(), value.toCount() );
+
+		if ( text.isEmpty() )
+			text = value.toString();
+	} else {
+		text = value.toString().replace( "\n", " " ).replace( "\r", " " );
+	}
+
+	if ( cacheable ) {
+		// Start over rather than grow without bound while large arrays are scrolled
+		if ( displayStrings.count() >= 0x10000 )
+			displayStrings.clear();
+
+		displayStrings.insert( item, { value, item->type(), text } );
+	}
+
+	return text;
+}
+
 QVariant NifModel::data( const QModelIndex & idx, int role ) const
 {
 	QModelIndex index = buddy( idx );
@@ -1227,9 +1712,7 @@ QVariant NifModel::data( const QModelIndex & idx, int role ) const
 						if ( idx == -1 )
 							return QString();
 
-						NifItem * header = getHeaderItem();
-						QModelIndex stringIndex = createIndex( header->row(), 0, header );
-						QString string = get<QString>( this->index( idx, 0, getIndex( stringIndex, "Strings" ) ) );
+						QString string = headerString( idx );
 
 						if ( idx < 0 )
 							return tr( "%1 - <index invalid>" ).arg( idx );
@@ -1269,17 +1752,8 @@ QVariant NifModel::data( const QModelIndex & idx, int role ) const
 
 						return tr( "None" );
 					}
-					else if ( item->value().isCount() )
-					{
-						QString optId = NifValue::enumOptionName( item->type(), item->value().toCount() );
-
-						if ( optId.isEmpty() )
-							return item->value().toString();
-
-						return QString( "%1" ).arg( optId );
-					}
 
-					return item->value().toString().replace( "\n", " " ).replace( "\r", " " );
+					return displayString( item );
 				}
 				break;
 			case ArgCol:
@@ -1531,8 +2005,11 @@ bool NifModel::setData( const QModelIndex & index, const QVariant & value, int r
 	case NifModel::NameCol:
 		item->setName( value.toString() );
 
-		if ( item->parent() && item->parent() == root )
+		if ( item->parent() && item->parent() == root ) {
+			// Older versions store the block type in front of the block
+			invalidateSize( root );
 			updateHeader();
+		}
 
 		break;
 	case NifModel::TypeCol:
@@ -1540,9 +2017,15 @@ bool NifModel::setData( const QModelIndex & index, const QVariant & value, int r
 		break;
 	case NifModel::ValueCol:
 		{
+			if ( transactionDepth )
+				recordValue( item );
+
 			QString type = item->type();
 			NifValue & val = item->value();
 
+			if ( !NifValue::isFixedSize( val.type() ) )
+				invalidateSize( item );
+
 			if ( val.type() == NifValue::tString || val.type() == NifValue::tFilePath ) {
 				val.changeType( version < 0x14010003 ? NifValue::tSizedString : NifValue::tStringIndex );
 				assignString( index, value.toString(), true );
@@ -1550,9 +2033,10 @@ bool NifModel::setData( const QModelIndex & index, const QVariant & value, int r
 				item->value().setFromVariant( value );
 
 				if ( isLink( index ) && getBlockOrHeader( index ) != getFooter() ) {
-					updateLinks();
+					updateLinks( getBlockNumber( index ) );
 					updateFooter();
-					emit linksChanged();
+					if ( !lockUpdates )
+						emit linksChanged();
 				}
 			}
 		}
@@ -1603,8 +2087,9 @@ bool NifModel::setData( const QModelIndex & index, const QVariant & value, int r
 	if ( state == Default ) {
 		// Reassess conditions for reliant data only when modifying value
 		invalidateDependentConditions( item );
-		// update original index
-		emit dataChanged( index, index );
+		// update original index, a transaction emits changed values when it ends
+		if ( !transactionDepth || index.column() != ValueCol )
+			emit dataChanged( index, index );
 	}
 
 	return true;
@@ -1618,6 +2103,32 @@ void NifModel::reset()
 	endResetModel();
 }
 
+QModelIndex NifModel::index( int row, int column, const QModelIndex & parent ) const
+{
+	if ( !unparsedBlocks.isEmpty() && parent.isValid() && parent.model() == this )
+		parseBlock( static_cast<NifItem *>( parent.internalPointer() ) );
+
+	return BaseModel::index( row, column, parent );
+}
+
+int NifModel::rowCount( const QModelIndex & parent ) const
+{
+	if ( !unparsedBlocks.isEmpty() && parent.isValid() && parent.model() == this )
+		parseBlock( static_cast<NifItem *>( parent.internalPointer() ) );
+
+	return BaseModel::rowCount( parent );
+}
+
+bool NifModel::hasChildren( const QModelIndex & parent ) const
+{
+	// Let views show unparsed blocks as expandable without parsing them
+	if ( !unparsedBlocks.isEmpty() && parent.isValid() && parent.model() == this
+		&& unparsedBlocks.contains( static_cast<NifItem *>( parent.internalPointer() ) ) )
+		return true;
+
+	return BaseModel::hasChildren( parent );
+}
+
 bool NifModel::removeRows( int row, int count, const QModelIndex & parent )
 {
 	NifItem * item = static_cast<NifItem *>( parent.internalPointer() );
@@ -1636,7 +2147,7 @@ bool NifModel::removeRows( int row, int count, const QModelIndex & parent )
 		endRemoveRows();
 
 		if ( link ) {
-			updateLinks();
+			updateLinks( getBlockNumber( item ) );
 			updateFooter();
 			emit linksChanged();
 		}
@@ -1716,17 +2227,33 @@ bool NifModel::setHeaderString( const QString & s )
 
 bool NifModel::load( QIODevice & device )
 {
-	QSettings cfg;
-	bool ignoreSize = false;
-	ignoreSize = cfg.value( "Ignore Block Size", false ).toBool();
-
 	clear();
 
 	NifIStream stream( this, &device );
 
+	return load( stream );
+}
+
+bool NifModel::load( const QByteArray & data )
+{
+	clear();
+
+	NifIStream stream( this, data );
+
+	return load( stream );
+}
+
+bool NifModel::load( NifIStream & stream )
+{
+	QSettings cfg;
+	bool ignoreSize = false;
+	ignoreSize = cfg.value( "Ignore Block Size", false ).toBool();
+
 	if ( state != Loading )
 		setState( Loading );
 
+	qint64 start = stream.pos();
+
 	// read header
 	NifItem * header = nullptr;
 	header = getHeaderItem();
@@ -1742,26 +2269,56 @@ bool NifModel::load( QIODevice & device )
 		return false;
 	}
 
+	// The loader knows the sizes, see fileOffset()
+	rootSizes.insert( header, int( stream.pos() - start ) );
+
+	// The versions are known now, insert the blocks from templates without the fields of other versions
+	if ( cfg.value( "Prune Version Templates", true ).toBool() )
+		templates = versionTemplates( header );
+
+	// The bytes of each block can be stored and decoded later when the header has the block sizes.
+	//	Big-endian files are parsed up front as the byte order is only known to the stream which read the header.
+	bool sized = !ignoreSize && version >= 0x14020000 && get<int>( header, "Endian Type" ) != 0;
+	// Parse each block on first access
+	bool lazy = sized && cfg.value( "Lazy Load Blocks", false ).toBool();
+	// Decode the blocks on all cores once they are read
+	bool parallel = sized && !lazy && QThread::idealThreadCount() > 1 && cfg.value( "Parallel Load Blocks", true ).toBool();
+
 	int numblocks = 0;
 	numblocks = get<int>( header, "Num Blocks" );
 	//qDebug( "numblocks %i", numblocks );
 
+	// The workers read their own copy of the header
+	QByteArray headerData;
+	if ( parallel && numblocks > 1 ) {
+		qint64 end = stream.pos();
+
+		if ( stream.seek( start ) )
+			headerData = stream.readRaw( end - start );
+
+		parallel = stream.seek( end ) && headerData.size() == end - start;
+	} else {
+		parallel = false;
+	}
+
 	emit sigProgress( 0, numblocks );
 	//QTime t = QTime::currentTime();
 
 	qint64 curpos = 0;
 	try
 	{
-		curpos = device.pos();
+		curpos = stream.pos();
 
 		if ( version >= 0x0303000d ) {
 			// read in the NiBlocks
 			QString prevblktyp;
 
 			for ( int c = 0; c < numblocks; c++ ) {
-				emit sigProgress( c + 1, numblocks );
+				// Parallel progress is reported as the blocks are decoded
+				if ( !parallel )
+					emit sigProgress( c + 1, numblocks );
 
-				if ( device.atEnd() )
+				if ( stream.atEnd() )
 					throw tr( "unexpected EOF during load" );
 
 				QString blktyp;
@@ -1779,7 +2336,7 @@ bool NifModel::load( QIODevice & device )
 						//		 (see for instance meshes/architecture/basementsections/ungrdltraphingedoor.nif)
 						if ( (version < 0x0a020000) && ( !blktyp.startsWith( "bhk" ) ) ) {
 							int dummy;
-							device.read( (char *)&dummy, 4 );
+							stream.readRaw( (char *)&dummy, 4 );
 
 							if ( dummy != 0 ) {
 								auto m = tr( "non-zero block separator (%1) preceeding block %2" ).arg( dummy ).arg( blktyp );
@@ -1796,12 +2353,12 @@ bool NifModel::load( QIODevice & device )
 							size = get<quint32>( index( c, 0, getIndex( createIndex( header->row(), 0, header ), "Block Size" ) ) );
 					} else {
 						int len;
-						device.read( (char *)&len, 4 );
+						stream.readRaw( (char *)&len, 4 );
 
 						if ( len < 2 || len > 80 )
 							throw tr( "next block does not start with a NiString" );
 
-						blktyp = device.read( len );
+						blktyp = stream.readRaw( len );
 					}
 
 					// Hack for NiMesh data streams
@@ -1827,15 +2384,34 @@ bool NifModel::load( QIODevice & device )
 						qDebug() << "Loaded NiDataStream with usage " << dataStreamUsage << " access " << dataStreamAccess;
 					}
 
-					if ( isNiBlock( blktyp ) ) {
+					if ( ( lazy || parallel ) && size != UINT_MAX && blktyp != "NiDataStream" && isNiBlock( blktyp ) ) {
+						NifBlockPtr block = blockTemplate( blktyp );
+						int at = getBlockCount() + 1;
+
+						beginInsertRows( QModelIndex(), at, at );
+
+						NifData blockData( blktyp, "NiBlock", block->text );
+						blockData.setFieldIndex( block );
+
+						NifItem * branch = insertBranch( root, blockData, at );
+						branch->setCondition( true );
+
+						endInsertRows();
+
+						unparsedBlocks.insert( branch, stream.readRaw( size ) );
+						rootSizes.insert( branch, int( size ) );
+					} else if ( isNiBlock( blktyp ) ) {
 						//qDebug() << "loading block" << c << ":" << blktyp );
 						QModelIndex newBlock = insertNiBlock( blktyp, -1 );
 
+						qint64 blockStart = stream.pos();
 						if ( !loadItem( root->child( c + 1 ), stream ) ) {
 							NifItem * child = root->child( c );
 							throw tr( "failed to load block number %1 (%2) previous block was %3" ).arg( c ).arg( blktyp ).arg( child ? child->name() : prevblktyp );
 						}
 
+						rootSizes.insert( root->child( c + 1 ), int( stream.pos() - blockStart ) );
+
 						// NiMesh hack
 						if ( blktyp == "NiDataStream" ) {
 							set<qint32>( newBlock, "Usage", dataStreamUsage );
@@ -1862,11 +2438,11 @@ bool NifModel::load( QIODevice & device )
 
 				// Check device position and emit warning if location is not expected
 				if ( size != UINT_MAX ) {
-					qint64 pos = device.pos();
+					qint64 pos = stream.pos();
 
 					if ( (curpos + size) != pos ) {
 						// unable to seek to location... abort
-						if ( device.seek( curpos + size ) ) {
+						if ( stream.seek( curpos + size ) ) {
 							auto m = tr( "device position incorrect after block number %1 (%2) at 0x%3 ended at 0x%4 (expected 0x%5)" )
 								.arg( c )
 								.arg( blktyp )
@@ -1884,7 +2460,7 @@ bool NifModel::load( QIODevice & device )
 						else {
 							throw tr( "failed to reposition device at block number %1 (%2) previous block was %3" ).arg( c ).arg( blktyp ).arg( root->child( c )->name() );
 						}
-						curpos = device.pos();
+						curpos = stream.pos();
 					} else {
 						curpos = pos;
 					}
@@ -1896,9 +2472,14 @@ bool NifModel::load( QIODevice & device )
 			// read in the footer
 			// Disabling the throw because it hinders decoding when the XML is wrong,
 			// and prevents any data whatsoever from loading.
-			loadItem( getFooterItem(), stream );
+			qint64 footerStart = stream.pos();
+			if ( loadItem( getFooterItem(), stream ) )
+				rootSizes.insert( getFooterItem(), int( stream.pos() - footerStart ) );
 			//if ( !loadItem( getFooterItem(), stream ) )
 			//	throw tr( "failed to load file footer" );
+
+			if ( parallel )
+				decodeBlocks( headerData );
 		} else {
 			// versions below 3.3.0.13
 			QMap<qint32, qint32> linkMap;
@@ -1907,30 +2488,30 @@ bool NifModel::load( QIODevice & device )
 				for ( qint32 c = 0; true; c++ ) {
 					emit sigProgress( c + 1, 0 );
 
-					if ( device.atEnd() )
+					if ( stream.atEnd() )
 						throw tr( "unexpected EOF during load" );
 
 					int len;
-					device.read( (char *)&len, 4 );
+					stream.readRaw( (char *)&len, 4 );
 
 					if ( len < 0 || len > 80 )
 						throw tr( "next block does not start with a NiString" );
 
-					QString blktyp = device.read( len );
+					QString blktyp = stream.readRaw( len );
 
 					if ( blktyp == "End Of File" ) {
 						break;
 					} else if ( blktyp == "Top Level Object" ) {
-						device.read( (char *)&len, 4 );
+						stream.readRaw( (char *)&len, 4 );
 
 						if ( len < 0 || len > 80 )
 							throw tr( "next block does not start with a NiString" );
 
-						blktyp = device.read( len );
+						blktyp = stream.readRaw( len );
 					}
 
 					qint32 p;
-					device.read( (char *)&p, 4 );
+					stream.readRaw( (char *)&p, 4 );
 					p -= 1;
 
 					if ( p != c )
@@ -1940,8 +2521,11 @@ bool NifModel::load( QIODevice & device )
 						//qDebug() << "loading block" << c << ":" << blktyp );
 						insertNiBlock( blktyp, -1 );
 
+						qint64 blockStart = stream.pos();
 						if ( !loadItem( root->child( c + 1 ), stream ) )
 							throw tr( "failed to load block number %1 (%2) previous block was %3" ).arg( c ).arg( blktyp ).arg( root->child( c )->name() );
+
+						rootSizes.insert( root->child( c + 1 ), int( stream.pos() - blockStart ) );
 					} else {
 						throw tr( "encountered unknown block (%1)" ).arg( blktyp );
 					}
@@ -1980,6 +2564,8 @@ bool NifModel::save( QIODevice & device ) const
 {
 	NifOStream stream( this, &device );
 
+	parseAllBlocks();
+
 	setState( Saving );
 
 	// Force update header and footer prior to save
@@ -2022,6 +2608,13 @@ bool NifModel::save( QIODevice & device ) const
 			}
 		}
 
+		// A block whose type is unknown to the XML is written back as it was read
+		auto unparsed = unparsedBlocks.constFind( root->child( c ) );
+		if ( unparsed != unparsedBlocks.constEnd() ) {
+			device.write( unparsed.value() );
+			continue;
+		}
+
 		if ( !saveItem( root->child( c ), stream ) ) {
 			Message::critical( nullptr, tr( "Failed to write block %1 (%2)." ).arg( itemName( index( c, 0 ) ) ).arg( c - 1 ) );
 			resetState();
@@ -2047,7 +2640,8 @@ bool NifModel::loadIndex( QIODevice & device, const QModelIndex & index )
 	if ( item && index.isValid() && index.model() == this ) {
 		NifIStream stream( this, &device );
 		bool ok = loadItem( item, stream );
-		updateLinks();
+		invalidateSize( item );
+		updateLinks( getBlockNumber( item ) );
 		updateFooter();
 		emit linksChanged();
 		return ok;
@@ -2064,8 +2658,9 @@ bool NifModel::loadAndMapLinks( QIODevice & device, const QModelIndex & index, c
 	if ( item && index.isValid() && index.model() == this ) {
 		NifIStream stream( this, &device );
 		bool ok = loadItem( item, stream );
+		invalidateSize( item );
 		mapLinks( item, map );
-		updateLinks();
+		updateLinks( getBlockNumber( item ) );
 		updateFooter();
 		emit linksChanged();
 		return ok;
@@ -2144,49 +2739,160 @@ bool NifModel::saveIndex( QIODevice & device, const QModelIndex & index ) const
 	return ( item && index.isValid() && index.model() == this && saveItem( item, stream ) );
 }
 
-int NifModel::fileOffset( const QModelIndex & index ) const
+int NifModel::rootPrefix( int c ) const
 {
-	NifSStream stream( this );
-	NifItem * target = static_cast<NifItem *>( index.internalPointer() );
-
-	if ( target && index.isValid() && index.model() == this ) {
-		int ofs = 0;
+	int ofs = 0;
 
-		for ( int c = 0; c < root->childCount(); c++ ) {
-			if ( c > 0 && c <= getBlockCount() ) {
-				if ( version > 0x0a000000 ) {
-					if ( version < 0x0a020000 ) {
-						ofs += 4;
-					}
-				} else {
-					if ( version < 0x0303000d ) {
-						if ( rootLinks.contains( c - 1 ) ) {
-							QString string = "Top Level Object";
-							ofs += 4 + string.length();
-						}
-					}
-
-					QString string = itemName( this->NifModel::index( c, 0 ) );
+	if ( c > 0 && c <= getBlockCount() ) {
+		if ( version > 0x0a000000 ) {
+			if ( version < 0x0a020000 ) {
+				ofs += 4;
+			}
+		} else {
+			if ( version < 0x0303000d ) {
+				if ( rootLinks.contains( c - 1 ) ) {
+					QString string = "Top Level Object";
 					ofs += 4 + string.length();
-
-					if ( version < 0x0303000d ) {
-						ofs += 4;
-					}
 				}
 			}
 
-			if ( fileOffset( root->child( c ), target, stream, ofs ) )
-				return ofs;
+			QString string = itemName( this->NifModel::index( c, 0 ) );
+			ofs += 4 + string.length();
+
+			if ( version < 0x0303000d ) {
+				ofs += 4;
+			}
 		}
 	}
 
+	return ofs;
+}
+
+int NifModel::rootSize( NifItem * item, NifSStream & stream ) const
+{
+	auto size = rootSizes.constFind( item );
+	if ( size != rootSizes.constEnd() )
+		return size.value();
+
+	int s = blockSize( item, stream );
+	rootSizes.insert( item, s );
+	return s;
+}
+
+QVector<int> NifModel::rootItemOffsets() const
+{
+	updateOffsets();
+	return rootOffsets;
+}
+
+void NifModel::updateOffsets() const
+{
+	if ( !rootOffsets.isEmpty() )
+		return;
+
+	NifSStream stream( this );
+	int ofs = 0;
+
+	rootOffsets.reserve( root->childCount() + 1 );
+	for ( int c = 0; c < root->childCount(); c++ ) {
+		ofs += rootPrefix( c );
+		rootOffsets.append( ofs );
+		ofs += rootSize( root->child( c ), stream );
+	}
+
+	rootOffsets.append( ofs );
+}
+
+void NifModel::invalidateSize( const NifItem * item )
+{
+	if ( !item )
+		return;
+
+	// The header strings changed
+	if ( stringTable.valid && ( item == stringTable.array || item->parent() == stringTable.array ) )
+		stringTable.valid = false;
+
+	// Blocks were inserted, removed or moved; their sizes are kept
+	if ( item == root ) {
+		rootOffsets.clear();
+		return;
+	}
+
+	while ( item->parent() && item->parent() != root )
+		item = item->parent();
+
+	// Detached items, e.g. a block which is being built, are not in the file
+	if ( item->parent() != root )
+		return;
+
+	rootSizes.remove( item );
+	rootOffsets.clear();
+}
+
+int NifModel::fileOffset( const QModelIndex & index ) const
+{
+	NifItem * target = static_cast<NifItem *>( index.internalPointer() );
+
+	if ( !target || !index.isValid() || index.model() != this )
+		return -1;
+
+	// The header, block or footer holding the target
+	NifItem * top = target;
+	while ( top->parent() && top->parent() != root )
+		top = top->parent();
+
+	if ( top->parent() != root )
+		return -1;
+
+	updateOffsets();
+
+	int ofs = rootOffsets.at( top->row() );
+
+	NifSStream stream( this );
+	if ( fileOffset( top, target, stream, ofs ) )
+		return ofs;
+
 	return -1;
 }
 
+QModelIndex NifModel::indexAtOffset( int offset ) const
+{
+	updateOffsets();
+
+	if ( offset < 0 || offset >= rootOffsets.last() )
+		return QModelIndex();
+
+	// The last row which starts at or before the offset
+	auto next = std::upper_bound( rootOffsets.constBegin(), rootOffsets.constEnd() - 1, offset );
+	int c = int( next - rootOffsets.constBegin() ) - 1;
+	if ( c < 0 )
+		return QModelIndex();
+
+	NifItem * top = root->child( c );
+	int ofs = rootOffsets.at( c );
+
+	// The offset is in the prefix of the next block
+	if ( offset >= ofs + rootSizes.value( top ) )
+		return QModelIndex();
+
+	NifSStream stream( this );
+	NifItem * item = itemAtOffset( top, offset, stream, ofs );
+	if ( !item )
+		item = top;
+
+	return createIndex( item->row(), 0, item );
+}
+
 int NifModel::blockSize( const QModelIndex & index ) const
 {
 	NifSStream stream( this );
-	return blockSize( static_cast<NifItem *>( index.internalPointer() ), stream );
+	NifItem * item = static_cast<NifItem *>( index.internalPointer() );
+
+	// The header, blocks and footer remember their size
+	if ( item && index.isValid() && item->parent() == root )
+		return rootSize( item, stream );
+
+	return blockSize( item, stream );
 }
 
 int NifModel::blockSize( NifItem * parent ) const
@@ -2202,6 +2908,18 @@ int NifModel::blockSize( NifItem * parent, NifSStream & stream ) const
 	if ( !parent )
 		return 0;
 
+	auto unparsed = unparsedBlocks.constFind( parent );
+	if ( unparsed != unparsedBlocks.constEnd() )
+		return unparsed->size();
+
+	// Packed elements are conditionless leaves
+	if ( parent->isPacked() ) {
+		for ( int row = 0; row < parent->childCount(); row++ )
+			size += stream.size( parent->childValue( row ) );
+
+		return size;
+	}
+
 	for ( int row = 0; row < parent->childCount(); row++ ) {
 		NifItem * child = parent->child( row );
 
@@ -2251,8 +2969,15 @@ bool NifModel::loadItem( NifItem * parent, NifIStream & stream )
 
 		if ( evalCondition( child ) ) {
 			if ( isArray( child ) ) {
-				if ( !updateArrayItem( child ) || !loadItem( child, stream ) )
+				if ( !updateArrayItem( child ) )
+					return false;
+
+				if ( isFixedSizeArray( child ) ) {
+					if ( !stream.readArray( child ) )
+						return false;
+				} else if ( !loadItem( child, stream ) ) {
 					return false;
+				}
 			} else if ( child->childCount() > 0 ) {
 				if ( !loadItem( child, stream ) )
 					return false;
@@ -2266,6 +2991,255 @@ bool NifModel::loadItem( NifItem * parent, NifIStream & stream )
 	return true;
 }
 
+bool NifModel::parseBlock( NifItem * block ) const
+{
+	auto unparsed = unparsedBlocks.find( block );
+	if ( unparsed == unparsedBlocks.end() )
+		return true;
+
+	// Keep the bytes while the type is unknown, e.g. after the XML was reloaded without it
+	NifBlockPtr type = blockTemplate( block->name() );
+	if ( !type )
+		return false;
+
+	// Take the bytes before parsing, the lookups made while loading must not parse the block again
+	QByteArray data = unparsed.value();
+	unparsedBlocks.erase( unparsed );
+
+	NifModel * self = const_cast<NifModel *>( this );
+
+	// Nobody has seen the rows of the block yet, so the views need not be told about them
+	bool blocked = self->blockSignals( true );
+	setState( Loading );
+
+	self->insertBlockTypes( block, type );
+
+	NifIStream stream( self, data );
+	bool ok = self->loadItem( block, stream );
+
+	restoreState();
+	self->blockSignals( blocked );
+
+	int b = getBlockNumber( block );
+	reportBlockLoad( b, block->name(), ok, stream.pos(), data.size() );
+
+	// The fields read may not add up to the stored size
+	if ( stream.pos() != data.size() ) {
+		rootSizes.insert( block, int( stream.pos() ) );
+		rootOffsets.clear();
+	}
+
+	self->updateBlockLinks( b );
+
+	// The roots were taken from the footer until every block was known
+	if ( unparsedBlocks.isEmpty() )
+		self->updateRootLinks();
+
+	// Blocks are often parsed in bursts, e.g. while a view is painted, notify once
+	if ( !linksChangePending ) {
+		linksChangePending = true;
+
+		QTimer::singleShot( 0, self, [self]() {
+			self->linksChangePending = false;
+			emit self->linksChanged();
+		} );
+	}
+
+	return ok;
+}
+
+void NifModel::parseAllBlocks() const
+{
+	// Blocks of unknown types stay unparsed
+	const QList<NifItem *> pending = unparsedBlocks.keys();
+	for ( NifItem * block : pending )
+		parseBlock( block );
+}
+
+void NifModel::reportBlockLoad( int block, const QString & type, bool ok, qint64 pos, qint64 size ) const
+{
+	if ( ok && pos == size )
+		return;
+
+	auto m = ok ? tr( "device position incorrect after block number %1 (%2), read 0x%3 of 0x%4 bytes" )
+	                .arg( block ).arg( type ).arg( QString::number( pos, 16 ) ).arg( QString::number( size, 16 ) )
+	            : tr( "failed to load block number %1 (%2)" ).arg( block ).arg( type );
+
+	if ( msgMode == UserMessage ) {
+		Message::append( tr( "Warnings were generated while reading NIF file." ), m );
+	} else {
+		testMsg( m );
+	}
+}
+
+//! Decodes the stored bytes of a run of blocks into detached items, see NifModel::decodeBlocks()
+class NifBlockDecoder final : public QRunnable
+{
+public:
+	NifBlockDecoder( NifVersionTemplatesPtr templates, const QByteArray & header )
+		: templates( templates ), header( header )
+	{
+		setAutoDelete( false );
+	}
+
+	~NifBlockDecoder()
+	{
+		for ( const Block & b : blocks )
+			delete b.item;
+	}
+
+	struct Block
+	{
+		QString type;
+		QByteArray data;
+		//! The decoded block, owned by the decoder until it is taken
+		NifItem * item = nullptr;
+		//! Whether every field was read
+		bool ok = false;
+		//! The number of bytes read
+		qint64 pos = 0;
+		//! The messages from reading the block
+		QList<TestMessage> messages;
+	};
+
+	//! The blocks to decode in file order
+	QVector<Block> blocks;
+	//! Released when the blocks are decoded
+	QSemaphore done;
+	//! The arenas the decoded blocks were allocated from
+	QVector<std::shared_ptr<NifItemArena>> arenas;
+
+	void run() override final;
+
+private:
+	NifVersionTemplatesPtr templates;
+	QByteArray header;
+};
+
+void NifBlockDecoder::run()
+{
+	{
+		QReadLocker lck( &NifModel::XMLlock );
+
+		// A model of its own reads the header and the blocks like a sequential load would
+		NifModel nif;
+		nif.templates = templates;
+		nif.setState( NifModel::Loading );
+
+		NifIStream headerStream( &nif, header );
+		bool ok = nif.loadHeader( nif.getHeaderItem(), headerStream );
+		nif.getMessages();
+
+		for ( Block & b : blocks ) {
+			if ( !ok )
+				break;
+
+			QModelIndex index = nif.insertNiBlock( b.type, -1 );
+			NifItem * block = static_cast<NifItem *>( index.internalPointer() );
+
+			if ( block ) {
+				NifIStream stream( &nif, b.data );
+				b.ok = nif.loadItem( block, stream );
+				b.pos = stream.pos();
+				b.item = nif.root->takeChild( block->row() );
+			}
+
+			b.messages = nif.getMessages();
+		}
+
+		nif.resetState();
+		arenas = nif.arenas;
+	}
+
+	done.release();
+}
+
+void NifModel::decodeBlocks( const QByteArray & header )
+{
+	int numblocks = getBlockCount();
+
+	// The stored blocks in file order
+	QVector<NifItem *> pending;
+	for ( int c = 0; c < numblocks; c++ ) {
+		NifItem * block = root->child( c + 1 );
+		if ( unparsedBlocks.contains( block ) )
+			pending.append( block );
+	}
+
+	// A pool of its own, the load may itself run on a global pool thread
+	QThreadPool pool;
+	std::vector<std::unique_ptr<NifBlockDecoder>> decoders;
+
+	// Several runs per thread even out blocks of uneven size
+	int runs = qMin( pending.count(), pool.maxThreadCount() * 4 );
+
+	for ( int r = 0; r < runs; r++ ) {
+		NifBlockDecoder * decoder = new NifBlockDecoder( templates, header );
+
+		for ( int p = pending.count() * r / runs; p < pending.count() * ( r + 1 ) / runs; p++ ) {
+			NifBlockDecoder::Block b;
+			b.type = pending[p]->name();
+			b.data = unparsedBlocks.take( pending[p] );
+			decoder->blocks.append( b );
+		}
+
+		decoders.emplace_back( decoder );
+		pool.start( decoder );
+	}
+
+	// Splice the blocks into the model in order as their runs complete
+	int p = 0;
+	for ( const auto & decoder : decoders ) {
+		decoder->done.acquire();
+		arenas += decoder->arenas;
+
+		for ( NifBlockDecoder::Block & b : decoder->blocks ) {
+			int row = pending[p++]->row();
+
+			// Keep the bytes of a block which could not be built
+			if ( !b.item && !b.data.isEmpty() )
+				unparsedBlocks.insert( pending[p - 1], b.data );
+
+			if ( b.item ) {
+				NifItem * stored = root->takeChild( row );
+				rootSizes.remove( stored );
+				delete stored;
+
+				root->insertChild( b.item, row );
+				rootSizes.insert( b.item, int( b.pos ) );
+				b.item = nullptr;
+			}
+
+			for ( const TestMessage & m : b.messages ) {
+				if ( msgMode == UserMessage ) {
+					Message::append( tr( "Warnings were generated while reading NIF file." ), m );
+				} else {
+					messages.append( m );
+				}
+			}
+
+			reportBlockLoad( row - 1, b.type, b.ok, b.pos, b.data.size() );
+			emit sigProgress( row, numblocks );
+		}
+	}
+
+	// The runnables are not deleted before the pool is done with them
+	pool.waitForDone();
+}
+
+bool NifModel::isFixedSizeArray( NifItem * array ) const
+{
+	if ( array->isPacked() )
+		return true;
+
+	if ( !isArray( array ) || array->isCompound() || array->isMultiArray() || array->isBinary() )
+		return false;
+
+	NifItem * first = array->child( 0 );
+
+	return first && first->childCount() == 0 && NifValue::isFixedSize( first->value().type() );
+}
+
 bool NifModel::loadHeader( NifItem * header, NifIStream & stream )
 {
 	// Load header separately and invalidate conditions before reading
@@ -2304,8 +3278,12 @@ bool NifModel::saveItem( NifItem * parent, NifOStream & stream ) const
 					}
 				}
 
-				if ( !saveItem( child, stream ) )
+				if ( isFixedSizeArray( child ) ) {
+					if ( !stream.writeArray( child ) )
+						return false;
+				} else if ( !saveItem( child, stream ) ) {
 					return false;
+				}
 			} else {
 				if ( !stream.write( child->value() ) )
 					return false;
@@ -2321,6 +3299,20 @@ bool NifModel::fileOffset( NifItem * parent, NifItem * target, NifSStream & stre
 	if ( parent == target )
 		return true;
 
+	auto unparsed = unparsedBlocks.constFind( parent );
+	if ( unparsed != unparsedBlocks.constEnd() ) {
+		ofs += unparsed->size();
+		return false;
+	}
+
+	if ( parent->isPacked() ) {
+		int rows = ( target->parent() == parent ) ? target->row() : parent->childCount();
+		for ( int row = 0; row < rows; row++ )
+			ofs += stream.size( parent->childValue( row ) );
+
+		return rows < parent->childCount();
+	}
+
 	for ( auto child : parent->children() ) {
 		if ( child == target )
 			return true;
@@ -2338,6 +3330,45 @@ bool NifModel::fileOffset( NifItem * parent, NifItem * target, NifSStream & stre
 	return false;
 }
 
+NifItem * NifModel::itemAtOffset( NifItem * parent, int offset, NifSStream & stream, int & ofs ) const
+{
+	// The rows of an unparsed block are not known
+	if ( unparsedBlocks.contains( parent ) )
+		return nullptr;
+
+	if ( parent->isPacked() ) {
+		for ( int row = 0; row < parent->childCount(); row++ ) {
+			ofs += stream.size( parent->childValue( row ) );
+			if ( offset < ofs )
+				return parent->child( row );
+		}
+
+		return nullptr;
+	}
+
+	for ( auto child : parent->children() ) {
+		if ( !evalCondition( child ) )
+			continue;
+
+		if ( isArray( child ) || !child->arr2().isEmpty() || child->childCount() > 0 ) {
+			int start = ofs;
+			NifItem * item = itemAtOffset( child, offset, stream, ofs );
+			if ( item )
+				return item;
+
+			// E.g. a binary array which is stored in one value
+			if ( offset < ofs && offset >= start )
+				return child;
+		} else {
+			ofs += stream.size( child->value() );
+			if ( offset < ofs )
+				return child;
+		}
+	}
+
+	return nullptr;
+}
+
 NifItem * NifModel::insertBranch( NifItem * parentItem, const NifData & data, int at )
 {
 	NifItem * item = parentItem->insertChild( data, at );
@@ -2347,6 +3378,16 @@ NifItem * NifModel::insertBranch( NifItem * parentItem, const NifData & data, in
 
 bool NifModel::evalCondition( NifItem * item, bool chkParents ) const
 {
+	// A value set in the transaction may decide the condition, reevaluate before it is read
+	if ( transactionDepth && !conditionParents.isEmpty() ) {
+		for ( const NifItem * p = item->parent(); p; p = p->parent() ) {
+			if ( conditionParents.contains( const_cast<NifItem *>( p ) ) ) {
+				const_cast<NifModel *>( this )->flushConditions();
+				break;
+			}
+		}
+	}
+
 	if ( item->isConditionValid() )
 		return item->condition();
 
@@ -2386,6 +3427,10 @@ bool NifModel::evalCondition( NifItem * item, bool chkParents ) const
 
 void NifModel::invalidateConditions( NifItem * item, bool refresh )
 {
+	// Packed elements are conditionless
+	if ( item->isPacked() )
+		return;
+
 	for ( NifItem * c : item->children() ) {
 		c->invalidateCondition();
 		c->invalidateVersionCondition();
@@ -2410,16 +3455,137 @@ void NifModel::invalidateConditions( const QModelIndex & index, bool refresh )
 		invalidateConditions( item, refresh );
 }
 
+//! Collect an item and its descendants in the order their conditions are evaluated
+static void conditionalItems( NifItem * item, QVector<NifItem *> & items )
+{
+	items.append( item );
+
+	// Packed elements are conditionless
+	if ( item->isPacked() )
+		return;
+
+	for ( int c = 0; c < item->childCount(); c++ )
+		conditionalItems( item->child( c ), items );
+}
+
+QString NifModel::benchmarkConditions( int passes )
+{
+	struct Timing
+	{
+		int blocks = 0;
+		qint64 evaluations = 0;
+		qint64 nsecs = 0;
+	};
+
+	QHash<QString, Timing> timings;
+	QElapsedTimer t;
+
+	for ( int b = 0; b < getBlockCount(); b++ ) {
+		NifItem * block = getBlockItem( b );
+		QVector<NifItem *> items;
+		for ( int c = 0; c < block->childCount(); c++ )
+			conditionalItems( block->child( c ), items );
+
+		Timing & timing = timings[block->name()];
+		timing.blocks++;
+		timing.evaluations += qint64( items.count() ) * passes;
+
+		for ( int p = 0; p < passes; p++ ) {
+			for ( NifItem * i : items ) {
+				i->invalidateCondition();
+				i->invalidateVersionCondition();
+			}
+
+			t.start();
+			for ( NifItem * i : items )
+				evalCondition( i );
+			timing.nsecs += t.nsecsElapsed();
+		}
+	}
+
+	QStringList types = timings.keys();
+	std::sort( types.begin(), types.end(), [&timings]( const QString & a, const QString & b ) {
+		return timings[a].nsecs > timings[b].nsecs;
+	} );
+
+	QString report;
+	for ( const QString & type : types ) {
+		const Timing & timing = timings[type];
+		QString line = tr( "%1: %2 blocks, %3 evaluations, %4 ms, %5 ns per evaluation" )
+			.arg( type ).arg( timing.blocks ).arg( timing.evaluations )
+			.arg( timing.nsecs / 1000000.0, 0, 'f', 2 )
+			.arg( timing.evaluations ? timing.nsecs / timing.evaluations : 0 );
+
+		qCDebug( nsNif ).noquote() << line;
+		report += line + "\n";
+	}
+
+	return report;
+}
+
 void NifModel::invalidateDependentConditions( NifItem * item )
 {
 	if ( !item )
 		return;
 
 	NifItem * p = item->parent();
-	if ( !p || p == root )
+	if ( !p || p == root || p->isPacked() )
 		return;
 
+	// The pruned templates lack the fields of another version, restore them in the blocks
+	if ( templates && state == Default && p == getHeaderItem() && !( versionKey( p ) == templates->key ) )
+		unpruneTemplates();
+
+	// Once per item when the transaction ends, or when a condition below the parent is read
+	if ( transactionDepth ) {
+		conditionEdits.insert( item );
+		conditionParents.insert( p );
+		return;
+	}
+
+	// Reevaluate only the rows known to read the item, while the children follow the layout of the type.
+	// The type is held until the end, reevaluating may replace the data of the parent.
+	const std::shared_ptr<const NifBlock> type = p->fieldIndex();
+	const NifDependents * deps = type ? &type->dependents : nullptr;
+	if ( deps && !p->isArray() && p->childCount() == deps->layout.count() ) {
+		auto follows = [p, deps]( int row ) {
+			return p->child( row )->atom() == deps->layout.at( row );
+		};
+
+		NifAtom name = item->atom();
+		const QVector<int> conditions = deps->conditions.value( name ) + deps->unresolved;
+		const QVector<int> arguments = deps->arguments.value( name ) + deps->unresolved;
+
+		bool valid = follows( item->row() );
+		for ( int row : conditions )
+			valid &= follows( row );
+		for ( int row : arguments )
+			valid &= follows( row );
+
+		if ( valid ) {
+			for ( int row : conditions ) {
+				NifItem * c = p->child( row );
+				c->invalidateCondition();
+				c->setCondition( BaseModel::evalCondition( c ) );
+			}
+
+			// The conditions below an argument read it through "ARG"
+			for ( int row : arguments ) {
+				NifItem * c = p->child( row );
+				if ( c->childCount() > 0 )
+					invalidateConditions( c, true );
+			}
+
+			// Rows which were read may be skipped now, or the other way around
+			if ( !conditions.isEmpty() || !arguments.isEmpty() )
+				invalidateSize( p );
+
+			return;
+		}
+	}
+
 	QString name = item->name();
+	bool dependents = false;
 	for ( int i = item->row(); i < p->childCount(); i++ ) {
 		auto c = p->children().at( i );
 		// String check for Name in cond or arg
@@ -2427,11 +3593,17 @@ void NifModel::invalidateDependentConditions( NifItem * item )
 		if ( c->cond().contains( name ) ) {
 			c->invalidateCondition();
 			c->setCondition( BaseModel::evalCondition( c ) );
+			dependents = true;
 		}
 
-		if ( (c->cond().contains( name ) || c->arg().contains( name )) && c->childCount() > 0 )
+		if ( (c->cond().contains( name ) || c->arg().contains( name )) && c->childCount() > 0 ) {
 			invalidateConditions( c, true );
+			dependents = true;
+		}
 	}
+
+	if ( dependents )
+		invalidateSize( p );
 }
 
 void NifModel::invalidateDependentConditions( const QModelIndex & index )
@@ -2450,44 +3622,114 @@ void NifModel::updateLinks( int block )
 {
 	if ( lockUpdates ) {
 		needUpdates = UpdateType( needUpdates | utLinks );
+		// Remember which blocks to update, -1 updates all of them
+		pendingLinks.insert( block );
 		return;
 	}
 
 	if ( block >= 0 ) {
-		childLinks[ block ].clear();
-		parentLinks[ block ].clear();
-		updateLinks( block, getBlockItem( block ) );
+		updateBlockLinks( block );
 	} else {
 		rootLinks.clear();
+		rootOffsets.clear();
 		childLinks.clear();
 		parentLinks.clear();
+		referrers.clear();
+		droppedCycles = false;
+
+		int n = getBlockCount();
 
 		// Run updateLinks() for each block
-		for ( int c = 0; c < getBlockCount(); c++ )
-			updateLinks( c );
+		for ( int c = 0; c < n; c++ ) {
+			updateLinks( c, root->child( c + 1 ) );
+			uniqueLinks( childLinks[c] );
+			uniqueLinks( parentLinks[c] );
+		}
 
 		// Run checkLinks() for each block
-		for ( int c = 0; c < getBlockCount(); c++ ) {
+		for ( int c = 0; c < n; c++ ) {
 			QStack<int> stack;
 			checkLinks( c, stack );
 		}
 
+		// The referrers are appended in block order
+		for ( int c = 0; c < n; c++ ) {
+			for ( const auto d : childLinks.value( c ) )
+				referrers[d].append( c );
+		}
 
-		int n = getBlockCount();
-		QByteArray hasrefs( n, 0 );
+		updateRootLinks();
+	}
+}
 
-		for ( int c = 0; c < n; c++ ) {
-			for ( const auto d : childLinks.value( c ) ) {
-				if ( d >= 0 && d < n )
-					hasrefs[d] = 1;
+void NifModel::updateBlockLinks( int block )
+{
+	// Blocks which are not parsed yet have no links to collect
+	if ( block >= getBlockCount() )
+		return;
+
+	QList<int> before = childLinks.value( block );
+
+	QList<int> & children = childLinks[block];
+	children.clear();
+	parentLinks[block].clear();
+	updateLinks( block, root->child( block + 1 ) );
+	uniqueLinks( children );
+	uniqueLinks( parentLinks[block] );
+
+	// Any new cycle passes through this block, it closes at a child which leads back to it
+	bool dropped = false;
+	QSet<int> ancestors;
+	QVector<int> queue{ block };
+	while ( !queue.isEmpty() ) {
+		int b = queue.takeLast();
+		for ( int r : referrers.value( b ) ) {
+			if ( r != block && !ancestors.contains( r ) ) {
+				ancestors.insert( r );
+				queue.append( r );
 			}
 		}
+	}
 
-		for ( int c = 0; c < n; c++ ) {
-			if ( !hasrefs[c] )
-				rootLinks.append( c );
+	for ( int i = children.count() - 1; i >= 0; i-- ) {
+		int child = children.at( i );
+		if ( child == block || ancestors.contains( child ) ) {
+			auto m = tr( "infinite recursive link construct detected %1 -> %2" ).arg( block ).arg( child );
+			if ( msgMode == UserMessage ) {
+				Message::append( tr( "Warnings were generated while reading NIF file." ), m );
+			} else {
+				testMsg( m );
+			}
+
+			children.removeAt( i );
+			dropped = true;
 		}
 	}
+
+	// Only the edges which changed touch the reverse index
+	QSet<int> removed;
+	for ( int c : before )
+		removed.insert( c );
+
+	for ( int c : children )
+		removed.remove( c );
+
+	// An edge left out to break a cycle elsewhere may be restored by removing this one,
+	// the blocks holding such edges are not collected again here
+	if ( droppedCycles && !removed.isEmpty() ) {
+		updateLinks();
+		return;
+	}
+
+	droppedCycles |= dropped;
+
+	for ( int c : children ) {
+		if ( !before.contains( c ) )
+			addReferrer( c, block );
+	}
+
+	for ( int c : removed )
+		removeReferrer( c, block );
 }
 
 void NifModel::updateLinks( int block, NifItem * parent )
@@ -2506,14 +3748,13 @@ void NifModel::updateLinks( int block, NifItem * parent )
 			continue;
 		}
 	
+		// Duplicates are removed once the block is done
 		int i = c->value().toLink();
 		if ( i >= 0 ) {
 			if ( c->value().type() == NifValue::tUpLink ) {
-				if ( !parentLinks[block].contains( i ) )
-					parentLinks[block].append( i );
+				parentLinks[block].append( i );
 			} else {
-				if ( !childLinks[block].contains( i ) )
-					childLinks[block].append( i );
+				childLinks[block].append( i );
 			}
 		}
 	}
@@ -2526,6 +3767,81 @@ void NifModel::updateLinks( int block, NifItem * parent )
 	}
 }
 
+void NifModel::uniqueLinks( QList<int> & links )
+{
+	if ( links.count() < 2 )
+		return;
+
+	QSet<int> seen;
+	seen.reserve( links.count() );
+
+	int n = 0;
+	for ( int i = 0; i < links.count(); i++ ) {
+		if ( !seen.contains( links.at( i ) ) ) {
+			seen.insert( links.at( i ) );
+			links[n++] = links.at( i );
+		}
+	}
+
+	links.erase( links.begin() + n, links.end() );
+}
+
+void NifModel::addReferrer( int block, int referrer )
+{
+	QList<int> & refs = referrers[block];
+	bool wasRoot = refs.isEmpty();
+
+	refs.insert( std::lower_bound( refs.begin(), refs.end(), referrer ), referrer );
+
+	// The roots of a partly parsed file come from its footer
+	if ( wasRoot && unparsedBlocks.isEmpty() ) {
+		rootLinks.removeOne( block );
+		// Files before 3.3.0.13 mark the roots in front of the blocks
+		rootOffsets.clear();
+	}
+}
+
+void NifModel::removeReferrer( int block, int referrer )
+{
+	auto refs = referrers.find( block );
+	if ( refs == referrers.end() )
+		return;
+
+	refs->removeOne( referrer );
+
+	if ( refs->isEmpty() ) {
+		referrers.erase( refs );
+
+		if ( unparsedBlocks.isEmpty() && block < getBlockCount() ) {
+			rootLinks.insert( std::lower_bound( rootLinks.begin(), rootLinks.end(), block ), block );
+			rootOffsets.clear();
+		}
+	}
+}
+
+void NifModel::updateRootLinks()
+{
+	rootLinks.clear();
+	rootOffsets.clear();
+
+	int n = getBlockCount();
+
+	if ( unparsedBlocks.isEmpty() ) {
+		for ( int c = 0; c < n; c++ ) {
+			if ( !referrers.contains( c ) )
+				rootLinks.append( c );
+		}
+	} else {
+		// The references of unparsed blocks are unknown, trust the roots stored in the footer
+		NifItem * roots = getItem( getFooterItem(), "Roots" );
+		for ( int r = 0; roots && r < roots->childCount(); r++ ) {
+			int l = roots->child( r )->value().toLink();
+			if ( l >= 0 && l < n && !rootLinks.contains( l ) )
+				rootLinks.append( l );
+		}
+	}
+}
+
 void NifModel::checkLinks( int block, QStack<int> & parents )
 {
 	parents.push( block );
@@ -2539,6 +3855,7 @@ void NifModel::checkLinks( int block, QStack<int> & parents )
 			}
 
 			childLinks[block].removeAll( child );
+			droppedCycles = true;
 		} else {
 			checkLinks( child, parents );
 		}
@@ -2548,7 +3865,8 @@ void NifModel::checkLinks( int block, QStack<int> & parents )
 
 void NifModel::adjustLinks( NifItem * parent, int block, int delta )
 {
-	if ( !parent )
+	// Packed arrays hold no links
+	if ( !parent || parent->isPacked() )
 		return;
 
 	if ( parent->childCount() > 0 ) {
@@ -2568,7 +3886,8 @@ void NifModel::adjustLinks( NifItem * parent, int block, int delta )
 
 void NifModel::mapLinks( NifItem * parent, const QMap<qint32, qint32> & map )
 {
-	if ( !parent )
+	// Packed arrays hold no links
+	if ( !parent || parent->isPacked() )
 		return;
 
 	if ( parent->childCount() > 0 ) {
@@ -2642,17 +3961,21 @@ bool NifModel::setLink( const QModelIndex & parent, const QString & name, qint32
 
 	NifItem * item = getItem( parentItem, name );
 
+	if ( item && transactionDepth )
+		recordValue( item );
+
 	if ( item && item->value().setLink( l ) ) {
-		emit dataChanged( createIndex( item->row(), ValueCol, item ), createIndex( item->row(), ValueCol, item ) );
+		valueChanged( item );
 		NifItem * parent = item;
 
 		while ( parent->parent() && parent->parent() != root )
 			parent = parent->parent();
 
 		if ( parent != getFooterItem() ) {
-			updateLinks();
+			updateLinks( getBlockNumber( parent ) );
 			updateFooter();
-			emit linksChanged();
+			if ( !lockUpdates )
+				emit linksChanged();
 		}
 
 		return true;
@@ -2668,17 +3991,21 @@ bool NifModel::setLink( const QModelIndex & index, qint32 l )
 	if ( !( index.isValid() && item && index.model() == this ) )
 		return false;
 
+	if ( transactionDepth )
+		recordValue( item );
+
 	if ( item && item->value().setLink( l ) ) {
-		emit dataChanged( createIndex( item->row(), ValueCol, item ), createIndex( item->row(), ValueCol, item ) );
+		valueChanged( item );
 		NifItem * parent = item;
 
 		while ( parent->parent() && parent->parent() != root )
 			parent = parent->parent();
 
 		if ( parent != getFooterItem() ) {
-			updateLinks();
+			updateLinks( getBlockNumber( parent ) );
 			updateFooter();
-			emit linksChanged();
+			if ( !lockUpdates )
+				emit linksChanged();
 		}
 
 		return true;
@@ -2695,13 +4022,16 @@ bool NifModel::setLinkArray( const QModelIndex & iArray, const QVector<qint32> &
 		bool ret = true;
 
 		for ( int c = 0; c < item->childCount() && c < links.count(); c++ ) {
+			if ( transactionDepth )
+				recordValue( item->child( c ) );
+
 			ret &= item->child( c )->value().setLink( links[c] );
 		}
 
 		ret &= item->childCount() == links.count();
 		int x = item->childCount() - 1;
 
-		if ( x >= 0 )
+		if ( x >= 0 && !transactionDepth )
 			emit dataChanged( createIndex( 0, ValueCol, item->child( 0 ) ), createIndex( x, ValueCol, item->child( x ) ) );
 
 		NifItem * parent = item;
@@ -2710,9 +4040,10 @@ bool NifModel::setLinkArray( const QModelIndex & iArray, const QVector<qint32> &
 			parent = parent->parent();
 
 		if ( parent != getFooterItem() ) {
-			updateLinks();
+			updateLinks( getBlockNumber( parent ) );
 			updateFooter();
-			emit linksChanged();
+			if ( !lockUpdates )
+				emit linksChanged();
 		}
 
 		return ret;
@@ -2738,16 +4069,11 @@ bool NifModel::isLink( const QModelIndex & index, bool * isChildLink ) const
 
 int NifModel::getParent( int block ) const
 {
-	int parent = -1;
-
-	for ( int b = 0; b < getBlockCount(); b++ ) {
-		if ( childLinks.value( b ).contains( block ) ) {
-			parent = b;
-			break;
-		}
-	}
+	auto refs = referrers.constFind( block );
+	if ( refs == referrers.constEnd() || refs->isEmpty() )
+		return -1;
 
-	return parent;
+	return refs->first();
 }
 
 int NifModel::getParent( const QModelIndex & index ) const
@@ -2774,13 +4100,7 @@ QString NifModel::string( const QModelIndex & index, bool extraInfo ) const
 		if ( idx < 0 )
 			return QString();
 
-		NifItem * header = this->getHeaderItem();
-		QModelIndex stringIndex = createIndex( header->row(), 0, header );
-
-		if ( !stringIndex.isValid() )
-			return tr( "%1 - <index invalid>" ).arg( idx );
-
-		QString string = BaseModel::get<QString>( this->index( idx, 0, getIndex( stringIndex, "Strings" ) ) );
+		QString string = headerString( idx );
 
 		if ( extraInfo )
 			string = QString( "%2 [%1]" ).arg( idx ).arg( string );
@@ -2854,29 +4174,19 @@ bool NifModel::assignString( NifItem * item, const QString & string, bool replac
 			return set<int>( item, 0xffffffff );
 		}
 
-		QModelIndex iArray = getIndex( header, "Strings" );
-
 		// Simply replace the string
 		if ( replace && idx >= 0 && idx < nstrings ) {
+			QModelIndex iArray = getIndex( header, "Strings" );
 			return BaseModel::set<QString>( iArray.child( idx, 0 ), string );
 		}
 
-		QVector<QString> stringVector = getArray<QString>( iArray );
-		idx = stringVector.indexOf( string );
-
-		// Already exists.  Just update the Index
-		if ( idx >= 0 && idx < stringVector.size() ) {
-			v.changeType( NifValue::tStringIndex );
-			return set<int>( pItem, idx );
-		}
-
-		// Append string to end of list
-		set<uint>( header, "Num Strings", nstrings + 1 );
-		updateArray( header, "Strings" );
-		BaseModel::set<QString>( iArray.child( nstrings, 0 ), string );
+		// Reuse the index of an existing string or append it
+		idx = internString( string );
+		if ( idx < 0 )
+			return false;
 
 		v.changeType( NifValue::tStringIndex );
-		return set<int>( pItem, nstrings );
+		return set<int>( pItem, idx );
 	} // endif getVersionNumber() >= 0x14010003
 
 	// Handle the older simpler strings
@@ -2898,6 +4208,188 @@ bool NifModel::assignString( const QModelIndex & index, const QString & name, co
 }
 
 
+QString NifModel::headerString( int idx ) const
+{
+	const NifItem * array = getItem( getHeaderItem(), "Strings" );
+	if ( !array || idx < 0 || idx >= array->childCount() )
+		return QString();
+
+	// Read the packed storage directly, the element items are not created
+	return array->childValue( idx ).get<QString>();
+}
+
+void NifModel::updateStringTable() const
+{
+	if ( stringTable.valid )
+		return;
+
+	const NifItem * array = getItem( getHeaderItem(), "Strings" );
+
+	stringTable.array = array;
+	stringTable.index.clear();
+	stringTable.valid = true;
+
+	if ( !array )
+		return;
+
+	// Backwards, so that the first of duplicate strings wins
+	stringTable.index.reserve( array->childCount() );
+	for ( int i = array->childCount() - 1; i >= 0; i-- )
+		stringTable.index.insert( array->childValue( i ).get<QString>(), i );
+}
+
+int NifModel::lookupString( const QString & string ) const
+{
+	updateStringTable();
+	return stringTable.index.value( string, -1 );
+}
+
+int NifModel::internString( const QString & string )
+{
+	int idx = lookupString( string );
+	if ( idx >= 0 || !stringTable.array )
+		return idx;
+
+	NifItem * header = getHeaderItem();
+	int nstrings = get<int>( header, "Num Strings" );
+
+	// Appending changes the array, which would have the table rebuilt; extend it instead
+	QHash<QString, int> index = std::move( stringTable.index );
+
+	set<uint>( header, "Num Strings", nstrings + 1 );
+	updateArray( getHeader(), "Strings" );
+
+	NifItem * array = getItem( header, "Strings" );
+	if ( !array || nstrings >= array->childCount() )
+		return -1;
+
+	BaseModel::set<QString>( array->child( nstrings ), string );
+
+	index.insert( string, nstrings );
+	stringTable.array = array;
+	stringTable.index = std::move( index );
+	stringTable.valid = true;
+
+	return nstrings;
+}
+
+void NifModel::collectStringIndices( NifItem * parent, QVector<QPair<NifItem *, int>> & refs ) const
+{
+	if ( parent->isPacked() ) {
+		for ( int row = 0; row < parent->childCount(); row++ ) {
+			if ( parent->childValue( row ).type() == NifValue::tStringIndex )
+				refs.append( { parent, row } );
+		}
+
+		return;
+	}
+
+	for ( auto child : parent->children() ) {
+		if ( child->childCount() > 0 )
+			collectStringIndices( child, refs );
+		else if ( child->value().type() == NifValue::tStringIndex )
+			refs.append( { child, -1 } );
+	}
+}
+
+QStringList NifModel::compactStrings( const QStringList & keep )
+{
+	QStringList removed;
+
+	NifItem * header = getHeaderItem();
+	NifItem * array = getItem( header, "Strings" );
+	if ( version < 0x14010003 || !array )
+		return removed;
+
+	QVector<QString> strings = array->getArray<QString>();
+	int n = strings.count();
+
+	// The stored blocks are parsed to see their indices
+	QVector<QPair<NifItem *, int>> refs;
+	for ( int b = 0; b < getBlockCount(); b++ ) {
+		NifItem * block = getBlockItem( b );
+		if ( !block )
+			continue;
+
+		parseBlock( block );
+		collectStringIndices( block, refs );
+	}
+
+	auto value = []( const QPair<NifItem *, int> & ref ) -> NifValue & {
+		return ( ref.second < 0 ) ? ref.first->value() : ref.first->childValue( ref.second );
+	};
+
+	QVector<bool> used( n, false );
+	for ( const QString & string : keep ) {
+		int idx = lookupString( string );
+		if ( idx >= 0 )
+			used[idx] = true;
+	}
+
+	for ( const auto & ref : refs ) {
+		quint32 idx = value( ref ).get<quint32>();
+		if ( idx < quint32( n ) )
+			used[idx] = true;
+	}
+
+	// Keep the order of the used strings, the first of duplicate strings takes the others' place
+	QVector<QString> newStrings;
+	QHash<QString, int> newIndex;
+	QVector<int> remap( n, -1 );
+
+	for ( int i = 0; i < n; i++ ) {
+		auto existing = newIndex.constFind( strings.at( i ) );
+
+		if ( !used.at( i ) || existing != newIndex.constEnd() ) {
+			if ( used.at( i ) )
+				remap[i] = existing.value();
+
+			removed << strings.at( i );
+			continue;
+		}
+
+		remap[i] = newStrings.count();
+		newIndex.insert( strings.at( i ), remap[i] );
+		newStrings.append( strings.at( i ) );
+	}
+
+	if ( removed.isEmpty() )
+		return removed;
+
+	// One update of the views for all indices
+	NifTransaction transaction( this );
+
+	for ( const auto & ref : refs ) {
+		quint32 idx = value( ref ).get<quint32>();
+		if ( idx >= quint32( n ) || remap.at( idx ) == int( idx ) )
+			continue;
+
+		if ( ref.second < 0 ) {
+			set<int>( ref.first, remap.at( idx ) );
+		} else {
+			recordArray( ref.first );
+			value( ref ).set<int>( remap.at( idx ) );
+			arrayChanged( ref.first );
+		}
+	}
+
+	QModelIndex iHeader = getHeader();
+	set<uint>( iHeader, "Num Strings", newStrings.count() );
+	updateArray( iHeader, "Strings" );
+	setArray<QString>( iHeader, "Strings", newStrings );
+
+	transaction.commit();
+	updateHeader();
+
+	// The new strings are hashed already
+	stringTable.array = getItem( header, "Strings" );
+	stringTable.index = newIndex;
+	stringTable.valid = true;
+
+	return removed;
+}
+
+
 // convert a block from one type to another
 void NifModel::convertNiBlock( const QString & identifier, const QModelIndex & index )
 {
@@ -2912,16 +4404,17 @@ void NifModel::convertNiBlock( const QString & identifier, const QModelIndex & i
 	}
 
 	NifItem * branch = static_cast<NifItem *>( index.internalPointer() );
-	NifBlockPtr srcBlock = blocks.value( btype );
-	NifBlockPtr dstBlock = blocks.value( identifier );
+	NifBlockPtr srcBlock = blockTemplate( btype );
+	NifBlockPtr dstBlock = blockTemplate( identifier );
 
 	if ( srcBlock && dstBlock && branch ) {
+		parseBlock( branch );
 		branch->setName( identifier );
 
 		if ( inherits( btype, identifier ) ) {
 			// Remove any level between the two types
 			for ( QString ancestor = btype; !ancestor.isNull() && ancestor != identifier; ) {
-				NifBlockPtr block = blocks.value( ancestor );
+				NifBlockPtr block = blockTemplate( ancestor );
 
 				if ( !block )
 					break;
@@ -2938,7 +4431,7 @@ void NifModel::convertNiBlock( const QString & identifier, const QModelIndex & i
 			QStringList types;
 
 			for ( QString ancestor = identifier; !ancestor.isNull() && ancestor != btype; ) {
-				NifBlockPtr block = blocks.value( ancestor );
+				NifBlockPtr block = blockTemplate( ancestor );
 
 				if ( !block )
 					break;
@@ -2948,7 +4441,7 @@ void NifModel::convertNiBlock( const QString & identifier, const QModelIndex & i
 			}
 
 			for ( const QString& ancestor : types ) {
-				NifBlockPtr block = blocks.value( ancestor );
+				NifBlockPtr block = blockTemplate( ancestor );
 
 				if ( !block )
 					break;
@@ -2970,7 +4463,7 @@ void NifModel::convertNiBlock( const QString & identifier, const QModelIndex & i
 
 		if ( state != Loading ) {
 			updateHeader();
-			updateLinks();
+			updateLinks( getBlockNumber( branch ) );
 			updateFooter();
 			emit linksChanged();
 		}
@@ -2994,13 +4487,161 @@ bool NifModel::holdUpdates( bool value )
 	return retval;
 }
 
+void NifModel::beginTransaction()
+{
+	if ( transactionDepth++ > 0 )
+		return;
+
+	edits = Edits();
+	conditionEdits.clear();
+	conditionParents.clear();
+	transactionHeld = holdUpdates( true );
+}
+
+void NifModel::endTransaction( const QString & text )
+{
+	if ( transactionDepth == 0 || --transactionDepth > 0 )
+		return;
+
+	Edits changed = edits;
+
+	flushEdits();
+	edits = Edits();
+
+	// Updates the links, header and footer once
+	holdUpdates( transactionHeld );
+
+	bool empty = changed.items.isEmpty() && changed.arrays.isEmpty();
+	if ( !text.isEmpty() && undoStack && !changed.structural && !empty ) {
+		undoStack->push( new BatchEditCommand( text, changed, this ) );
+		limitUndoMemory();
+	}
+}
+
+void NifModel::rollbackTransaction()
+{
+	if ( transactionDepth == 0 || edits.structural )
+		return;
+
+	Edits changed = edits;
+	applyEdits( changed );
+}
+
+void NifModel::applyEdits( const Edits & values )
+{
+	beginTransaction();
+
+	for ( int i = 0; i < values.items.count(); i++ ) {
+		NifItem * item = values.items.at( i );
+		recordValue( item );
+		item->value() = values.values.at( i );
+		conditionEdits.insert( item );
+		if ( item->parent() )
+			conditionParents.insert( item->parent() );
+
+		if ( !NifValue::isFixedSize( item->value().type() ) )
+			invalidateSize( item );
+
+		if ( item->value().isLink() )
+			updateLinks( getBlockNumber( item ) );
+	}
+
+	for ( int i = 0; i < values.arrays.count(); i++ ) {
+		NifItem * array = values.arrays.at( i );
+		const ArrayValues & elements = values.arrayValues.at( i );
+		if ( array->childCount() != elements.count )
+			continue;
+
+		recordArray( array );
+		elements.write( array );
+
+		if ( elements.type == NifValue::tNone )
+			invalidateSize( array );
+	}
+
+	endTransaction();
+}
+
+qint64 NifModel::undoMemory() const
+{
+	qint64 size = 0;
+	if ( !undoStack )
+		return size;
+
+	for ( int i = 0; i < undoStack->count(); i++ ) {
+		auto command = dynamic_cast<const BatchEditCommand *>( undoStack->command( i ) );
+		if ( command )
+			size += command->byteSize();
+	}
+
+	return size;
+}
+
+void NifModel::limitUndoMemory()
+{
+	qint64 limit = qint64( QSettings().value( "Undo Memory Limit", 256 ).toInt() ) << 20;
+	qint64 size = undoMemory();
+
+	// The latest command is kept regardless of its size
+	for ( int i = 0; size > limit && i < undoStack->count() - 1; i++ ) {
+		const QUndoCommand * command = undoStack->command( i );
+
+		auto batch = dynamic_cast<BatchEditCommand *>( const_cast<QUndoCommand *>( command ) );
+		if ( !batch ) {
+			// Single value commands hold little, anything else is not accounted for
+			if ( !dynamic_cast<const ChangeValueCommand *>( command ) && !dynamic_cast<const ToggleCheckBoxListCommand *>( command ) )
+				qCDebug( nsNif ) << "The memory of undo command" << command->text() << "is not counted";
+			continue;
+		}
+
+		if ( batch->isReleased() )
+			continue;
+
+		size -= batch->byteSize();
+		batch->release();
+		size += batch->byteSize();
+	}
+}
+
+void NifModel::flushConditions()
+{
+	QSet<NifItem *> items = conditionEdits;
+	conditionEdits.clear();
+	conditionParents.clear();
+
+	// Reevaluate now rather than defer again
+	int depth = transactionDepth;
+	transactionDepth = 0;
+
+	for ( NifItem * item : items )
+		invalidateDependentConditions( item );
+
+	transactionDepth = depth;
+}
+
+void NifModel::flushEdits()
+{
+	flushConditions();
+
+	BaseModel::flushEdits();
+}
+
 void NifModel::updateModel( UpdateType value )
 {
 	if ( value & utHeader )
 		updateHeader();
 
-	if ( value & utLinks )
-		updateLinks();
+	if ( value & utLinks ) {
+		QSet<int> blocks = pendingLinks;
+		pendingLinks.clear();
+
+		if ( blocks.isEmpty() || blocks.contains( -1 ) ) {
+			updateLinks();
+		} else {
+			for ( int b : blocks )
+				updateLinks( b );
+		}
+	}
 
 	if ( value & utFooter )
 		updateFooter();
@@ -3020,24 +4661,18 @@ NifModelEval::NifModelEval( const NifModel * model, const NifItem * item )
 	this->item = item;
 }
 
-QVariant NifModelEval::operator()( const QVariant & v ) const
+quint32 NifModelEval::operator()( const Expression::Field & field ) const
 {
-	if ( v.type() == QVariant::String ) {
-		QString left = v.toString();
-		NifItem * i = const_cast<NifItem *>(item);
-		i = model->getItem( i, left );
-
-		if ( i ) {
-			if ( i->value().isCount() )
-				return QVariant( i->value().toCount() );
-			else if ( i->value().isFileVersion() )
-				return QVariant( i->value().toFileVersion() );
-		}
+	NifItem * i = model->getItem( const_cast<NifItem *>(item), field );
 
-		return QVariant( 0 );
+	if ( i ) {
+		if ( i->value().isCount() )
+			return i->value().toCount();
+		else if ( i->value().isFileVersion() )
+			return i->value().toFileVersion();
 	}
 
-	return v;
+	return 0;
 }
 
 
@@ -3078,6 +4713,180 @@ void ChangeValueCommand::undo()
 }
 
 
+/*
+ *  NifTransaction
+ */
+
+NifTransaction::NifTransaction( NifModel * nif, const QString & text )
+	: nif( nif ), text( text )
+{
+	nif->beginTransaction();
+}
+
+NifTransaction::~NifTransaction()
+{
+	commit();
+}
+
+void NifTransaction::commit()
+{
+	if ( !open )
+		return;
+
+	open = false;
+	nif->endTransaction( text );
+}
+
+void NifTransaction::rollback()
+{
+	if ( !open )
+		return;
+
+	open = false;
+	nif->rollbackTransaction();
+	nif->endTransaction();
+}
+
+
+/*
+ *  BatchEditCommand
+ */
+
+BatchEditCommand::BatchEditCommand( const QString & text, const NifModel::Edits & before, NifModel * model )
+	: QUndoCommand( text ), nif( model ), oldValues( before ), newValues( before ), resets( model->resets )
+{
+	itemPaths.reserve( newValues.items.count() );
+	for ( int i = 0; i < newValues.items.count(); i++ ) {
+		newValues.values[i] = newValues.items.at( i )->value();
+		itemPaths.append( path( newValues.items.at( i ) ) );
+	}
+
+	// Keep only the elements which were changed, as packed before and after buffers
+	arrayPaths.reserve( newValues.arrays.count() );
+	for ( int i = 0; i < newValues.arrays.count(); i++ ) {
+		oldValues.arrayValues[i].diff( newValues.arrays.at( i ), newValues.arrayValues[i] );
+		arrayPaths.append( path( newValues.arrays.at( i ) ) );
+	}
+
+	// The items are found again through their paths
+	oldValues.positions.clear();
+	newValues.positions.clear();
+}
+
+void BatchEditCommand::redo()
+{
+	if ( done )
+		return;
+
+	NifModel::Edits values = newValues;
+	if ( !resolve( values ) ) {
+		release();
+		return;
+	}
+
+	nif->applyEdits( values );
+	done = true;
+}
+
+void BatchEditCommand::undo()
+{
+	NifModel::Edits values = oldValues;
+	if ( !resolve( values ) ) {
+		release();
+		return;
+	}
+
+	nif->applyEdits( values );
+	done = false;
+}
+
+BatchEditCommand::ItemPath BatchEditCommand::path( const NifItem * item ) const
+{
+	ItemPath p;
+	p.name = item->atom();
+
+	while ( item->parent() && item->parent() != nif->root ) {
+		p.rows.prepend( item->row() );
+		item = item->parent();
+	}
+
+	p.block = item;
+	return p;
+}
+
+bool BatchEditCommand::resolve( NifModel::Edits & values ) const
+{
+	if ( released || nif->resets != resets )
+		return false;
+
+	// A block is found by its item, its row changes when blocks before it are inserted or removed
+	QSet<const NifItem *> blocks;
+	for ( const NifItem * b : nif->root->children() )
+		blocks.insert( b );
+
+	auto find = [&blocks]( const ItemPath & p ) -> NifItem * {
+		if ( !blocks.contains( p.block ) )
+			return nullptr;
+
+		NifItem * item = const_cast<NifItem *>( p.block );
+		for ( int r : p.rows ) {
+			item = item->child( r );
+			if ( !item )
+				return nullptr;
+		}
+
+		return ( item->atom() == p.name ) ? item : nullptr;
+	};
+
+	for ( int i = 0; i < itemPaths.count(); i++ ) {
+		NifItem * item = find( itemPaths.at( i ) );
+		if ( !item || item->value().type() != values.values.at( i ).type() )
+			return false;
+
+		values.items[i] = item;
+	}
+
+	for ( int i = 0; i < arrayPaths.count(); i++ ) {
+		NifItem * array = find( arrayPaths.at( i ) );
+		if ( !array || array->childCount() != values.arrayValues.at( i ).count )
+			return false;
+
+		values.arrays[i] = array;
+	}
+
+	return true;
+}
+
+qint64 BatchEditCommand::byteSize() const
+{
+	qint64 size = sizeof(BatchEditCommand) + oldValues.byteSize() + newValues.byteSize();
+	for ( const ItemPath & p : itemPaths )
+		size += sizeof(ItemPath) + p.rows.count() * sizeof(int);
+	for ( const ItemPath & p : arrayPaths )
+		size += sizeof(ItemPath) + p.rows.count() * sizeof(int);
+
+	return size;
+}
+
+void BatchEditCommand::release()
+{
+	oldValues = NifModel::Edits();
+	newValues = NifModel::Edits();
+	itemPaths.clear();
+	arrayPaths.clear();
+
+	if ( !released )
+		setText( QApplication::translate( "BatchEditCommand", "%1 (released)" ).arg( text() ) );
+
+	released = true;
+
+#if QT_VERSION >= 0x050900
+	// The stack deletes the command once undo or redo reaches it
+	setObsolete( true );
+#endif
+}
+
+
 /*
  *  ToggleCheckBoxListCommand
  */
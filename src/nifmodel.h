@@ -36,7 +36,9 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "basemodel.h" // Inherited
 
 #include <QHash>
+#include <QMutex>
 #include <QReadWriteLock>
+#include <QSet>
 #include <QStack>
 #include <QStringList>
 #include <QUndoCommand>
@@ -46,10 +48,49 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 class SpellBook;
+class XmlCache;
 
 using NifBlockPtr = std::shared_ptr<NifBlock>;
 using SpellBookPtr = std::shared_ptr<SpellBook>;
 
+//! The header values which decide the fields present in a file
+struct NifVersionKey
+{
+	//! Version from the header string
+	quint32 version;
+	//! Header field values used by vercond
+	quint32 fileVersion;
+	quint32 userVersion;
+	quint32 userVersion2;
+
+	bool operator==( const NifVersionKey & other ) const
+	{
+		return version == other.version && fileVersion == other.fileVersion
+			&& userVersion == other.userVersion && userVersion2 == other.userVersion2;
+	}
+};
+
+inline uint qHash( const NifVersionKey & key )
+{
+	return ( ( key.version * 31 + key.fileVersion ) * 31 + key.userVersion ) * 31 + key.userVersion2;
+}
+
+//! Block and compound templates with the fields of other versions removed
+struct NifVersionTemplates
+{
+	//! The version the templates were pruned for
+	NifVersionKey key;
+
+	QHash<QString, NifBlockPtr> compounds;
+	QHash<QString, NifBlockPtr> blocks;
+
+	//! Blocks built once from the templates, which new blocks of the type are copied from
+	mutable QHash<QString, std::shared_ptr<const NifItem>> prototypes;
+	mutable QMutex prototypesLock;
+};
+
+using NifVersionTemplatesPtr = std::shared_ptr<const NifVersionTemplates>;
+
 //! @file nifmodel.h NifModel, NifModelEval, ChangeValueCommand, ToggleCheckBoxListCommand
 
 //! The main data model for the NIF file.
@@ -60,6 +101,9 @@ class NifModel final : public BaseModel
 	friend class NifXmlHandler;
 	friend class NifModelEval;
 	friend class NifOStream;
+	friend class NifBlockDecoder;
+	friend class NifTransaction;
+	friend class BatchEditCommand;
 
 public:
 	NifModel( QObject * parent = 0 );
@@ -76,12 +120,17 @@ public:
 	bool setData( const QModelIndex & index, const QVariant & value, int role = Qt::EditRole ) override final;
 	bool removeRows( int row, int count, const QModelIndex & parent ) override final;
 
+	QModelIndex index( int row, int column, const QModelIndex & parent = QModelIndex() ) const override final;
+	int rowCount( const QModelIndex & parent = QModelIndex() ) const override final;
+	bool hasChildren( const QModelIndex & parent = QModelIndex() ) const override final;
+
 	// end QAbstractItemModel
 
 	// BaseModel
 	
 	void clear() override final;
 	bool load( QIODevice & device ) override final;
+	bool load( const QByteArray & data ) override final;
 	bool save( QIODevice & device ) const override final;
 
 	QString getVersion() const override final { return version2string( version ); }
@@ -93,6 +142,9 @@ public:
 	template <typename T> T get( const QModelIndex & parent, const QString & name ) const;
 	template <typename T> bool set( const QModelIndex & parent, const QString & name, const T & v );
 
+	template <typename T> T get( const QModelIndex & parent, NifAtom name ) const;
+	template <typename T> bool set( const QModelIndex & parent, NifAtom name, const T & v );
+
 	// end BaseModel
 
 	//! Load from QIODevice and index
@@ -110,6 +162,8 @@ public:
 	//! Invalidate only the conditions of the items dependent on this item
 	void invalidateDependentConditions( NifItem * item );
 	void invalidateDependentConditions( const QModelIndex & index );
+	//! Times repeated evaluation of all conditions per block type and returns a report
+	QString benchmarkConditions( int passes = 100 );
 
 	//! Loads a model and maps links
 	bool loadAndMapLinks( QIODevice & device, const QModelIndex &, const QMap<qint32, qint32> & map );
@@ -118,6 +172,10 @@ public:
 
 	//! Returns the the estimated file offset of the model index
 	int fileOffset( const QModelIndex & ) const;
+	//! Returns the deepest item whose estimated bytes in the file hold the offset
+	QModelIndex indexAtOffset( int offset ) const;
+	//! Returns the estimated file offset of each root item, followed by the file size
+	QVector<int> rootItemOffsets() const;
 
 	//! Returns the estimated file size of the model index
 	int blockSize( const QModelIndex & ) const;
@@ -149,6 +207,13 @@ public:
 	//! Set delayed updating of model links
 	bool holdUpdates( bool value );
 
+	//! Open a transaction, see NifTransaction
+	void beginTransaction();
+	//! Close a transaction; closing the outermost applies what was deferred and records one undo command named text
+	void endTransaction( const QString & text = QString() );
+	//! Restore the values changed since the outermost transaction opened, unless rows were removed meanwhile
+	void rollbackTransaction();
+
 	//! Insert or append ( row == -1 ) a new NiBlock
 	QModelIndex insertNiBlock( const QString & identifier, int row = -1 );
 	//! Remove a block from the list
@@ -274,11 +339,28 @@ public:
 	bool assignString( const QModelIndex & index, const QString & string, bool replace = false );
 	bool assignString( const QModelIndex & index, const QString & name, const QString & string, bool replace = false );
 
+	//! Returns the header string at an index, for 20.1.0.3 and later
+	QString headerString( int idx ) const;
+	//! Returns the index of a header string, or -1 if the header has none such
+	int lookupString( const QString & string ) const;
+	//! Returns the index of a header string, appending it to the header if it is new
+	int internString( const QString & string );
+	/*! Removes the header strings which no block refers to and merges duplicates
+	 *
+	 * The strings in keep are kept even if they are unused. The indices in all
+	 * blocks are renumbered in one pass.
+	 *
+	 * @return The removed strings
+	 */
+	QStringList compactStrings( const QStringList & keep = QStringList() );
+
 	//! Create and return delegate for SpellBook
 	static QAbstractItemDelegate * createDelegate( QObject * parent, SpellBookPtr book );
 
 	//! Undo Stack for changes to NifModel
-	QUndoStack * undoStack;
+	QUndoStack * undoStack = nullptr;
+	//! The memory held by the values of the batch edit commands on the undo stack
+	qint64 undoMemory() const;
 
 public slots:
 	void updateSettings();
@@ -292,6 +374,8 @@ protected:
 	// BaseModel
 
 	NifItem * getItem( NifItem * parent, const QString & name ) const override final;
+	NifItem * getItem( NifItem * parent, NifAtom name ) const override final;
+	NifItem * getItem( NifItem * parent, const Expression::Field & field ) const override final;
 
 	bool setItemValue( NifItem * item, const NifValue & v ) override final;
 
@@ -308,13 +392,35 @@ protected:
 	template <typename T> T get( NifItem * item ) const;
 	template <typename T> bool set( NifItem * parent, const QString & name, const T & d );
 	template <typename T> bool set( NifItem * item, const T & d );
+	template <typename T> T get( NifItem * parent, NifAtom name ) const;
+	template <typename T> bool set( NifItem * parent, NifAtom name, const T & d );
 
 	// end BaseModel
 
+	bool load( NifIStream & stream );
 	bool loadItem( NifItem * parent, NifIStream & stream );
+	//! Whether the array has only leaf elements of a fixed size type, which are streamed in one pass
+	bool isFixedSizeArray( NifItem * array ) const;
 	bool loadHeader( NifItem * parent, NifIStream & stream );
 	bool saveItem( NifItem * parent, NifOStream & stream ) const;
 	bool fileOffset( NifItem * parent, NifItem * target, NifSStream & stream, int & ofs ) const;
+	//! Find the deepest item holding the offset within parent, which starts at ofs
+	NifItem * itemAtOffset( NifItem * parent, int offset, NifSStream & stream, int & ofs ) const;
+
+	//! The number of bytes preceding the item in row c of the root, e.g. the block type in older versions
+	int rootPrefix( int c ) const;
+	//! The size of an item in row c of the root, from rootSizes if it is known
+	int rootSize( NifItem * item, NifSStream & stream ) const;
+	//! Compute rootOffsets unless it is up to date
+	void updateOffsets() const;
+	//! The text of the value of an item in the value column, from displayStrings if it is current
+	QString displayString( const NifItem * item ) const;
+
+	//! Hash the header strings unless the table is up to date
+	void updateStringTable() const;
+	//! Collect the values which index the header strings, as their item and the row of a packed element or -1
+	void collectStringIndices( NifItem * parent, QVector<QPair<NifItem *, int>> & refs ) const;
+	void invalidateSize( const NifItem * item ) override final;
 
 	NifItem * getHeaderItem() const;
 	NifItem * getFooterItem() const;
@@ -325,13 +431,26 @@ protected:
 
 	void insertAncestor( NifItem * parent, const QString & identifier, int row = -1 );
 	void insertType( NifItem * parent, const NifData & data, int row = -1 );
+	//! Insert the fields of a block, copying them from its prototype when the templates are pruned
+	void insertBlockTypes( NifItem * branch, const NifBlockPtr & block );
+	//! Get the prototype of a block type, building it on first use
+	std::shared_ptr<const NifItem> blockPrototype( const NifBlockPtr & block );
 	NifItem * insertBranch( NifItem * parent, const NifData & data, int row = -1 );
 
 	bool updateByteArrayItem( NifItem * array );
 	bool updateArrays( NifItem * parent );
 
+	//! Update the links of a block, or of all blocks if -1
 	void updateLinks( int block = -1 );
 	void updateLinks( int block, NifItem * parent );
+	//! Collect the links of a block again and apply the difference to the reverse index and the roots
+	void updateBlockLinks( int block );
+	//! Remove duplicate links, keeping the first of each
+	static void uniqueLinks( QList<int> & links );
+	void addReferrer( int block, int referrer );
+	void removeReferrer( int block, int referrer );
+	//! Find the blocks nothing links to
+	void updateRootLinks();
 	void checkLinks( int block, QStack<int> & parents );
 	void adjustLinks( NifItem * parent, int block, int delta );
 	void mapLinks( NifItem * parent, const QMap<qint32, qint32> & map );
@@ -345,6 +464,59 @@ protected:
 	QHash<int, QList<int> > childLinks;
 	QHash<int, QList<int> > parentLinks;
 	QList<int> rootLinks;
+	//! The blocks with a child link to each block, in block order
+	QHash<int, QList<int> > referrers;
+	//! Whether a link was left out of childLinks to break a cycle; removing another link may restore it
+	bool droppedCycles = false;
+	//! The blocks whose links changed while updates were held, -1 for all
+	QSet<int> pendingLinks;
+
+	//! The size in the file of the header, the blocks and the footer, if it is known
+	mutable QHash<const NifItem *, int> rootSizes;
+	//! The file offset of each row of the root and the file size at the end, empty if it must be recomputed
+	mutable QVector<int> rootOffsets;
+
+	//! The header strings of 20.1.0.3 and later, hashed
+	struct StringTable
+	{
+		//! The Strings array of the header
+		const NifItem * array = nullptr;
+		//! The first index of each string
+		QHash<QString, int> index;
+		//! Whether the hash follows the array, else it is rebuilt by the next lookup
+		bool valid = false;
+	};
+	mutable StringTable stringTable;
+
+	//! The text of a value as it was displayed
+	struct DisplayString
+	{
+		NifValue value;
+		QString type;
+		QString text;
+	};
+	//! The displayed text of values stored inline, used while the value and type of the item are unchanged
+	mutable QHash<const NifItem *, DisplayString> displayStrings;
+
+	//! Set recorded values in a transaction of its own
+	void applyEdits( const Edits & values );
+	/*! Release the values of the oldest batch edit commands while the undo stack holds too much memory
+	 *
+	 * Called whenever a batch edit is pushed. QUndoStack can only drop commands past
+	 * an undo limit set while it is empty, so the released commands stay on the stack
+	 * and are removed from it once undo reaches them.
+	 */
+	void limitUndoMemory();
+	void flushEdits() override final;
+
+	//! Items whose dependent conditions are reevaluated when the transaction ends
+	QSet<NifItem *> conditionEdits;
+	//! The parents of the items in conditionEdits, the conditions below them are stale
+	QSet<NifItem *> conditionParents;
+	//! Reevaluate the conditions which depend on the values set in the transaction so far
+	void flushConditions();
+	//! Whether updates were held before the outermost transaction opened
+	bool transactionHeld = false;
 
 	bool lockUpdates;
 
@@ -360,8 +532,51 @@ protected:
 
 	void updateModel( UpdateType value = utAll );
 
+	//! Insert the fields of a block loaded lazily and read them from its stored bytes
+	bool parseBlock( NifItem * block ) const;
+	//! Parse every block that has not been accessed yet
+	void parseAllBlocks() const;
+	//! Decode the stored blocks on a thread pool and splice them in order, see "Parallel Load Blocks"
+	void decodeBlocks( const QByteArray & header );
+	//! Report a block which failed to load or did not end where its stored size says
+	void reportBlockLoad( int block, const QString & type, bool ok, qint64 pos, qint64 size ) const;
+
+	//! The stored bytes of the blocks which have not been parsed yet, see "Lazy Load Blocks"
+	mutable QHash<NifItem *, QByteArray> unparsedBlocks;
+	//! Whether a linksChanged() signal is queued for blocks parsed on access
+	mutable bool linksChangePending = false;
+
 	//! Parse the XML file using a NifXmlHandler
 	static QString parseXmlDescription( const QString & filename );
+	//! Load the schema from the binary snapshot of the XML file, see "Use XML Cache"
+	static bool loadXmlCache( XmlCache & cache );
+	//! Store the schema parsed from the XML file in its binary snapshot
+	static void saveXmlCache( XmlCache & cache );
+	//! Index the field rows of the templates and resolve the fields referenced by their expressions
+	static void indexTemplates( QHash<QString, NifBlockPtr> & compounds, QHash<QString, NifBlockPtr> & blocks );
+
+	//! Get the header values which decide the fields present in the file
+	NifVersionKey versionKey( NifItem * header ) const;
+	//! Get the templates pruned for the version in the header, building them on first use
+	NifVersionTemplatesPtr versionTemplates( NifItem * header ) const;
+	//! Insert the fields of the other versions into the items built from pruned templates and drop them
+	void unpruneTemplates();
+	//! Restore the full layout of the children of an item built from a pruned template
+	void unpruneItem( NifItem * item, const QList<NifData> & types, const NifVersionKey & key, int & row, bool pruned );
+	//! Restore the full layout below an item, see unpruneTemplates()
+	void unpruneChildren( NifItem * item, const NifVersionKey & key );
+	//! Drop the cached version templates
+	static void clearVersionTemplates();
+	//! Get the template of a block, pruned for the loaded version if available
+	NifBlockPtr blockTemplate( const QString & id ) const;
+	//! Get the template of a compound, pruned for the loaded version if available
+	NifBlockPtr compoundTemplate( const QString & type ) const;
+
+	//! Templates pruned for the loaded version, or null to use the full XML templates
+	NifVersionTemplatesPtr templates;
+
+	static QMutex versionTemplatesLock;
+	static QHash<NifVersionKey, NifVersionTemplatesPtr> versionTemplateCache;
 
 	// XML structures
 	static QList<quint32> supportedVersions;
@@ -385,13 +600,93 @@ class NifModelEval
 public:
 	NifModelEval( const NifModel * model, const NifItem * item );
 
-	QVariant operator()( const QVariant & v ) const;
+	quint32 operator()( const Expression::Field & field ) const;
 private:
 	const NifModel * model;
 	const NifItem * item;
 };
 
 
+/*! Groups edits to a NifModel
+ *
+ * While a transaction is open the model defers link, header and footer updates,
+ * the reevaluation of dependent conditions and dataChanged(). The outermost
+ * transaction applies them once when it is committed, with one dataChanged() per
+ * contiguous range of changed rows. If it has a text, the changed values are
+ * pushed to the undo stack as one command.
+ *
+ * Removing rows applies what was deferred so far and leaves nothing to undo.
+ */
+class NifTransaction final
+{
+public:
+	NifTransaction( NifModel * nif, const QString & text = QString() );
+	~NifTransaction();
+
+	NifTransaction( const NifTransaction & ) = delete;
+	NifTransaction & operator=( const NifTransaction & ) = delete;
+
+	//! Apply the deferred updates and close the transaction
+	void commit();
+	//! Restore the changed values and close the transaction
+	void rollback();
+
+private:
+	NifModel * nif;
+	QString text;
+	bool open = true;
+};
+
+
+//! Undoes the values changed by a NifTransaction
+class BatchEditCommand : public QUndoCommand
+{
+public:
+	BatchEditCommand( const QString & text, const NifModel::Edits & before, NifModel * model );
+	void redo() override;
+	void undo() override;
+
+	//! The memory held by the recorded values
+	qint64 byteSize() const;
+	//! Whether the values were released, the command does nothing from then on
+	bool isReleased() const { return released; }
+	/*! Release the values, e.g. to limit the memory of the undo stack
+	 *
+	 * On Qt 5.9 and later the stack removes the command once undo or redo reaches it.
+	 * Before, it stays and does nothing, so the older commands can still be reached.
+	 */
+	void release();
+private:
+	//! Where a recorded item is found again, rows may have been inserted or removed elsewhere since
+	struct ItemPath
+	{
+		//! The item of the root holding it, e.g. its block, looked up among the current root items
+		const NifItem * block;
+		//! The rows from the block down to the item
+		QVector<int> rows;
+		//! The name of the item, checked when it is found again
+		NifAtom name;
+	};
+
+	//! Record where an item is
+	ItemPath path( const NifItem * item ) const;
+	//! Find the recorded items and arrays again; false if one of them is gone or no longer matches
+	bool resolve( NifModel::Edits & values ) const;
+
+	NifModel * nif;
+	//! The changed values, and only the differing elements of each array
+	NifModel::Edits oldValues, newValues;
+	//! Where each recorded item and array is
+	QVector<ItemPath> itemPaths, arrayPaths;
+	//! The values are already set when the command is pushed
+	bool done = true;
+	//! The values were released, or the recorded items could not be found again
+	bool released = false;
+	//! The reset count of the model when the values were recorded
+	quint32 resets;
+};
+
+
 class ChangeValueCommand : public QUndoCommand
 {
 public:
@@ -547,6 +842,32 @@ template <typename T> inline bool NifModel::set( NifItem * parent, const QString
 	return result;
 }
 
+template <typename T> inline T NifModel::get( NifItem * parent, NifAtom name ) const
+{
+	return BaseModel::get<T>( parent, name );
+}
+
+template <typename T> inline T NifModel::get( const QModelIndex & parent, NifAtom name ) const
+{
+	return BaseModel::get<T>( parent, name );
+}
+
+template <typename T> inline bool NifModel::set( const QModelIndex & parent, NifAtom name, const T & d )
+{
+	bool result = BaseModel::set<T>( parent, name, d );
+	if ( result )
+		invalidateDependentConditions( getIndex( parent, name ) );
+	return result;
+}
+
+template <typename T> inline bool NifModel::set( NifItem * parent, NifAtom name, const T & d )
+{
+	bool result = BaseModel::set<T>( parent, name, d );
+	if ( result )
+		invalidateDependentConditions( getItem( parent, name ) );
+	return result;
+}
+
 template <> inline QString NifModel::get( const QModelIndex & index ) const
 {
 	return this->string( index );
@@ -565,6 +886,11 @@ template <> inline QString NifModel::get( const QModelIndex & parent, const QStr
 	return this->string( parent, name );
 }
 
+template <> inline QString NifModel::get( const QModelIndex & parent, NifAtom name ) const
+{
+	return this->string( getIndex( parent, name ) );
+}
+
 template <> inline bool NifModel::set( const QModelIndex & index, const QString & d )
 {
 	return this->assignString( index, d );
@@ -579,6 +905,11 @@ template <> inline bool NifModel::set( const QModelIndex & parent, const QString
 	return this->assignString( parent, name, d );
 }
 
+template <> inline bool NifModel::set( const QModelIndex & parent, NifAtom name, const QString & d )
+{
+	return this->assignString( getIndex( parent, name ), d );
+}
+
 //template <> inline bool NifModel::set( NifItem * parent, const QString & name, const QString & d ) {
 //	return this->assignString(parent, name, d);
 //}
@@ -65,13 +65,13 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QMessageBox>
 #include <QProgressBar>
 #include <QSettings>
+#include <QThread>
 #include <QTimer>
 #include <QToolBar>
 #include <QToolButton>
 #include <QTranslator>
 #include <QUdpSocket>
 #include <QUrl>
-#include <QCryptographicHash>
 
 #include <QListView>
 #include <QTreeView>
@@ -80,6 +80,11 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fsengine/bsa.h>
 #include <fsengine/fsmanager.h>
 
+#include "xxhash.h"
+
+#include <algorithm>
+#include <cstring>
+
 #ifdef WIN32
 #  define WINDOWS_LEAN_AND_MEAN
 #  include "windows.h"
@@ -721,43 +726,202 @@ void NifSkope::updateRecentArchiveFileActions()
 	mRecentArchiveFiles->setEnabled( numRecentFiles > 0 );
 }
 
-QByteArray fileChecksum( const QString &fileName, QCryptographicHash::Algorithm hashAlgorithm )
+//! A write-only device which hashes the saved bytes of each root item instead of storing them
+class RoundTripSink final : public QIODevice
 {
-	QFile f( fileName );
-	if ( f.open( QFile::ReadOnly ) ) {
-		QCryptographicHash hash( hashAlgorithm );
-		if ( hash.addData( &f ) ) {
-			return hash.result();
+public:
+	//! The offsets are the estimated start of each root item followed by the file size
+	RoundTripSink( const QVector<int> & offsets )
+		: offsets( offsets )
+	{
+		XXH64_reset( &state, 0 );
+		open( QIODevice::WriteOnly );
+	}
+
+	//! Finish the hash of the last root item and of the bytes past the estimated file size
+	void finish()
+	{
+		while ( hashes.count() < offsets.count() )
+			nextSegment();
+	}
+
+	//! The offsets the bytes were split at
+	QVector<int> offsets;
+	//! The XXH64 of each root item's bytes, and of the bytes after them
+	QVector<quint64> hashes;
+	//! The number of bytes in each hash
+	QVector<qint64> sizes;
+
+protected:
+	qint64 readData( char *, qint64 ) override final { return -1; }
+
+	qint64 writeData( const char * data, qint64 len ) override final
+	{
+		qint64 left = len;
+		while ( left > 0 ) {
+			// Bytes past the estimated file size are hashed as one segment
+			qint64 end = ( segment + 1 < offsets.count() ) ? offsets.at( segment + 1 ) : written + left;
+			qint64 n = std::min( left, std::max<qint64>( end - written, 0 ) );
+
+			XXH64_update( &state, data, size_t( n ) );
+			data += n;
+			left -= n;
+			written += n;
+
+			if ( left > 0 )
+				nextSegment();
 		}
+
+		return len;
 	}
-	return QByteArray();
-}
 
-void NifSkope::checkFile( QFileInfo fInfo, QByteArray filehash )
+private:
+	void nextSegment()
+	{
+		hashes.append( XXH64_digest( &state ) );
+		sizes.append( written - start );
+		XXH64_reset( &state, 0 );
+		start = written;
+		segment++;
+	}
+
+	XXH64_state_t state;
+	//! The root item being hashed
+	int segment = 0;
+	//! The offset where its bytes started
+	qint64 start = 0;
+	qint64 written = 0;
+};
+
+//! Compares the hashes of the saved root items against the original file away from the GUI thread
+class RoundTripCheck final : public QThread
 {
-	QString fname = fInfo.fileName();
-	QString fpath = fInfo.filePath();
-	QDir::temp().mkdir( "NifSkope" );
-	QString tmpDir = QDir::tempPath() + "/NifSkope";
-	QDir tmp( tmpDir );
-	QString tmpFile = tmpDir + "/" + fInfo.fileName();
+public:
+	RoundTripCheck( const QString & path, const QByteArray & original, const RoundTripSink & sink )
+		: path( path ), original( original ), offsets( sink.offsets ), hashes( sink.hashes ), sizes( sink.sizes )
+	{
+	}
 
-	emit beginSave();
-	bool saved = nif->saveToFile( tmpFile );
-	if ( saved ) {
-		auto filehash2 = fileChecksum( tmpFile, QCryptographicHash::Md5 );
+	QString path;
+	//! The original bytes; when empty they are read from path
+	QByteArray original;
+	QVector<int> offsets;
+	QVector<quint64> hashes;
+	QVector<qint64> sizes;
+
+	//! False if the original file could not be read
+	bool readable = true;
+	//! The root item whose bytes differ first, offsets.count() - 1 past the last one, or -1 if the saved file is identical
+	int segment = -1;
+	//! The offset of that segment in the original file
+	qint64 start = 0;
+	//! The original bytes of that segment
+	QByteArray slice;
+	//! True if the model changed after it was saved
+	bool modified = false;
+
+protected:
+	void run() override final
+	{
+		QFile f( path );
+		const char * orig = original.constData();
+		qint64 size = original.size();
+
+		if ( original.isEmpty() ) {
+			if ( !f.open( QIODevice::ReadOnly ) ) {
+				readable = false;
+				return;
+			}
 
-		if ( filehash == filehash2 ) {
-			tmp.remove( fname );
-		} else {
-			QString err = "An MD5 hash comparison indicates this file will not be 100% identical upon saving. This could indicate underlying issues with the data in this file.";
-			Message::warning( this, err, fpath );
-#ifdef QT_NO_DEBUG
-			tmp.remove( fname );
-#endif
+			size = f.size();
+			orig = reinterpret_cast<const char *>( f.map( 0, size ) );
+			if ( !orig ) {
+				original = f.readAll();
+				orig = original.constData();
+			}
+		}
+
+		// Split the original at the same offsets as the saved bytes
+		for ( int s = 0; s < hashes.count(); s++ ) {
+			qint64 end = ( s + 1 < offsets.count() ) ? std::min<qint64>( offsets.at( s + 1 ), size ) : size;
+			qint64 len = std::max<qint64>( end - start, 0 );
+
+			if ( len != sizes.at( s ) || XXH64( orig + start, size_t( len ), 0 ) != hashes.at( s ) ) {
+				segment = s;
+				if ( s + 1 < offsets.count() )
+					slice = QByteArray( orig + start, int( len ) );
+				return;
+			}
+
+			start += len;
 		}
 	}
-	emit completeSave( saved, fpath );
+};
+
+void NifSkope::checkFile( const QString & path, const QByteArray & original )
+{
+	// Take the root item offsets now, the model may be edited before the check finishes.
+	// Blocks which are not parsed yet count with the size they were read with.
+	QVector<int> offsets = nif->rootItemOffsets();
+	QStringList names;
+	for ( int r = 0; r < nif->rowCount(); r++ )
+		names << nif->index( r, NifModel::NameCol ).data().toString();
+
+	// Saving parses every block on the GUI thread
+	RoundTripSink sink( offsets );
+	if ( !nif->save( sink ) )
+		return;
+
+	sink.finish();
+
+	auto check = new RoundTripCheck( path, original, sink );
+
+	// The mismatching root item is saved again to find the exact offset, which needs the same model
+	auto modified = [check]() { check->modified = true; };
+	connect( nif, &NifModel::dataChanged, check, modified );
+	connect( nif, &NifModel::rowsInserted, check, modified );
+	connect( nif, &NifModel::rowsRemoved, check, modified );
+	connect( nif, &NifModel::modelReset, check, modified );
+
+	connect( check, &QThread::finished, this, [this, check, names]() {
+		check->deleteLater();
+		if ( !check->readable ) {
+			qCWarning( nsIo ) << tr( "Could not read %1 to verify it" ).arg( check->path );
+			return;
+		}
+
+		int row = check->segment;
+		if ( row < 0 )
+			return;
+
+		QString where;
+		if ( row >= names.count() )
+			where = tr( "The file size differs" );
+		else if ( row == 0 || row == names.count() - 1 )
+			where = tr( "The first difference is in the %1" ).arg( names.at( row ) );
+		else
+			where = tr( "The first difference is in block %1 (%2)" ).arg( row - 1 ).arg( names.at( row ) );
+
+		// The segment holds the root item followed by the prefix of the next one
+		qint64 offset = check->start;
+		if ( row < names.count() && !check->modified ) {
+			QBuffer saved;
+			saved.open( QIODevice::WriteOnly );
+			if ( nif->saveIndex( saved, nif->index( row, 0 ) ) ) {
+				const QByteArray & bytes = saved.data();
+				int n = std::min( bytes.size(), check->slice.size() );
+				auto diff = std::mismatch( bytes.constBegin(), bytes.constBegin() + n, check->slice.constBegin() );
+				offset += diff.first - bytes.constBegin();
+			}
+		}
+
+		where += tr( ", at offset 0x%1" ).arg( offset, 0, 16 );
+
+		QString err = tr( "A hash comparison indicates this file will not be 100% identical upon saving. This could indicate underlying issues with the data in this file." );
+		Message::warning( this, err, QString( "%1\n%2" ).arg( check->path, where ) );
+	} );
+
+	check->start( QThread::LowPriority );
 }
 
 void NifSkope::openArchive( const QString & archive )
@@ -863,30 +1027,18 @@ void NifSkope::openArchiveFileString( BSA * bsa, const QString & filepath )
 		// Format like "BSANAME.BSA/path/to/file.nif"
 		QString path = bsa->name() + "/" + filepath;
 
-		QBuffer buf;
-		buf.setData( data );
-		if ( buf.open( QBuffer::ReadOnly ) ) {
+		emit beginLoading();
 
-			emit beginLoading();
+		// Decode directly from the extracted data
+		bool loaded = nif->load( data );
+		if ( loaded )
+			setCurrentFile( path );
 
-			bool loaded = nif->load( buf );
-			if ( loaded )
-				setCurrentFile( path );
+		emit completeLoading( loaded, path );
 
-			emit completeLoading( loaded, path );
-
-			//if ( loaded ) {
-			//	QCryptographicHash hash( QCryptographicHash::Md5 );
-			//	hash.addData( data );
-			//	filehash = hash.result();
-			//
-			//	QFileInfo f( path );
-			//	
-			//	checkFile( f, filehash );
-			//}
-
-			buf.close();
-		}
+		// Off by default, saving parses the blocks left for later on the GUI thread
+		if ( loaded && QSettings().value( "Verify Round Trip", false ).toBool() )
+			checkFile( path, data );
 	}
 }
 
@@ -979,11 +1131,9 @@ void NifSkope::load()
 
 	emit completeLoading( loaded, fname );
 
-	//if ( loaded ) {
-	//	filehash = fileChecksum( fname, QCryptographicHash::Md5 );
-	//
-	//	checkFile( f, filehash );
-	//}
+	// Off by default, saving parses the blocks left for later on the GUI thread
+	if ( loaded && QSettings().value( "Verify Round Trip", false ).toBool() )
+		checkFile( fname );
 }
 
 void NifSkope::save()
@@ -1251,6 +1401,8 @@ QCoreApplication * createApplication( int &argc, char *argv[] )
  *  main
  */
 
+#ifndef NIF_BENCH
+
 //! The main program
 int main( int argc, char * argv[] )
 {
@@ -1368,6 +1520,8 @@ int main( int argc, char * argv[] )
 	return 0;
 }
 
+#endif
+
 
 void NifSkope::migrateSettings() const
 {
@@ -256,7 +256,14 @@ private:
 
 	void loadFile( const QString & );
 	void saveFile( const QString & );
-	void checkFile( QFileInfo fInfo, QByteArray filehash );
+	/*! Hashes the saved NIF and compares it to the original file in the background
+	 *
+	 * Enabled by the hidden "Verify Round Trip" setting. The save itself runs on the
+	 * GUI thread and parses every block which was left for later, which costs about
+	 * as much as loading the whole file up front. When the hashes differ, the first
+	 * mismatching root item is saved again to report the first differing byte.
+	 */
+	void checkFile( const QString & path, const QByteArray & original = QByteArray() );
 
 	void openRecentFile();
 	void setCurrentFile( const QString & );
@@ -289,8 +296,6 @@ private:
 	QString currentFile;
 	BSA * currentArchive = nullptr;
 
-	QByteArray filehash;
-
 	//! Stores the NIF file in memory.
 	NifModel * nif;
 	//! A hierarchical proxy for the NIF file.
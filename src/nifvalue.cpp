@@ -40,6 +40,10 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QIODevice>
 #include <QSettings>
 
+#include <algorithm>
+#include <cstring>
+#include <new>
+
 
 //! @file nifvalue.cpp NifValue, NifIStream, NifOStream, NifSStream
 
@@ -48,6 +52,11 @@ QHash<QString, QString>               NifValue::typeTxt;
 QHash<QString, NifValue::EnumOptions> NifValue::enumMap;
 QHash<QString, QString>               NifValue::aliasMap;
 
+#ifdef NIF_BENCH
+QAtomicInteger<qint64> NifValue::heapAllocations;
+QAtomicInteger<qint64> NifValue::inlineAllocations;
+#endif
+
 /*
  *  NifValue
  */
@@ -132,6 +141,56 @@ NifValue::Type NifValue::type( const QString & id )
 	return typeMap.value( id, tNone );
 }
 
+//! Size on disk of a value of a fixed size type, or 0 if the size depends on the value
+static int fixedSize( NifValue::Type t, bool bool32bit )
+{
+	switch ( t ) {
+	case NifValue::tBool:
+		return bool32bit ? 4 : 1;
+	case NifValue::tByte:
+		return 1;
+	case NifValue::tWord:
+	case NifValue::tShort:
+	case NifValue::tFlags:
+	case NifValue::tBlockTypeIndex:
+	case NifValue::tHfloat:
+		return 2;
+	case NifValue::tStringOffset:
+	case NifValue::tStringIndex:
+	case NifValue::tInt:
+	case NifValue::tUInt:
+	case NifValue::tULittle32:
+	case NifValue::tLink:
+	case NifValue::tUpLink:
+	case NifValue::tFloat:
+		return 4;
+	case NifValue::tByteVector3:
+		return 3;
+	case NifValue::tHalfVector2:
+	case NifValue::tByteColor4:
+		return 4;
+	case NifValue::tHalfVector3:
+	case NifValue::tTriangle:
+		return 6;
+	case NifValue::tVector2:
+		return 8;
+	case NifValue::tVector3:
+	case NifValue::tColor3:
+		return 12;
+	case NifValue::tVector4:
+	case NifValue::tQuat:
+	case NifValue::tColor4:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+bool NifValue::isFixedSize( Type t )
+{
+	return fixedSize( t, false ) > 0;
+}
+
 void NifValue::setTypeDescription( const QString & typId, const QString & txt )
 {
 	typeTxt[typId] = QString( txt ).replace( "<", "&lt;" ).replace( "\n", "<br/>" );
@@ -194,9 +253,22 @@ bool NifValue::registerEnumOption( const QString & eid, const QString & oid, qui
 		return false;
 
 	e[oval] = QPair<QString, QString>( oid, otxt );
+	enumMap[eid].indexName( oval, oid );
 	return true;
 }
 
+void NifValue::EnumOptions::indexName( quint32 oval, const QString & oid )
+{
+	// Larger values are looked up in the dictionary
+	if ( oval >= 1024 )
+		return;
+
+	if ( quint32( names.count() ) <= oval )
+		names.resize( oval + 1 );
+
+	names[oval] = oid;
+}
+
 QStringList NifValue::enumOptions( const QString & eid )
 {
 	QStringList opts;
@@ -222,6 +294,61 @@ bool NifValue::registerEnumType( const QString & eid, EnumType eTyp )
 	return true;
 }
 
+void NifValue::saveTypes( QDataStream & ds )
+{
+	ds << quint32( typeMap.count() );
+	for ( auto it = typeMap.cbegin(); it != typeMap.cend(); ++it )
+		ds << it.key() << quint32( it.value() );
+
+	ds << typeTxt << aliasMap;
+
+	ds << quint32( enumMap.count() );
+	for ( auto it = enumMap.cbegin(); it != enumMap.cend(); ++it )
+		ds << it.key() << quint32( it->t ) << it->o;
+}
+
+bool NifValue::loadTypes( QDataStream & ds )
+{
+	QHash<QString, Type> types;
+	QHash<QString, QString> txt;
+	QHash<QString, QString> aliases;
+	QHash<QString, EnumOptions> enums;
+
+	quint32 count = 0;
+	ds >> count;
+	for ( ; count > 0 && ds.status() == QDataStream::Ok; count-- ) {
+		QString id;
+		quint32 t;
+		ds >> id >> t;
+		types.insert( id, Type( t ) );
+	}
+
+	ds >> txt >> aliases;
+
+	ds >> count;
+	for ( ; count > 0 && ds.status() == QDataStream::Ok; count-- ) {
+		QString id;
+		quint32 t;
+		EnumOptions e;
+		ds >> id >> t >> e.o;
+		e.t = EnumType( t );
+
+		for ( auto it = e.o.cbegin(); it != e.o.cend(); ++it )
+			e.indexName( it.key(), it.value().first );
+
+		enums.insert( id, e );
+	}
+
+	if ( ds.status() != QDataStream::Ok )
+		return false;
+
+	typeMap = types;
+	typeTxt = txt;
+	aliasMap = aliases;
+	enumMap = enums;
+	return true;
+}
+
 NifValue::EnumType NifValue::enumType( const QString & eid )
 {
 	return (enumMap.contains( eid )) ? enumMap[eid].t : EnumType::eNone;
@@ -229,46 +356,49 @@ NifValue::EnumType NifValue::enumType( const QString & eid )
 
 QString NifValue::enumOptionName( const QString & eid, quint32 val )
 {
-	if ( enumMap.contains( eid ) ) {
-		NifValue::EnumOptions & eo = enumMap[eid];
-
-		if ( eo.t == NifValue::eFlags ) {
-			QString text;
-			quint32 val2 = 0;
-			QMapIterator<quint32, QPair<QString, QString> > it( eo.o );
+	auto it = enumMap.constFind( eid );
+	if ( it == enumMap.constEnd() )
+		return QString();
 
-			while ( it.hasNext() ) {
-				it.next();
+	const NifValue::EnumOptions & eo = it.value();
 
-				if ( val & ( 1 << it.key() ) ) {
-					val2 |= ( 1 << it.key() );
+	if ( eo.t == NifValue::eFlags ) {
+		QString text;
+		quint32 val2 = val;
 
-					if ( !text.isEmpty() )
-						text += " | ";
+		for ( int bit = 0; bit < qMin( eo.names.count(), 32 ) && val2; bit++ ) {
+			quint32 mask = 1u << bit;
 
-					text += it.value().first;
-				}
-			}
+			if ( ( val & mask ) && !eo.names.at( bit ).isEmpty() ) {
+				val2 &= ~mask;
 
-			val2 = (val & ~val2);
-
-			if ( val2 ) {
 				if ( !text.isEmpty() )
 					text += " | ";
 
-				text += QString::number( val2, 16 );
+				text += eo.names.at( bit );
 			}
+		}
 
-			return text;
-		} else if ( eo.t == NifValue::eDefault ) {
-			if ( eo.o.contains( val ) )
-				return eo.o.value( val ).first;
+		if ( val2 ) {
+			if ( !text.isEmpty() )
+				text += " | ";
+
+			text += QString::number( val2, 16 );
 		}
 
-		return QString::number( val );
+		return text;
+	} else if ( eo.t == NifValue::eDefault ) {
+		if ( val < quint32( eo.names.count() ) ) {
+			if ( !eo.names.at( val ).isEmpty() )
+				return eo.names.at( val );
+		} else {
+			auto o = eo.o.constFind( val );
+			if ( o != eo.o.constEnd() )
+				return o.value().first;
+		}
 	}
 
-	return QString();
+	return QString::number( val );
 }
 
 QString NifValue::enumOptionText( const QString & eid, quint32 val )
@@ -341,37 +471,18 @@ const NifValue::EnumOptions & NifValue::enumOptionData( const QString & eid )
 void NifValue::clear()
 {
 	switch ( typ ) {
-	case tVector4:
-		delete static_cast<Vector4 *>( val.data );
-		break;
-	case tVector3:
-	case tHalfVector3:
-	case tByteVector3:
-		delete static_cast<Vector3 *>( val.data );
-		break;
-	case tVector2:
-	case tHalfVector2:
-		delete static_cast<Vector2 *>( val.data );
-		break;
 	case tMatrix:
-		delete static_cast<Matrix *>( val.data );
+		delete ptr<Matrix>();
 		break;
 	case tMatrix4:
-		delete static_cast<Matrix4 *>( val.data );
-		break;
-	case tQuat:
-	case tQuatXYZW:
-		delete static_cast<Quat *>( val.data );
+		delete ptr<Matrix4>();
 		break;
 	case tByteMatrix:
-		delete static_cast<ByteMatrix *>( val.data );
+		delete ptr<ByteMatrix>();
 		break;
 	case tByteArray:
 	case tStringPalette:
-		delete static_cast<QByteArray *>( val.data );
-		break;
-	case tTriangle:
-		delete static_cast<Triangle *>( val.data );
+		delete ptr<QByteArray>();
 		break;
 	case tString:
 	case tSizedString:
@@ -380,24 +491,18 @@ void NifValue::clear()
 	case tHeaderString:
 	case tLineString:
 	case tChar8String:
-		delete static_cast<QString *>( val.data );
-		break;
-	case tColor3:
-		delete static_cast<Color3 *>( val.data );
-		break;
-	case tColor4:
-	case tByteColor4:
-		delete static_cast<Color4 *>( val.data );
+		delete ptr<QString>();
 		break;
 	case tBlob:
-		delete static_cast<QByteArray *>( val.data );
+		delete ptr<QByteArray>();
 		break;
 	default:
+		// Inline values have trivial destructors
 		break;
 	}
 
 	typ = tNone;
-	val.u32 = 0;
+	memset( &val, 0, sizeof(val) );
 }
 
 void NifValue::changeType( Type t )
@@ -416,27 +521,34 @@ void NifValue::changeType( Type t )
 	case tVector3:
 	case tHalfVector3:
 	case tByteVector3:
-		val.data = new Vector3();
-		break;
+		new ( &val ) Vector3();
+		NIFVALUE_COUNT( inlineAllocations );
+		return;
 	case tVector4:
-		val.data = new Vector4();
+		new ( &val ) Vector4();
+		NIFVALUE_COUNT( inlineAllocations );
 		return;
 	case tMatrix:
 		val.data = new Matrix();
+		NIFVALUE_COUNT( heapAllocations );
 		return;
 	case tMatrix4:
 		val.data = new Matrix4();
+		NIFVALUE_COUNT( heapAllocations );
 		return;
 	case tQuat:
 	case tQuatXYZW:
-		val.data = new Quat();
+		new ( &val ) Quat();
+		NIFVALUE_COUNT( inlineAllocations );
 		return;
 	case tVector2:
 	case tHalfVector2:
-		val.data = new Vector2();
+		new ( &val ) Vector2();
+		NIFVALUE_COUNT( inlineAllocations );
 		return;
 	case tTriangle:
-		val.data = new Triangle();
+		new ( &val ) Triangle();
+		NIFVALUE_COUNT( inlineAllocations );
 		return;
 	case tString:
 	case tSizedString:
@@ -446,20 +558,25 @@ void NifValue::changeType( Type t )
 	case tLineString:
 	case tChar8String:
 		val.data = new QString();
+		NIFVALUE_COUNT( heapAllocations );
 		return;
 	case tColor3:
-		val.data = new Color3();
+		new ( &val ) Color3();
+		NIFVALUE_COUNT( inlineAllocations );
 		return;
 	case tColor4:
 	case tByteColor4:
-		val.data = new Color4();
+		new ( &val ) Color4();
+		NIFVALUE_COUNT( inlineAllocations );
 		return;
 	case tByteArray:
 	case tStringPalette:
 		val.data = new QByteArray();
+		NIFVALUE_COUNT( heapAllocations );
 		return;
 	case tByteMatrix:
 		val.data = new ByteMatrix();
+		NIFVALUE_COUNT( heapAllocations );
 		return;
 	case tStringOffset:
 	case tStringIndex:
@@ -467,6 +584,7 @@ void NifValue::changeType( Type t )
 		return;
 	case tBlob:
 		val.data = new QByteArray();
+		NIFVALUE_COUNT( heapAllocations );
 		return;
 	default:
 		val.u32 = 0;
@@ -474,6 +592,73 @@ void NifValue::changeType( Type t )
 	}
 }
 
+#ifdef NIF_BENCH
+NifValue::AllocationStatistics NifValue::allocationStatistics()
+{
+	AllocationStatistics stats;
+	stats.heap = heapAllocations.load();
+	stats.inlined = inlineAllocations.load();
+	return stats;
+}
+#endif
+
+int NifValue::inlineSize( Type t )
+{
+	switch ( t ) {
+	case tBool:
+	case tByte:
+	case tWord:
+	case tFlags:
+	case tStringOffset:
+	case tStringIndex:
+	case tBlockTypeIndex:
+	case tInt:
+	case tShort:
+	case tULittle32:
+	case tUInt:
+	case tLink:
+	case tUpLink:
+	case tFloat:
+	case tHfloat:
+	case tFileVersion:
+		return sizeof(quint32);
+	case tVector3:
+	case tHalfVector3:
+	case tByteVector3:
+		return sizeof(Vector3);
+	case tVector4:
+		return sizeof(Vector4);
+	case tQuat:
+	case tQuatXYZW:
+		return sizeof(Quat);
+	case tVector2:
+	case tHalfVector2:
+		return sizeof(Vector2);
+	case tTriangle:
+		return sizeof(Triangle);
+	case tColor3:
+		return sizeof(Color3);
+	case tColor4:
+	case tByteColor4:
+		return sizeof(Color4);
+	default:
+		return 0;
+	}
+}
+
+void NifValue::storeInline( char * dst ) const
+{
+	memcpy( dst, &val, inlineSize( typ ) );
+}
+
+void NifValue::loadInline( Type t, const char * src )
+{
+	if ( typ != t )
+		changeType( t );
+
+	memcpy( &val, src, inlineSize( t ) );
+}
+
 void NifValue::operator=( const NifValue & other )
 {
 	if ( typ != other.typ )
@@ -483,24 +668,24 @@ void NifValue::operator=( const NifValue & other )
 	case tVector3:
 	case tHalfVector3:
 	case tByteVector3:
-		*static_cast<Vector3 *>( val.data ) = *static_cast<Vector3 *>( other.val.data );
+		*ptr<Vector3>() = *other.ptr<Vector3>();
 		return;
 	case tVector4:
-		*static_cast<Vector4 *>( val.data ) = *static_cast<Vector4 *>( other.val.data );
+		*ptr<Vector4>() = *other.ptr<Vector4>();
 		return;
 	case tMatrix:
-		*static_cast<Matrix *>( val.data ) = *static_cast<Matrix *>( other.val.data );
+		*ptr<Matrix>() = *other.ptr<Matrix>();
 		return;
 	case tMatrix4:
-		*static_cast<Matrix4 *>( val.data ) = *static_cast<Matrix4 *>( other.val.data );
+		*ptr<Matrix4>() = *other.ptr<Matrix4>();
 		return;
 	case tQuat:
 	case tQuatXYZW:
-		*static_cast<Quat *>( val.data ) = *static_cast<Quat *>( other.val.data );
+		*ptr<Quat>() = *other.ptr<Quat>();
 		return;
 	case tVector2:
 	case tHalfVector2:
-		*static_cast<Vector2 *>( val.data ) = *static_cast<Vector2 *>( other.val.data );
+		*ptr<Vector2>() = *other.ptr<Vector2>();
 		return;
 	case tString:
 	case tSizedString:
@@ -509,27 +694,27 @@ void NifValue::operator=( const NifValue & other )
 	case tHeaderString:
 	case tLineString:
 	case tChar8String:
-		*static_cast<QString *>( val.data ) = *static_cast<QString *>( other.val.data );
+		*ptr<QString>() = *other.ptr<QString>();
 		return;
 	case tColor3:
-		*static_cast<Color3 *>( val.data ) = *static_cast<Color3 *>( other.val.data );
+		*ptr<Color3>() = *other.ptr<Color3>();
 		return;
 	case tColor4:
 	case tByteColor4:
-		*static_cast<Color4 *>( val.data ) = *static_cast<Color4 *>( other.val.data );
+		*ptr<Color4>() = *other.ptr<Color4>();
 		return;
 	case tByteArray:
 	case tStringPalette:
-		*static_cast<QByteArray *>( val.data ) = *static_cast<QByteArray *>( other.val.data );
+		*ptr<QByteArray>() = *other.ptr<QByteArray>();
 		return;
 	case tByteMatrix:
-		*static_cast<ByteMatrix *>( val.data ) = *static_cast<ByteMatrix *>( other.val.data );
+		*ptr<ByteMatrix>() = *other.ptr<ByteMatrix>();
 		return;
 	case tTriangle:
-		*static_cast<Triangle *>( val.data ) = *static_cast<Triangle *>( other.val.data );
+		*ptr<Triangle>() = *other.ptr<Triangle>();
 		return;
 	case tBlob:
-		*static_cast<QByteArray *>( val.data ) = *static_cast<QByteArray *>( other.val.data );
+		*ptr<QByteArray>() = *other.ptr<QByteArray>();
 		return;
 	default:
 		val = other.val;
@@ -574,8 +759,8 @@ bool NifValue::operator==( const NifValue & other ) const
 	case tChar8String:
 	case tFilePath:
 	{
-		QString * s1 = static_cast<QString *>(val.data);
-		QString * s2 = static_cast<QString *>(other.val.data);
+		QString * s1 = ptr<QString>();
+		QString * s2 = other.ptr<QString>();
 
 		if ( !s1 || !s2 )
 			return false;
@@ -585,8 +770,8 @@ bool NifValue::operator==( const NifValue & other ) const
 
 	case tColor3:
 	{
-		Color3 * c1 = static_cast<Color3 *>(val.data);
-		Color3 * c2 = static_cast<Color3 *>(other.val.data);
+		Color3 * c1 = ptr<Color3>();
+		Color3 * c2 = other.ptr<Color3>();
 
 		if ( !c1 || !c2 )
 			return false;
@@ -597,8 +782,8 @@ bool NifValue::operator==( const NifValue & other ) const
 	case tColor4:
 	case tByteColor4:
 	{
-		Color4 * c1 = static_cast<Color4 *>(val.data);
-		Color4 * c2 = static_cast<Color4 *>(other.val.data);
+		Color4 * c1 = ptr<Color4>();
+		Color4 * c2 = other.ptr<Color4>();
 
 		if ( !c1 || !c2 )
 			return false;
@@ -609,8 +794,8 @@ bool NifValue::operator==( const NifValue & other ) const
 	case tVector2:
 	case tHalfVector2:
 	{
-		Vector2 * vec1 = static_cast<Vector2 *>(val.data);
-		Vector2 * vec2 = static_cast<Vector2 *>(other.val.data);
+		Vector2 * vec1 = ptr<Vector2>();
+		Vector2 * vec2 = other.ptr<Vector2>();
 
 		if ( !vec1 || !vec2 )
 			return false;
@@ -622,8 +807,8 @@ bool NifValue::operator==( const NifValue & other ) const
 	case tHalfVector3:
 	case tByteVector3:
 	{
-		Vector3 * vec1 = static_cast<Vector3 *>(val.data);
-		Vector3 * vec2 = static_cast<Vector3 *>(other.val.data);
+		Vector3 * vec1 = ptr<Vector3>();
+		Vector3 * vec2 = other.ptr<Vector3>();
 
 		if ( !vec1 || !vec2 )
 			return false;
@@ -633,8 +818,8 @@ bool NifValue::operator==( const NifValue & other ) const
 
 	case tVector4:
 	{
-		Vector4 * vec1 = static_cast<Vector4 *>(val.data);
-		Vector4 * vec2 = static_cast<Vector4 *>(other.val.data);
+		Vector4 * vec1 = ptr<Vector4>();
+		Vector4 * vec2 = other.ptr<Vector4>();
 
 		if ( !vec1 || !vec2 )
 			return false;
@@ -645,8 +830,8 @@ bool NifValue::operator==( const NifValue & other ) const
 	case tQuat:
 	case tQuatXYZW:
 	{
-		Quat * quat1 = static_cast<Quat *>(val.data);
-		Quat * quat2 = static_cast<Quat *>(other.val.data);
+		Quat * quat1 = ptr<Quat>();
+		Quat * quat2 = other.ptr<Quat>();
 
 		if ( !quat1 || !quat2 )
 			return false;
@@ -656,8 +841,8 @@ bool NifValue::operator==( const NifValue & other ) const
 
 	case tTriangle:
 	{
-		Triangle * tri1 = static_cast<Triangle *>(val.data);
-		Triangle * tri2 = static_cast<Triangle *>(other.val.data);
+		Triangle * tri1 = ptr<Triangle>();
+		Triangle * tri2 = other.ptr<Triangle>();
 
 		if ( !tri1 || !tri2 )
 			return false;
@@ -670,8 +855,8 @@ bool NifValue::operator==( const NifValue & other ) const
 	case tStringPalette:
 	case tBlob:
 	{
-		QByteArray * a1 = static_cast<QByteArray *>(val.data);
-		QByteArray * a2 = static_cast<QByteArray *>(other.val.data);
+		QByteArray * a1 = ptr<QByteArray>();
+		QByteArray * a2 = other.ptr<QByteArray>();
 
 		if ( a1->isNull() || a2->isNull() )
 			return false;
@@ -681,8 +866,8 @@ bool NifValue::operator==( const NifValue & other ) const
 
 	case tMatrix:
 	{
-		Matrix * m1 = static_cast<Matrix *>(val.data);
-		Matrix * m2 = static_cast<Matrix *>(other.val.data);
+		Matrix * m1 = ptr<Matrix>();
+		Matrix * m2 = other.ptr<Matrix>();
 
 		if ( !m1 || !m2 )
 			return false;
@@ -691,8 +876,8 @@ bool NifValue::operator==( const NifValue & other ) const
 	}
 	case tMatrix4:
 	{
-		Matrix4 * m1 = static_cast<Matrix4 *>(val.data);
-		Matrix4 * m2 = static_cast<Matrix4 *>(other.val.data);
+		Matrix4 * m1 = ptr<Matrix4>();
+		Matrix4 * m2 = other.ptr<Matrix4>();
 
 		if ( !m1 || !m2 )
 			return false;
@@ -733,6 +918,143 @@ bool NifValue::setFromVariant( const QVariant & var )
 	return false;
 }
 
+//! Write the components of a vector, color or quaternion
+template <typename T> static void saveComponents( QDataStream & ds, const T & v, unsigned int n )
+{
+	for ( unsigned int i = 0; i < n; i++ )
+		ds << v[i];
+}
+
+//! Read the components of a vector, color or quaternion
+template <typename T> static void loadComponents( QDataStream & ds, T & v, unsigned int n )
+{
+	for ( unsigned int i = 0; i < n; i++ )
+		ds >> v[i];
+}
+
+void NifValue::saveDefault( QDataStream & ds ) const
+{
+	ds << quint32( typ );
+
+	// The types which a default can be given for, see setFromString()
+	switch ( typ ) {
+	case tBool:
+	case tByte:
+	case tWord:
+	case tFlags:
+	case tStringOffset:
+	case tBlockTypeIndex:
+	case tShort:
+	case tInt:
+	case tUInt:
+	case tULittle32:
+	case tStringIndex:
+	case tLink:
+	case tUpLink:
+	case tFloat:
+	case tHfloat:
+	case tFileVersion:
+		ds << val.u32;
+		break;
+	case tString:
+	case tSizedString:
+	case tText:
+	case tShortString:
+	case tHeaderString:
+	case tLineString:
+	case tChar8String:
+		ds << *ptr<QString>();
+		break;
+	case tColor3:
+		saveComponents( ds, *ptr<Color3>(), 3 );
+		break;
+	case tColor4:
+	case tByteColor4:
+		saveComponents( ds, *ptr<Color4>(), 4 );
+		break;
+	case tVector2:
+		saveComponents( ds, *ptr<Vector2>(), 2 );
+		break;
+	case tVector3:
+		saveComponents( ds, *ptr<Vector3>(), 3 );
+		break;
+	case tVector4:
+		saveComponents( ds, *ptr<Vector4>(), 4 );
+		break;
+	case tQuat:
+	case tQuatXYZW:
+		saveComponents( ds, *ptr<Quat>(), 4 );
+		break;
+	default:
+		break;
+	}
+}
+
+bool NifValue::loadDefault( QDataStream & ds )
+{
+	quint32 t = tNone;
+	ds >> t;
+
+	if ( t > tNone )
+		return false;
+
+	changeType( Type( t ) );
+
+	switch ( typ ) {
+	case tBool:
+	case tByte:
+	case tWord:
+	case tFlags:
+	case tStringOffset:
+	case tBlockTypeIndex:
+	case tShort:
+	case tInt:
+	case tUInt:
+	case tULittle32:
+	case tStringIndex:
+	case tLink:
+	case tUpLink:
+	case tFloat:
+	case tHfloat:
+	case tFileVersion:
+		ds >> val.u32;
+		break;
+	case tString:
+	case tSizedString:
+	case tText:
+	case tShortString:
+	case tHeaderString:
+	case tLineString:
+	case tChar8String:
+		ds >> *ptr<QString>();
+		break;
+	case tColor3:
+		loadComponents( ds, *ptr<Color3>(), 3 );
+		break;
+	case tColor4:
+	case tByteColor4:
+		loadComponents( ds, *ptr<Color4>(), 4 );
+		break;
+	case tVector2:
+		loadComponents( ds, *ptr<Vector2>(), 2 );
+		break;
+	case tVector3:
+		loadComponents( ds, *ptr<Vector3>(), 3 );
+		break;
+	case tVector4:
+		loadComponents( ds, *ptr<Vector4>(), 4 );
+		break;
+	case tQuat:
+	case tQuatXYZW:
+		loadComponents( ds, *ptr<Quat>(), 4 );
+		break;
+	default:
+		break;
+	}
+
+	return ds.status() == QDataStream::Ok;
+}
+
 bool NifValue::setFromString( const QString & s )
 {
 	bool ok;
@@ -787,30 +1109,30 @@ bool NifValue::setFromString( const QString & s )
 	case tHeaderString:
 	case tLineString:
 	case tChar8String:
-		*static_cast<QString *>( val.data ) = s;
+		*ptr<QString>() = s;
 		return true;
 	case tColor3:
-		static_cast<Color3 *>( val.data )->fromQColor( QColor( s ) );
+		ptr<Color3>()->fromQColor( QColor( s ) );
 		return true;
 	case tColor4:
 	case tByteColor4:
-		static_cast<Color4 *>( val.data )->fromQColor( QColor( s ) );
+		ptr<Color4>()->fromQColor( QColor( s ) );
 		return true;
 	case tFileVersion:
 		val.u32 = NifModel::version2number( s );
 		return val.u32 != 0;
 	case tVector2:
-		static_cast<Vector2 *>( val.data )->fromString( s );
+		ptr<Vector2>()->fromString( s );
 		return true;
 	case tVector3:
-		static_cast<Vector3 *>( val.data )->fromString( s );
+		ptr<Vector3>()->fromString( s );
 		return true;
 	case tVector4:
-		static_cast<Vector4 *>( val.data )->fromString( s );
+		ptr<Vector4>()->fromString( s );
 		return true;
 	case tQuat:
 	case tQuatXYZW:
-		static_cast<Quat *>( val.data )->fromString( s );
+		ptr<Quat>()->fromString( s );
 		return true;
 	case tByteArray:
 	case tByteMatrix:
@@ -861,10 +1183,10 @@ QString NifValue::toString() const
 	case tHeaderString:
 	case tLineString:
 	case tChar8String:
-		return *static_cast<QString *>( val.data );
+		return *ptr<QString>();
 	case tColor3:
 		{
-			Color3 * col = static_cast<Color3 *>( val.data );
+			Color3 * col = ptr<Color3>();
 			return QString( "#%1%2%3" )
 			       .arg( (int)( col->red() * 0xff ),   2, 16, QChar( '0' ) )
 			       .arg( (int)( col->green() * 0xff ), 2, 16, QChar( '0' ) )
@@ -873,7 +1195,7 @@ QString NifValue::toString() const
 	case tColor4:
 	case tByteColor4:
 		{
-			Color4 * col = static_cast<Color4 *>( val.data );
+			Color4 * col = ptr<Color4>();
 			return QString( "#%1%2%3%4" )
 			       .arg( (int)( col->red() * 0xff ),   2, 16, QChar( '0' ) )
 			       .arg( (int)( col->green() * 0xff ), 2, 16, QChar( '0' ) )
@@ -883,7 +1205,7 @@ QString NifValue::toString() const
 	case tVector2:
 	case tHalfVector2:
 		{
-			Vector2 * v = static_cast<Vector2 *>( val.data );
+			Vector2 * v = ptr<Vector2>();
 
 			return QString( "X %1 Y %2" )
 			       .arg( NumOrMinMax( (*v)[0], 'f', VECTOR_DECIMALS ) )
@@ -893,7 +1215,7 @@ QString NifValue::toString() const
 	case tHalfVector3:
 	case tByteVector3:
 		{
-			Vector3 * v = static_cast<Vector3 *>( val.data );
+			Vector3 * v = ptr<Vector3>();
 
 			return QString( "X %1 Y %2 Z %3" )
 			       .arg( NumOrMinMax( (*v)[0], 'f', VECTOR_DECIMALS ) )
@@ -902,7 +1224,7 @@ QString NifValue::toString() const
 		}
 	case tVector4:
 		{
-			Vector4 * v = static_cast<Vector4 *>( val.data );
+			Vector4 * v = ptr<Vector4>();
 
 			return QString( "X %1 Y %2 Z %3 W %4" )
 			       .arg( NumOrMinMax( (*v)[0], 'f', VECTOR_DECIMALS ) )
@@ -917,9 +1239,9 @@ QString NifValue::toString() const
 			Matrix m;
 
 			if ( typ == tMatrix )
-				m = *( static_cast<Matrix *>( val.data ) );
+				m = *( ptr<Matrix>() );
 			else
-				m.fromQuat( *( static_cast<Quat *>( val.data ) ) );
+				m.fromQuat( *( ptr<Quat>() ) );
 
 			float x, y, z;
 			QString pre, suf;
@@ -936,7 +1258,7 @@ QString NifValue::toString() const
 		}
 	case tMatrix4:
 		{
-			Matrix4 * m = static_cast<Matrix4 *>( val.data );
+			Matrix4 * m = ptr<Matrix4>();
 			Matrix r; Vector3 t, s;
 			m->decompose( t, r, s );
 			float xr, yr, zr;
@@ -957,10 +1279,10 @@ QString NifValue::toString() const
 		}
 	case tByteArray:
 		return QString( "%1 bytes" )
-		       .arg( static_cast<QByteArray *>( val.data )->count() );
+		       .arg( ptr<QByteArray>()->count() );
 	case tStringPalette:
 		{
-			QByteArray * array = static_cast<QByteArray *>( val.data );
+			QByteArray * array = ptr<QByteArray>();
 			QString s;
 
 			while ( s.length() < array->count() ) {
@@ -972,7 +1294,7 @@ QString NifValue::toString() const
 		}
 	case tByteMatrix:
 		{
-			ByteMatrix * array = static_cast<ByteMatrix *>( val.data );
+			ByteMatrix * array = ptr<ByteMatrix>();
 			return QString( "%1 bytes  [%2 x %3]" )
 			       .arg( array->count() )
 			       .arg( array->count( 0 ) )
@@ -982,7 +1304,7 @@ QString NifValue::toString() const
 		return NifModel::version2string( val.u32 );
 	case tTriangle:
 		{
-			Triangle * tri = static_cast<Triangle *>( val.data );
+			Triangle * tri = ptr<Triangle>();
 			return QString( "%1 %2 %3" )
 			       .arg( tri->v1() )
 			       .arg( tri->v2() )
@@ -990,11 +1312,11 @@ QString NifValue::toString() const
 		}
 	case tFilePath:
 		{
-			return *static_cast<QString *>( val.data );
+			return *ptr<QString>();
 		}
 	case tBlob:
 		{
-			QByteArray * array = static_cast<QByteArray *>( val.data );
+			QByteArray * array = ptr<QByteArray>();
 			return QString( "%1 bytes" )
 				   .arg( array->size() );
 		}
@@ -1006,9 +1328,9 @@ QString NifValue::toString() const
 QColor NifValue::toColor() const
 {
 	if ( type() == tColor3 )
-		return static_cast<Color3 *>( val.data )->toQColor();
+		return ptr<Color3>()->toQColor();
 	else if ( type() == tColor4 || type() == tByteColor4 )
-		return static_cast<Color4 *>( val.data )->toQColor();
+		return ptr<Color4>()->toQColor();
 
 	return QColor();
 }
@@ -1024,13 +1346,117 @@ void NifIStream::init()
 	stringAdjust = (model->inherits( "NifModel" ) && model->getVersionNumber() >= 0x14010003);
 	bigEndian = false; // set when tFileVersion is read
 
-	dataStream = std::unique_ptr<QDataStream>( new QDataStream( device ) );
-	dataStream->setByteOrder( QDataStream::LittleEndian );
-	dataStream->setFloatingPointPrecision( QDataStream::SinglePrecision );
+	if ( device ) {
+		dataStream = std::unique_ptr<QDataStream>( new QDataStream( device ) );
+		dataStream->setByteOrder( QDataStream::LittleEndian );
+		dataStream->setFloatingPointPrecision( QDataStream::SinglePrecision );
+	}
 
 	maxLength = 0x8000;
 }
 
+template <typename T> void NifIStream::get( T & t )
+{
+	if ( !buffer ) {
+		*dataStream >> t;
+		return;
+	}
+
+	// Mirror QDataStream: a short read zeroes the value and consumes the remaining data
+	if ( bufferPastEnd || bufferSize - bufferPos < qint64( sizeof(T) ) ) {
+		t = T();
+		bufferPos = bufferSize;
+		bufferPastEnd = true;
+		return;
+	}
+
+	memcpy( &t, buffer + bufferPos, sizeof(T) );
+	bufferPos += sizeof(T);
+
+	if ( bigEndian )
+		std::reverse( reinterpret_cast<char *>( &t ), reinterpret_cast<char *>( &t ) + sizeof(T) );
+}
+
+bool NifIStream::getChar( char * c )
+{
+	if ( !buffer )
+		return device->getChar( c );
+
+	if ( bufferPos >= bufferSize )
+		return false;
+
+	*c = buffer[bufferPos++];
+	return true;
+}
+
+qint64 NifIStream::peek( char * data, qint64 len )
+{
+	if ( !buffer )
+		return device->peek( data, len );
+
+	len = qBound( qint64( 0 ), len, bufferSize - bufferPos );
+	memcpy( data, buffer + bufferPos, len );
+	return len;
+}
+
+bool NifIStream::status() const
+{
+	if ( !buffer )
+		return ( dataStream->status() == QDataStream::Ok );
+
+	return !bufferPastEnd;
+}
+
+qint64 NifIStream::readRaw( char * data, qint64 len )
+{
+	if ( !buffer )
+		return device->read( data, len );
+
+	len = peek( data, len );
+	bufferPos += len;
+	return len;
+}
+
+QByteArray NifIStream::readRaw( qint64 len )
+{
+	if ( !buffer )
+		return device->read( len );
+
+	// Deep copy, the values outlive the mapped data
+	len = qBound( qint64( 0 ), len, bufferSize - bufferPos );
+	QByteArray data( buffer + bufferPos, int( len ) );
+	bufferPos += len;
+	return data;
+}
+
+qint64 NifIStream::pos() const
+{
+	if ( !buffer )
+		return device->pos();
+
+	return bufferPos;
+}
+
+bool NifIStream::seek( qint64 p )
+{
+	if ( !buffer )
+		return device->seek( p );
+
+	if ( p < 0 || p > bufferSize )
+		return false;
+
+	bufferPos = p;
+	return true;
+}
+
+bool NifIStream::atEnd() const
+{
+	if ( !buffer )
+		return device->atEnd();
+
+	return bufferPos >= bufferSize;
+}
+
 bool NifIStream::read( NifValue & val )
 {
 	switch ( val.type() ) {
@@ -1039,17 +1465,17 @@ bool NifIStream::read( NifValue & val )
 			val.val.u32 = 0;
 
 			if ( bool32bit )
-				*dataStream >> val.val.u32;
+				get( val.val.u32 );
 			else
-				*dataStream >> val.val.u08;
+				get( val.val.u08 );
 
-			return ( dataStream->status() == QDataStream::Ok );
+			return status();
 		}
 	case NifValue::tByte:
 		{
 			val.val.u32 = 0;
-			*dataStream >> val.val.u08;
-			return ( dataStream->status() == QDataStream::Ok );
+			get( val.val.u08 );
+			return status();
 		}
 	case NifValue::tWord:
 	case NifValue::tShort:
@@ -1057,18 +1483,21 @@ bool NifIStream::read( NifValue & val )
 	case NifValue::tBlockTypeIndex:
 		{
 			val.val.u32 = 0;
-			*dataStream >> val.val.u16;
-			return ( dataStream->status() == QDataStream::Ok );
+			get( val.val.u16 );
+			return status();
 		}
 	case NifValue::tStringOffset:
 	case NifValue::tInt:
 	case NifValue::tUInt:
 		{
-			*dataStream >> val.val.u32;
-			return ( dataStream->status() == QDataStream::Ok );
+			get( val.val.u32 );
+			return status();
 		}
 	case NifValue::tULittle32:
 		{
+			if ( buffer )
+				return readRaw( (char *)&val.val.u32, 4 ) == 4;
+
 			if ( bigEndian )
 				dataStream->setByteOrder( QDataStream::LittleEndian );
 
@@ -1077,234 +1506,247 @@ bool NifIStream::read( NifValue & val )
 			if ( bigEndian )
 				dataStream->setByteOrder( QDataStream::BigEndian );
 
-			return (dataStream->status() == QDataStream::Ok);
+			return status();
 		}
 	case NifValue::tStringIndex:
 		{
-			*dataStream >> val.val.u32;
-			return ( dataStream->status() == QDataStream::Ok );
+			get( val.val.u32 );
+			return status();
 		}
 	case NifValue::tLink:
 	case NifValue::tUpLink:
 		{
-			*dataStream >> val.val.i32;
+			get( val.val.i32 );
 
 			if ( linkAdjust )
 				val.val.i32--;
 
-			return ( dataStream->status() == QDataStream::Ok );
+			return status();
 		}
 	case NifValue::tFloat:
 		{
-			*dataStream >> val.val.f32;
-			return ( dataStream->status() == QDataStream::Ok );
+			get( val.val.f32 );
+			return status();
 		}
 	case NifValue::tHfloat:
 		{
-			uint16_t half;
-			*dataStream >> half;
+			quint16 half;
+			get( half );
 			val.val.u32 = half_to_float( half );
-			return (dataStream->status() == QDataStream::Ok);
+			return status();
 		}
 	case NifValue::tByteVector3:
 		{
 			quint8 x, y, z;
 			float xf, yf, zf;
 
-			*dataStream >> x;
-			*dataStream >> y;
-			*dataStream >> z;
+			get( x );
+			get( y );
+			get( z );
 
 			xf = (double(x) / 255.0) * 2.0 - 1.0;
 			yf = (double(y) / 255.0) * 2.0 - 1.0;
 			zf = (double(z) / 255.0) * 2.0 - 1.0;
 	
-			Vector3 * v = static_cast<Vector3 *>(val.val.data);
+			Vector3 * v = val.ptr<Vector3>();
 			v->xyz[0] = xf; v->xyz[1] = yf; v->xyz[2] = zf;
 	
-			return (dataStream->status() == QDataStream::Ok);
+			return status();
 		}
 	case NifValue::tHalfVector3:
 		{
-			uint16_t x, y, z;
+			quint16 x, y, z;
 			union { float f; uint32_t i; } xu, yu, zu;
 
-			*dataStream >> x;
-			*dataStream >> y;
-			*dataStream >> z;
+			get( x );
+			get( y );
+			get( z );
 			
 			xu.i = half_to_float( x );
 			yu.i = half_to_float( y );
 			zu.i = half_to_float( z );
 	
-			Vector3 * v = static_cast<Vector3 *>(val.val.data);
+			Vector3 * v = val.ptr<Vector3>();
 			v->xyz[0] = xu.f; v->xyz[1] = yu.f; v->xyz[2] = zu.f;
 	
-			return ( dataStream->status() == QDataStream::Ok );
+			return status();
 		}
 	case NifValue::tHalfVector2:
 		{
-			uint16_t x, y;
+			quint16 x, y;
 			union { float f; uint32_t i; } xu, yu;
 
-			*dataStream >> x;
-			*dataStream >> y;
+			get( x );
+			get( y );
 			
 			xu.i = half_to_float( x );
 			yu.i = half_to_float( y );
 	
-			Vector2 * v = static_cast<Vector2 *>(val.val.data);
+			Vector2 * v = val.ptr<Vector2>();
 			v->xy[0] = xu.f; v->xy[1] = yu.f;
 	
-			return ( dataStream->status() == QDataStream::Ok );
+			return status();
 		}
 	case NifValue::tVector3:
 		{
-			Vector3 * v = static_cast<Vector3 *>( val.val.data );
-			*dataStream >> *v;
-			return ( dataStream->status() == QDataStream::Ok );
+			Vector3 * v = val.ptr<Vector3>();
+			get( v->xyz[0] );
+			get( v->xyz[1] );
+			get( v->xyz[2] );
+			return status();
 		}
 	case NifValue::tVector4:
 		{
-			Vector4 * v = static_cast<Vector4 *>( val.val.data );
-			*dataStream >> *v;
-			return ( dataStream->status() == QDataStream::Ok );
+			Vector4 * v = val.ptr<Vector4>();
+			get( v->xyzw[0] );
+			get( v->xyzw[1] );
+			get( v->xyzw[2] );
+			get( v->xyzw[3] );
+			return status();
 		}
 	case NifValue::tTriangle:
 		{
-			Triangle * t = static_cast<Triangle *>( val.val.data );
-			*dataStream >> *t;
-			return ( dataStream->status() == QDataStream::Ok );
+			Triangle * t = val.ptr<Triangle>();
+			get( t->v[0] );
+			get( t->v[1] );
+			get( t->v[2] );
+			return status();
 		}
 	case NifValue::tQuat:
 		{
-			Quat * q = static_cast<Quat *>( val.val.data );
-			*dataStream >> *q;
-			return ( dataStream->status() == QDataStream::Ok );
+			Quat * q = val.ptr<Quat>();
+			get( q->wxyz[0] );
+			get( q->wxyz[1] );
+			get( q->wxyz[2] );
+			get( q->wxyz[3] );
+			return status();
 		}
 	case NifValue::tQuatXYZW:
 		{
-			Quat * q = static_cast<Quat *>( val.val.data );
-			return device->read( (char *)&q->wxyz[1], 12 ) == 12 && device->read( (char *)q->wxyz, 4 ) == 4;
+			Quat * q = val.ptr<Quat>();
+			return readRaw( (char *)&q->wxyz[1], 12 ) == 12 && readRaw( (char *)q->wxyz, 4 ) == 4;
 		}
 	case NifValue::tMatrix:
-		return device->read( (char *)static_cast<Matrix *>( val.val.data )->m, 36 ) == 36;
+		return readRaw( (char *)val.ptr<Matrix>()->m, 36 ) == 36;
 	case NifValue::tMatrix4:
-		return device->read( (char *)static_cast<Matrix4 *>( val.val.data )->m, 64 ) == 64;
+		return readRaw( (char *)val.ptr<Matrix4>()->m, 64 ) == 64;
 	case NifValue::tVector2:
 		{
-			Vector2 * v = static_cast<Vector2 *>( val.val.data );
-			*dataStream >> *v;
-			return ( dataStream->status() == QDataStream::Ok );
+			Vector2 * v = val.ptr<Vector2>();
+			get( v->xy[0] );
+			get( v->xy[1] );
+			return status();
 		}
 	case NifValue::tColor3:
-		return device->read( (char *)static_cast<Color3 *>( val.val.data )->rgb, 12 ) == 12;
+		return readRaw( (char *)val.ptr<Color3>()->rgb, 12 ) == 12;
 	case NifValue::tByteColor4:
 		{
 			quint8 r, g, b, a;
-			*dataStream >> r;
-			*dataStream >> g;
-			*dataStream >> b;
-			*dataStream >> a;
+			get( r );
+			get( g );
+			get( b );
+			get( a );
 
-			Color4 * c = static_cast<Color4 *>(val.val.data);
+			Color4 * c = val.ptr<Color4>();
 			c->setRGBA( (float)r / 255.0, (float)g / 255.0, (float)b / 255.0, (float)a / 255.0 );
 
-			return (dataStream->status() == QDataStream::Ok);
+			return status();
 		}
 	case NifValue::tColor4:
 		{
-			Color4 * c = static_cast<Color4 *>( val.val.data );
-			*dataStream >> *c;
-			return ( dataStream->status() == QDataStream::Ok );
+			Color4 * c = val.ptr<Color4>();
+			get( c->rgba[0] );
+			get( c->rgba[1] );
+			get( c->rgba[2] );
+			get( c->rgba[3] );
+			return status();
 		}
 	case NifValue::tSizedString:
 		{
-			int len;
-			//device->read( (char *) &len, 4 );
-			*dataStream >> len;
+			qint32 len;
+			get( len );
 
 			if ( len > maxLength || len < 0 ) {
-				*static_cast<QString *>( val.val.data ) = tr( "<string too long (0x%1)>" ).arg( len, 0, 16 ); return false;
+				*val.ptr<QString>() = tr( "<string too long (0x%1)>" ).arg( len, 0, 16 ); return false;
 			}
 
-			QByteArray string = device->read( len );
+			QByteArray string = readRaw( len );
 
 			if ( string.size() != len )
 				return false;
 
 			//string.replace( "\r", "\\r" );
 			//string.replace( "\n", "\\n" );
-			*static_cast<QString *>( val.val.data ) = QString( string );
+			*val.ptr<QString>() = QString( string );
 		}
 		return true;
 	case NifValue::tShortString:
 		{
 			unsigned char len;
-			device->read( (char *)&len, 1 );
-			QByteArray string = device->read( len );
+			readRaw( (char *)&len, 1 );
+			QByteArray string = readRaw( len );
 
 			if ( string.size() != len )
 				return false;
 
 			//string.replace( "\r", "\\r" );
 			//string.replace( "\n", "\\n" );
-			*static_cast<QString *>( val.val.data ) = QString::fromLocal8Bit( string );
+			*val.ptr<QString>() = QString::fromLocal8Bit( string );
 		}
 		return true;
 	case NifValue::tText:
 		{
 			int len;
-			device->read( (char *)&len, 4 );
+			readRaw( (char *)&len, 4 );
 
 			if ( len > maxLength || len < 0 ) {
-				*static_cast<QString *>( val.val.data ) = tr( "<string too long>" ); return false;
+				*val.ptr<QString>() = tr( "<string too long>" ); return false;
 			}
 
-			QByteArray string = device->read( len );
+			QByteArray string = readRaw( len );
 
 			if ( string.size() != len )
 				return false;
 
-			*static_cast<QString *>( val.val.data ) = QString( string );
+			*val.ptr<QString>() = QString( string );
 		}
 		return true;
 	case NifValue::tByteArray:
 		{
 			int len;
-			device->read( (char *)&len, 4 );
+			readRaw( (char *)&len, 4 );
 
 			if ( len < 0 )
 				return false;
 
-			*static_cast<QByteArray *>( val.val.data ) = device->read( len );
-			return static_cast<QByteArray *>( val.val.data )->count() == len;
+			*val.ptr<QByteArray>() = readRaw( len );
+			return val.ptr<QByteArray>()->count() == len;
 		}
 	case NifValue::tStringPalette:
 		{
 			int len;
-			device->read( (char *)&len, 4 );
+			readRaw( (char *)&len, 4 );
 
 			if ( len > 0xffff || len < 0 )
 				return false;
 
-			*static_cast<QByteArray *>( val.val.data ) = device->read( len );
-			device->read( (char *)&len, 4 );
+			*val.ptr<QByteArray>() = readRaw( len );
+			readRaw( (char *)&len, 4 );
 			return true;
 		}
 	case NifValue::tByteMatrix:
 		{
 			int len1, len2;
-			device->read( (char *)&len1, 4 );
-			device->read( (char *)&len2, 4 );
+			readRaw( (char *)&len1, 4 );
+			readRaw( (char *)&len2, 4 );
 
 			if ( len1 < 0 || len2 < 0 )
 				return false;
 
 			int len = len1 * len2;
 			ByteMatrix tmp( len1, len2 );
-			qint64 rlen = device->read( tmp.data(), len );
-			tmp.swap( *static_cast<ByteMatrix *>( val.val.data ) );
+			qint64 rlen = readRaw( tmp.data(), len );
+			tmp.swap( *val.ptr<ByteMatrix>() );
 			return (rlen == len);
 		}
 	case NifValue::tHeaderString:
@@ -1313,13 +1755,13 @@ bool NifIStream::read( NifValue & val )
 			int c = 0;
 			char chr = 0;
 
-			while ( c++ < 80 && device->getChar( &chr ) && chr != '\n' )
+			while ( c++ < 80 && getChar( &chr ) && chr != '\n' )
 				string.append( chr );
 
 			if ( c >= 80 )
 				return false;
 
-			*static_cast<QString *>( val.val.data ) = QString( string );
+			*val.ptr<QString>() = QString( string );
 			bool x = model->setHeaderString( QString( string ) );
 			init();
 			return x;
@@ -1330,13 +1772,13 @@ bool NifIStream::read( NifValue & val )
 			int c = 0;
 			char chr = 0;
 
-			while ( c++ < 255 && device->getChar( &chr ) && chr != '\n' )
+			while ( c++ < 255 && getChar( &chr ) && chr != '\n' )
 				string.append( chr );
 
 			if ( c >= 255 )
 				return false;
 
-			*static_cast<QString *>( val.val.data ) = QString( string );
+			*val.ptr<QString>() = QString( string );
 			return true;
 		}
 	case NifValue::tChar8String:
@@ -1345,28 +1787,28 @@ bool NifIStream::read( NifValue & val )
 			int c = 0;
 			char chr = 0;
 
-			while ( c++ < 8 && device->getChar( &chr ) )
+			while ( c++ < 8 && getChar( &chr ) )
 				string.append( chr );
 
 			if ( c > 9 )
 				return false;
 
-			*static_cast<QString *>( val.val.data ) = QString( string );
+			*val.ptr<QString>() = QString( string );
 			return true;
 		}
 	case NifValue::tFileVersion:
 		{
-			if ( device->read( (char *)&val.val.u32, 4 ) != 4 )
+			if ( readRaw( (char *)&val.val.u32, 4 ) != 4 )
 				return false;
 
 			//bool x = model->setVersion( val.val.u32 );
 			//init();
 			if ( model->inherits( "NifModel" ) && model->getVersionNumber() >= 0x14000004 ) {
 				bool littleEndian;
-				device->peek( (char *)&littleEndian, 1 );
+				peek( (char *)&littleEndian, 1 );
 				bigEndian = !littleEndian;
 
-				if ( bigEndian ) {
+				if ( bigEndian && dataStream ) {
 					dataStream->setByteOrder( QDataStream::BigEndian );
 				}
 			}
@@ -1382,25 +1824,25 @@ bool NifIStream::read( NifValue & val )
 		{
 			if ( stringAdjust ) {
 				val.changeType( NifValue::tStringIndex );
-				return device->read( (char *)&val.val.i32, 4 ) == 4;
+				return readRaw( (char *)&val.val.i32, 4 ) == 4;
 			} else {
 				val.changeType( NifValue::tSizedString );
 
 				int len;
-				device->read( (char *)&len, 4 );
+				readRaw( (char *)&len, 4 );
 
 				if ( len > maxLength || len < 0 ) {
-					*static_cast<QString *>( val.val.data ) = tr( "<string too long>" ); return false;
+					*val.ptr<QString>() = tr( "<string too long>" ); return false;
 				}
 
-				QByteArray string = device->read( len );
+				QByteArray string = readRaw( len );
 
 				if ( string.size() != len )
 					return false;
 
 				//string.replace( "\r", "\\r" );
 				//string.replace( "\n", "\\n" );
-				*static_cast<QString *>( val.val.data ) = QString( string );
+				*val.ptr<QString>() = QString( string );
 				return true;
 			}
 		}
@@ -1408,23 +1850,23 @@ bool NifIStream::read( NifValue & val )
 		{
 			if ( stringAdjust ) {
 				val.changeType( NifValue::tStringIndex );
-				return device->read( (char *)&val.val.i32, 4 ) == 4;
+				return readRaw( (char *)&val.val.i32, 4 ) == 4;
 			} else {
 				val.changeType( NifValue::tSizedString );
 
 				int len;
-				device->read( (char *)&len, 4 );
+				readRaw( (char *)&len, 4 );
 
 				if ( len > maxLength || len < 0 ) {
-					*static_cast<QString *>( val.val.data ) = tr( "<string too long>" ); return false;
+					*val.ptr<QString>() = tr( "<string too long>" ); return false;
 				}
 
-				QByteArray string = device->read( len );
+				QByteArray string = readRaw( len );
 
 				if ( string.size() != len )
 					return false;
 
-				*static_cast<QString *>( val.val.data ) = QString( string );
+				*val.ptr<QString>() = QString( string );
 				return true;
 			}
 		}
@@ -1432,8 +1874,8 @@ bool NifIStream::read( NifValue & val )
 	case NifValue::tBlob:
 		{
 			if ( val.val.data ) {
-				QByteArray * array = static_cast<QByteArray *>( val.val.data );
-				return device->read( array->data(), array->size() ) == array->size();
+				QByteArray * array = val.ptr<QByteArray>();
+				return readRaw( array->data(), array->size() ) == array->size();
 			}
 
 			return false;
@@ -1445,6 +1887,214 @@ bool NifIStream::read( NifValue & val )
 	return false;
 }
 
+//! Decodes a primitive from unaligned little-endian (or big-endian if swapped) data
+template <typename T> static inline T decode( const char * p, bool swap )
+{
+	T t;
+	memcpy( &t, p, sizeof(T) );
+
+	if ( swap )
+		std::reverse( reinterpret_cast<char *>( &t ), reinterpret_cast<char *>( &t ) + sizeof(T) );
+
+	return t;
+}
+
+//! Encodes a primitive as unaligned little-endian data
+template <typename T> static inline void encode( char * p, T t )
+{
+	memcpy( p, &t, sizeof(T) );
+}
+
+//! Applies f to the value of each array element and its slice of the data
+template <typename F> static inline void forEachElement( NifItem * array, int count, const char * data, int size, F f )
+{
+	for ( int i = 0; i < count; i++ )
+		f( array->childValue( i ), data + i * size );
+}
+
+bool NifIStream::readArray( NifItem * array )
+{
+	int rows = array->childCount();
+	if ( rows == 0 )
+		return true;
+
+	NifValue::Type type = array->childValue( 0 ).type();
+	int size = fixedSize( type, bool32bit );
+	if ( size == 0 )
+		return false;
+
+	// Read the whole array at once; from a memory buffer this is just a bounds check
+	qint64 len = qint64( size ) * rows;
+	QByteArray block;
+	const char * data;
+	qint64 avail;
+
+	if ( buffer ) {
+		data = buffer + bufferPos;
+		avail = qMin( len, bufferSize - bufferPos );
+		bufferPos += avail;
+	} else {
+		block = device->read( len );
+		data = block.constData();
+		avail = block.size();
+	}
+
+	int count = int( avail / size );
+	bool swap = bigEndian;
+	bool adjust = linkAdjust;
+
+	switch ( type ) {
+	case NifValue::tBool:
+		if ( bool32bit ) {
+			forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+				v.val.u32 = decode<quint32>( p, swap );
+			} );
+		} else {
+			forEachElement( array, count, data, size, []( NifValue & v, const char * p ) {
+				v.val.u32 = 0;
+				v.val.u08 = quint8( *p );
+			} );
+		}
+		break;
+	case NifValue::tByte:
+		forEachElement( array, count, data, size, []( NifValue & v, const char * p ) {
+			v.val.u32 = 0;
+			v.val.u08 = quint8( *p );
+		} );
+		break;
+	case NifValue::tWord:
+	case NifValue::tShort:
+	case NifValue::tFlags:
+	case NifValue::tBlockTypeIndex:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			v.val.u32 = 0;
+			v.val.u16 = decode<quint16>( p, swap );
+		} );
+		break;
+	case NifValue::tStringOffset:
+	case NifValue::tStringIndex:
+	case NifValue::tInt:
+	case NifValue::tUInt:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			v.val.u32 = decode<quint32>( p, swap );
+		} );
+		break;
+	case NifValue::tULittle32:
+		forEachElement( array, count, data, size, []( NifValue & v, const char * p ) {
+			v.val.u32 = decode<quint32>( p, false );
+		} );
+		break;
+	case NifValue::tLink:
+	case NifValue::tUpLink:
+		forEachElement( array, count, data, size, [swap, adjust]( NifValue & v, const char * p ) {
+			v.val.i32 = decode<qint32>( p, swap ) - (adjust ? 1 : 0);
+		} );
+		break;
+	case NifValue::tFloat:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			v.val.f32 = decode<float>( p, swap );
+		} );
+		break;
+	case NifValue::tHfloat:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			v.val.u32 = half_to_float( decode<quint16>( p, swap ) );
+		} );
+		break;
+	case NifValue::tByteVector3:
+		forEachElement( array, count, data, size, []( NifValue & v, const char * p ) {
+			Vector3 * vec = v.ptr<Vector3>();
+			for ( int i = 0; i < 3; i++ )
+				vec->xyz[i] = (double( quint8( p[i] ) ) / 255.0) * 2.0 - 1.0;
+		} );
+		break;
+	case NifValue::tHalfVector3:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			Vector3 * vec = v.ptr<Vector3>();
+			union { float f; uint32_t i; } u;
+			for ( int i = 0; i < 3; i++ ) {
+				u.i = half_to_float( decode<quint16>( p + i * 2, swap ) );
+				vec->xyz[i] = u.f;
+			}
+		} );
+		break;
+	case NifValue::tHalfVector2:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			Vector2 * vec = v.ptr<Vector2>();
+			union { float f; uint32_t i; } u;
+			for ( int i = 0; i < 2; i++ ) {
+				u.i = half_to_float( decode<quint16>( p + i * 2, swap ) );
+				vec->xy[i] = u.f;
+			}
+		} );
+		break;
+	case NifValue::tVector2:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			Vector2 * vec = v.ptr<Vector2>();
+			for ( int i = 0; i < 2; i++ )
+				vec->xy[i] = decode<float>( p + i * 4, swap );
+		} );
+		break;
+	case NifValue::tVector3:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			Vector3 * vec = v.ptr<Vector3>();
+			for ( int i = 0; i < 3; i++ )
+				vec->xyz[i] = decode<float>( p + i * 4, swap );
+		} );
+		break;
+	case NifValue::tVector4:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			Vector4 * vec = v.ptr<Vector4>();
+			for ( int i = 0; i < 4; i++ )
+				vec->xyzw[i] = decode<float>( p + i * 4, swap );
+		} );
+		break;
+	case NifValue::tQuat:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			Quat * q = v.ptr<Quat>();
+			for ( int i = 0; i < 4; i++ )
+				q->wxyz[i] = decode<float>( p + i * 4, swap );
+		} );
+		break;
+	case NifValue::tTriangle:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			Triangle * t = v.ptr<Triangle>();
+			for ( int i = 0; i < 3; i++ )
+				t->v[i] = decode<quint16>( p + i * 2, swap );
+		} );
+		break;
+	case NifValue::tColor3:
+		// Read raw, as in read()
+		forEachElement( array, count, data, size, []( NifValue & v, const char * p ) {
+			memcpy( v.ptr<Color3>()->rgb, p, 12 );
+		} );
+		break;
+	case NifValue::tColor4:
+		forEachElement( array, count, data, size, [swap]( NifValue & v, const char * p ) {
+			Color4 * c = v.ptr<Color4>();
+			for ( int i = 0; i < 4; i++ )
+				c->rgba[i] = decode<float>( p + i * 4, swap );
+		} );
+		break;
+	case NifValue::tByteColor4:
+		forEachElement( array, count, data, size, []( NifValue & v, const char * p ) {
+			Color4 * c = v.ptr<Color4>();
+			c->setRGBA( (float)quint8( p[0] ) / 255.0, (float)quint8( p[1] ) / 255.0, (float)quint8( p[2] ) / 255.0, (float)quint8( p[3] ) / 255.0 );
+		} );
+		break;
+	default:
+		return false;
+	}
+
+	if ( count < rows ) {
+		if ( buffer )
+			bufferPastEnd = true;
+
+		return false;
+	}
+
+	return true;
+}
+
 
 /*
  *  NifOStream
@@ -1517,7 +2167,7 @@ bool NifOStream::write( const NifValue & val )
 		}
 	case NifValue::tByteVector3:
 		{
-			Vector3 * vec = static_cast<Vector3 *>(val.val.data);
+			Vector3 * vec = val.ptr<Vector3>();
 			if ( !vec )
 				return false;
 	
@@ -1530,7 +2180,7 @@ bool NifOStream::write( const NifValue & val )
 		}
 	case NifValue::tHalfVector3:
 		{
-			Vector3 * vec = static_cast<Vector3 *>(val.val.data);
+			Vector3 * vec = val.ptr<Vector3>();
 			if ( !vec )
 				return false;
 
@@ -1549,7 +2199,7 @@ bool NifOStream::write( const NifValue & val )
 		}
 	case NifValue::tHalfVector2:
 		{
-			Vector2 * vec = static_cast<Vector2 *>(val.val.data);
+			Vector2 * vec = val.ptr<Vector2>();
 			if ( !vec )
 				return false;
 
@@ -1565,29 +2215,29 @@ bool NifOStream::write( const NifValue & val )
 			return device->write( (char*)v, 4 ) == 4;
 		}
 	case NifValue::tVector3:
-		return device->write( (char *)static_cast<Vector3 *>( val.val.data )->xyz, 12 ) == 12;
+		return device->write( (char *)val.ptr<Vector3>()->xyz, 12 ) == 12;
 	case NifValue::tVector4:
-		return device->write( (char *)static_cast<Vector4 *>( val.val.data )->xyzw, 16 ) == 16;
+		return device->write( (char *)val.ptr<Vector4>()->xyzw, 16 ) == 16;
 	case NifValue::tTriangle:
-		return device->write( (char *)static_cast<Triangle *>( val.val.data )->v, 6 ) == 6;
+		return device->write( (char *)val.ptr<Triangle>()->v, 6 ) == 6;
 	case NifValue::tQuat:
-		return device->write( (char *)static_cast<Quat *>( val.val.data )->wxyz, 16 ) == 16;
+		return device->write( (char *)val.ptr<Quat>()->wxyz, 16 ) == 16;
 	case NifValue::tQuatXYZW:
 		{
-			Quat * q = static_cast<Quat *>( val.val.data );
+			Quat * q = val.ptr<Quat>();
 			return device->write( (char *)&q->wxyz[1], 12 ) == 12 && device->write( (char *)q->wxyz, 4 ) == 4;
 		}
 	case NifValue::tMatrix:
-		return device->write( (char *)static_cast<Matrix *>( val.val.data )->m, 36 ) == 36;
+		return device->write( (char *)val.ptr<Matrix>()->m, 36 ) == 36;
 	case NifValue::tMatrix4:
-		return device->write( (char *)static_cast<Matrix4 *>( val.val.data )->m, 64 ) == 64;
+		return device->write( (char *)val.ptr<Matrix4>()->m, 64 ) == 64;
 	case NifValue::tVector2:
-		return device->write( (char *)static_cast<Vector2 *>( val.val.data )->xy, 8 ) == 8;
+		return device->write( (char *)val.ptr<Vector2>()->xy, 8 ) == 8;
 	case NifValue::tColor3:
-		return device->write( (char *)static_cast<Color3 *>( val.val.data )->rgb, 12 ) == 12;
+		return device->write( (char *)val.ptr<Color3>()->rgb, 12 ) == 12;
 	case NifValue::tByteColor4:
 		{
-			Color4 * color = static_cast<Color4 *>(val.val.data);
+			Color4 * color = val.ptr<Color4>();
 			if ( !color )
 				return false;
 
@@ -1601,10 +2251,10 @@ bool NifOStream::write( const NifValue & val )
 			return device->write( (char*)c, 4 ) == 4;
 		}
 	case NifValue::tColor4:
-		return device->write( (char *)static_cast<Color4 *>( val.val.data )->rgba, 16 ) == 16;
+		return device->write( (char *)val.ptr<Color4>()->rgba, 16 ) == 16;
 	case NifValue::tSizedString:
 		{
-			QByteArray string = static_cast<QString *>( val.val.data )->toLatin1();
+			QByteArray string = val.ptr<QString>()->toLatin1();
 			//string.replace( "\\r", "\r" );
 			//string.replace( "\\n", "\n" );
 			int len = string.size();
@@ -1616,7 +2266,7 @@ bool NifOStream::write( const NifValue & val )
 		}
 	case NifValue::tShortString:
 		{
-			QByteArray string = static_cast<QString *>( val.val.data )->toLocal8Bit();
+			QByteArray string = val.ptr<QString>()->toLocal8Bit();
 			string.replace( "\\r", "\r" );
 			string.replace( "\\n", "\n" );
 
@@ -1632,7 +2282,7 @@ bool NifOStream::write( const NifValue & val )
 		}
 	case NifValue::tText:
 		{
-			QByteArray string = static_cast<QString *>( val.val.data )->toLatin1();
+			QByteArray string = val.ptr<QString>()->toLatin1();
 			int len = string.size();
 
 			if ( device->write( (char *)&len, 4 ) != 4 )
@@ -1643,7 +2293,7 @@ bool NifOStream::write( const NifValue & val )
 	case NifValue::tHeaderString:
 	case NifValue::tLineString:
 		{
-			QByteArray string = static_cast<QString *>( val.val.data )->toLatin1();
+			QByteArray string = val.ptr<QString>()->toLatin1();
 
 			if ( device->write( string.constData(), string.length() ) != string.length() )
 				return false;
@@ -1652,7 +2302,7 @@ bool NifOStream::write( const NifValue & val )
 		}
 	case NifValue::tChar8String:
 		{
-			QByteArray string = static_cast<QString *>( val.val.data )->toLatin1();
+			QByteArray string = val.ptr<QString>()->toLatin1();
 			quint32 n = std::min<quint32>( 8, string.length() );
 
 			if ( device->write( string.constData(), n ) != n )
@@ -1668,7 +2318,7 @@ bool NifOStream::write( const NifValue & val )
 		}
 	case NifValue::tByteArray:
 		{
-			QByteArray * array = static_cast<QByteArray *>( val.val.data );
+			QByteArray * array = val.ptr<QByteArray>();
 			int len = array->count();
 
 			if ( device->write( (char *)&len, 4 ) != 4 )
@@ -1678,7 +2328,7 @@ bool NifOStream::write( const NifValue & val )
 		}
 	case NifValue::tStringPalette:
 		{
-			QByteArray * array = static_cast<QByteArray *>( val.val.data );
+			QByteArray * array = val.ptr<QByteArray>();
 			int len = array->count();
 
 			if ( device->write( (char *)&len, 4 ) != 4 )
@@ -1691,7 +2341,7 @@ bool NifOStream::write( const NifValue & val )
 		}
 	case NifValue::tByteMatrix:
 		{
-			ByteMatrix * array = static_cast<ByteMatrix *>( val.val.data );
+			ByteMatrix * array = val.ptr<ByteMatrix>();
 			int len = array->count( 0 );
 
 			if ( device->write( (char *)&len, 4 ) != 4 )
@@ -1719,7 +2369,7 @@ bool NifOStream::write( const NifValue & val )
 				QByteArray string;
 
 				if ( val.val.data != 0 ) {
-					string = static_cast<QString *>( val.val.data )->toLatin1();
+					string = val.ptr<QString>()->toLatin1();
 				}
 
 				//string.replace( "\\r", "\r" );
@@ -1735,7 +2385,7 @@ bool NifOStream::write( const NifValue & val )
 	case NifValue::tBlob:
 
 		if ( val.val.data ) {
-			QByteArray * array = static_cast<QByteArray *>( val.val.data );
+			QByteArray * array = val.ptr<QByteArray>();
 			return device->write( array->data(), array->size() ) == array->size();
 		}
 
@@ -1748,6 +2398,133 @@ bool NifOStream::write( const NifValue & val )
 	return false;
 }
 
+bool NifOStream::writeArray( NifItem * array )
+{
+	int rows = array->childCount();
+	if ( rows == 0 )
+		return true;
+
+	NifValue::Type type = array->childValue( 0 ).type();
+	int size = fixedSize( type, bool32bit );
+
+	for ( int c = 0; c < rows && size > 0; c++ ) {
+		if ( array->childValue( c ).type() != type )
+			size = 0;
+	}
+
+	// Mixed or variable size values, write one at a time
+	if ( size == 0 ) {
+		for ( int c = 0; c < rows; c++ ) {
+			if ( !write( array->childValue( c ) ) )
+				return false;
+		}
+
+		return true;
+	}
+
+	QByteArray block( size * rows, Qt::Uninitialized );
+	char * data = block.data();
+
+	for ( int c = 0; c < rows; c++ ) {
+		const NifValue & v = array->childValue( c );
+		char * p = data + c * size;
+
+		switch ( type ) {
+		case NifValue::tBool:
+			if ( bool32bit )
+				encode( p, v.val.u32 );
+			else
+				encode( p, v.val.u08 );
+			break;
+		case NifValue::tByte:
+			encode( p, v.val.u08 );
+			break;
+		case NifValue::tWord:
+		case NifValue::tShort:
+		case NifValue::tFlags:
+		case NifValue::tBlockTypeIndex:
+			encode( p, v.val.u16 );
+			break;
+		case NifValue::tStringOffset:
+		case NifValue::tStringIndex:
+		case NifValue::tInt:
+		case NifValue::tUInt:
+		case NifValue::tULittle32:
+			encode( p, v.val.u32 );
+			break;
+		case NifValue::tLink:
+		case NifValue::tUpLink:
+			encode( p, qint32( linkAdjust ? v.val.i32 + 1 : v.val.i32 ) );
+			break;
+		case NifValue::tFloat:
+			encode( p, v.val.f32 );
+			break;
+		case NifValue::tHfloat:
+			encode( p, quint16( half_from_float( v.val.u32 ) ) );
+			break;
+		case NifValue::tByteVector3:
+			{
+				Vector3 * vec = v.ptr<Vector3>();
+				for ( int i = 0; i < 3; i++ )
+					encode( p + i, quint8( round( ((vec->xyz[i] + 1.0) / 2.0) * 255.0 ) ) );
+			}
+			break;
+		case NifValue::tHalfVector3:
+			{
+				Vector3 * vec = v.ptr<Vector3>();
+				union { float f; uint32_t i; } u;
+				for ( int i = 0; i < 3; i++ ) {
+					u.f = vec->xyz[i];
+					encode( p + i * 2, quint16( half_from_float( u.i ) ) );
+				}
+			}
+			break;
+		case NifValue::tHalfVector2:
+			{
+				Vector2 * vec = v.ptr<Vector2>();
+				union { float f; uint32_t i; } u;
+				for ( int i = 0; i < 2; i++ ) {
+					u.f = vec->xy[i];
+					encode( p + i * 2, quint16( half_from_float( u.i ) ) );
+				}
+			}
+			break;
+		case NifValue::tVector2:
+			memcpy( p, v.ptr<Vector2>()->xy, 8 );
+			break;
+		case NifValue::tVector3:
+			memcpy( p, v.ptr<Vector3>()->xyz, 12 );
+			break;
+		case NifValue::tVector4:
+			memcpy( p, v.ptr<Vector4>()->xyzw, 16 );
+			break;
+		case NifValue::tQuat:
+			memcpy( p, v.ptr<Quat>()->wxyz, 16 );
+			break;
+		case NifValue::tTriangle:
+			memcpy( p, v.ptr<Triangle>()->v, 6 );
+			break;
+		case NifValue::tColor3:
+			memcpy( p, v.ptr<Color3>()->rgb, 12 );
+			break;
+		case NifValue::tColor4:
+			memcpy( p, v.ptr<Color4>()->rgba, 16 );
+			break;
+		case NifValue::tByteColor4:
+			{
+				auto cF = v.ptr<Color4>()->rgba;
+				for ( int i = 0; i < 4; i++ )
+					encode( p + i, quint8( round( cF[i] * 255.0f ) ) );
+			}
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return device->write( block ) == block.size();
+}
+
 
 /*
  *  NifSStream
@@ -1817,14 +2594,14 @@ int NifSStream::size( const NifValue & val )
 		return 16;
 	case NifValue::tSizedString:
 		{
-			QByteArray string = static_cast<QString *>( val.val.data )->toLatin1();
+			QByteArray string = val.ptr<QString>()->toLatin1();
 			//string.replace( "\\r", "\r" );
 			//string.replace( "\\n", "\n" );
 			return 4 + string.size();
 		}
 	case NifValue::tShortString:
 		{
-			QByteArray string = static_cast<QString *>( val.val.data )->toLatin1();
+			QByteArray string = val.ptr<QString>()->toLatin1();
 
 			//string.replace( "\\r", "\r" );
 			//string.replace( "\\n", "\n" );
@@ -1835,13 +2612,13 @@ int NifSStream::size( const NifValue & val )
 		}
 	case NifValue::tText:
 		{
-			QByteArray string = static_cast<QString *>( val.val.data )->toLatin1();
+			QByteArray string = val.ptr<QString>()->toLatin1();
 			return 4 + string.size();
 		}
 	case NifValue::tHeaderString:
 	case NifValue::tLineString:
 		{
-			QByteArray string = static_cast<QString *>( val.val.data )->toLatin1();
+			QByteArray string = val.ptr<QString>()->toLatin1();
 			return string.length() + 1;
 		}
 	case NifValue::tChar8String:
@@ -1850,17 +2627,17 @@ int NifSStream::size( const NifValue & val )
 		}
 	case NifValue::tByteArray:
 		{
-			QByteArray * array = static_cast<QByteArray *>( val.val.data );
+			QByteArray * array = val.ptr<QByteArray>();
 			return 4 + array->count();
 		}
 	case NifValue::tStringPalette:
 		{
-			QByteArray * array = static_cast<QByteArray *>( val.val.data );
+			QByteArray * array = val.ptr<QByteArray>();
 			return 4 + array->count() + 4;
 		}
 	case NifValue::tByteMatrix:
 		{
-			ByteMatrix * array = static_cast<ByteMatrix *>( val.val.data );
+			ByteMatrix * array = val.ptr<ByteMatrix>();
 			return 4 + 4 + array->count();
 		}
 	case NifValue::tString:
@@ -1869,7 +2646,7 @@ int NifSStream::size( const NifValue & val )
 			if ( stringAdjust ) {
 				return 4;
 			}
-			QByteArray string = static_cast<QString *>( val.val.data )->toLatin1();
+			QByteArray string = val.ptr<QString>()->toLatin1();
 			//string.replace( "\\r", "\r" );
 			//string.replace( "\\n", "\n" );
 			return 4 + string.size();
@@ -1878,7 +2655,7 @@ int NifSStream::size( const NifValue & val )
 	case NifValue::tBlob:
 
 		if ( val.val.data ) {
-			QByteArray * array = static_cast<QByteArray *>( val.val.data );
+			QByteArray * array = val.ptr<QByteArray>();
 			return array->size();
 		}
 
@@ -35,13 +35,16 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "niftypes.h"
 
+#include <QAtomicInteger>
 #include <QByteArray>
 #include <QHash>
 #include <QPair>
 #include <QString>
 #include <QVariant>
+#include <QVector>
 
 #include <memory>
+#include <type_traits>
 
 
 //! @file nifvalue.h NifValue, NifIStream, NifOStream, NifSStream
@@ -61,9 +64,32 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define COLOR_STEP 0.01
 
 
+#ifdef NIF_BENCH
+//! Count a storage allocation; the counters are shared by all threads, so only the benchmark build keeps them
+#define NIFVALUE_COUNT( counter ) counter.fetchAndAddRelaxed( 1 )
+#else
+#define NIFVALUE_COUNT( counter )
+#endif
+
+//! Whether NifValue stores values of type T inline rather than allocating them on the heap.
+template <typename T> struct NifValueInline { enum { value = false }; };
+template <> struct NifValueInline<Vector2> { enum { value = true }; };
+template <> struct NifValueInline<HalfVector2> { enum { value = true }; };
+template <> struct NifValueInline<Vector3> { enum { value = true }; };
+template <> struct NifValueInline<HalfVector3> { enum { value = true }; };
+template <> struct NifValueInline<ByteVector3> { enum { value = true }; };
+template <> struct NifValueInline<Vector4> { enum { value = true }; };
+template <> struct NifValueInline<Quat> { enum { value = true }; };
+template <> struct NifValueInline<Triangle> { enum { value = true }; };
+template <> struct NifValueInline<Color3> { enum { value = true }; };
+template <> struct NifValueInline<Color4> { enum { value = true }; };
+template <> struct NifValueInline<ByteColor4> { enum { value = true }; };
+
 /*! A generic class used for storing a value of any type.
  *
  * The NifValue::Type enum lists all supported types.
+ * Vectors, quaternions, triangles and colors are stored inline; matrices,
+ * strings and byte arrays are allocated on the heap.
  */
 class NifValue
 {
@@ -200,6 +226,10 @@ public:
 	{
 		EnumType t;                                 //!< The enumeration type
 		QMap<quint32, QPair<QString, QString> > o;  //!< The enumeration dictionary as a value, a name and a description
+		QVector<QString> names;                     //!< The names of the options with small values, or bits for flags, indexed by value
+
+		//! Add an option to names, if its value is small enough
+		void indexName( quint32 oval, const QString & oid );
 	};
 
 	//! Register an enum type.
@@ -235,11 +265,32 @@ public:
 	//! Get list of all options that have been registered for the given enum type.
 	static const EnumOptions & enumOptionData( const QString & eid );
 
+	//! Write the registered types, aliases, enumerations and descriptions to a schema cache, see XmlCache.
+	static void saveTypes( QDataStream & ds );
+	//! Replace the registered types with those written by saveTypes(). Returns true if successful.
+	static bool loadTypes( QDataStream & ds );
+
+
+#ifdef NIF_BENCH
+	//! Storage allocation counters of all values since startup, counted in the benchmark build only
+	struct AllocationStatistics
+	{
+		//! Values whose storage was allocated on the heap
+		qint64 heap = 0;
+		//! Values stored inline, which would otherwise have been allocated on the heap
+		qint64 inlined = 0;
+	};
+
+	//! Get the storage allocation counters of all values
+	static AllocationStatistics allocationStatistics();
+#endif
 
 	//! Check if the type is not tNone.
 	static bool isValid( Type t ) { return t != tNone; }
 	//! Check if a type is of a link type (Ref or Ptr in xml).
 	static bool isLink( Type t ) { return t == tLink || t == tUpLink; }
+	//! Check if a type always has the same size on disk, so that arrays of it can be read and written in one pass.
+	static bool isFixedSize( Type t );
 
 	//! Check if the type of the data is not tNone.
 	bool isValid() const { return typ != tNone; }
@@ -334,6 +385,18 @@ public:
 	 */
 	bool setFromVariant( const QVariant & );
 
+	//! Write the type and the XML default of the value to a schema cache, see XmlCache.
+	void saveDefault( QDataStream & ds ) const;
+	//! Read a value written by saveDefault(). Returns true if successful.
+	bool loadDefault( QDataStream & ds );
+
+	//! The size of the inline storage of a value of type t, or 0 if it is stored on the heap.
+	static int inlineSize( Type t );
+	//! Copy the inline storage of the value to inlineSize( type() ) bytes of raw memory.
+	void storeInline( char * dst ) const;
+	//! Set the value to type t and copy its inline storage from raw memory written by storeInline().
+	void loadInline( Type t, const char * src );
+
 	//! Check whether the data is of type T.
 	template <typename T> bool ask( T * t = 0 ) const;
 	//! Get the data in the form of something of type T.
@@ -341,6 +404,19 @@ public:
 	//! Set the data from an instance of type T. Return true if successful.
 	template <typename T> bool set( const T & x );
 
+	/*! Copy the values of a packed array to an array of T
+	 *
+	 * Copies the inline storage directly when every value is stored inline as a T.
+	 * Returns false without touching the array otherwise.
+	 */
+	template <typename T> static bool getPacked( const QVector<NifValue> & values, QVector<T> & array );
+	/*! Overwrite the values of a packed array from an array of T of at least the same length
+	 *
+	 * Writes the inline storage directly when every value is stored inline as a T.
+	 * Returns false without touching the values otherwise.
+	 */
+	template <typename T> static bool setPacked( QVector<NifValue> & values, const QVector<T> & array );
+
 protected:
 	//! The type of this data.
 	Type typ = tNone;
@@ -354,11 +430,22 @@ protected:
 		qint32 i32;
 		float f32;
 		void * data;
+		//! Inline storage for small compound values, see NifValueInline
+		quint32 buffer[4];
 	};
 
 	//! The data value.
 	Value val;
 
+	//! Get the storage of a compound value of type T, either inline or on the heap.
+	template <typename T> T * ptr() const
+	{
+		if ( NifValueInline<T>::value )
+			return reinterpret_cast<T *>( const_cast<Value *>( &val ) );
+
+		return static_cast<T *>( val.data );
+	}
+
 	/*! Get the data as an object of type T.
 	 *
 	 * If the type t is not equal to the actual type of the data, then return T(). Serves
@@ -373,6 +460,13 @@ protected:
 	 */
 	template <typename T> bool setType( Type t, T v );
 
+	//! Whether every value is stored inline as a T
+	template <typename T> static bool isPacked( const QVector<NifValue> & values );
+	template <typename T> static bool getPacked( const QVector<NifValue> & values, QVector<T> & array, std::true_type );
+	template <typename T> static bool getPacked( const QVector<NifValue> &, QVector<T> &, std::false_type ) { return false; }
+	template <typename T> static bool setPacked( QVector<NifValue> & values, const QVector<T> & array, std::true_type );
+	template <typename T> static bool setPacked( QVector<NifValue> &, const QVector<T> &, std::false_type ) { return false; }
+
 	//! A dictionary yielding the Type from a type string.
 	static QHash<QString, Type> typeMap;
 
@@ -394,6 +488,13 @@ protected:
 	 * This dictionary allows that type to be exposed, eg. for NifValue::typeDescription().
 	 */
 	static QHash<QString, QString> aliasMap;
+
+#ifdef NIF_BENCH
+	//! Number of values allocated on the heap, see allocationStatistics()
+	static QAtomicInteger<qint64> heapAllocations;
+	//! Number of compound values stored inline, see allocationStatistics()
+	static QAtomicInteger<qint64> inlineAllocations;
+#endif
 };
 
 Q_DECLARE_METATYPE( NifValue )
@@ -416,8 +517,32 @@ public:
 		init();
 	}
 
+	/*! Constructs a stream that decodes directly from memory, e.g. a mapped file or archive entry.
+	 *
+	 * No copy of the data is made; it must outlive the stream.
+	 */
+	NifIStream( BaseModel * m, const QByteArray & d )
+		: model( m ), device( nullptr ), buffer( d.constData() ), bufferSize( d.size() )
+	{
+		init();
+	}
+
 	//! Reads a NifValue from the underlying device. Returns true if successful.
 	bool read( NifValue & );
+	//! Reads every element of an array of fixed size values in one pass. Returns true if successful.
+	bool readArray( NifItem * array );
+
+	//! Reads raw bytes without byte order conversion. Returns the number of bytes read.
+	qint64 readRaw( char * data, qint64 len );
+	//! Reads at most len raw bytes without byte order conversion.
+	QByteArray readRaw( qint64 len );
+
+	//! Returns the current read position.
+	qint64 pos() const;
+	//! Sets the current read position. Returns true if successful.
+	bool seek( qint64 pos );
+	//! Whether there is no more data to read.
+	bool atEnd() const;
 
 private:
 	//! The model that data is being read into.
@@ -427,9 +552,27 @@ private:
 	//! The data stream that is wrapped around the device (simplifies endian conversion)
 	std::unique_ptr<QDataStream> dataStream;
 
+	//! The memory being read from when there is no device.
+	const char * buffer = nullptr;
+	//! The size of the memory buffer.
+	qint64 bufferSize = 0;
+	//! The read position in the memory buffer.
+	qint64 bufferPos = 0;
+	//! Whether a read from the memory buffer has run past its end.
+	bool bufferPastEnd = false;
+
 	//! Initialises the stream.
 	void init();
 
+	//! Reads a primitive in the byte order of the stream.
+	template <typename T> void get( T & );
+	//! Reads a single byte.
+	bool getChar( char * c );
+	//! Looks ahead at the next bytes without consuming them.
+	qint64 peek( char * data, qint64 len );
+	//! Whether all primitive reads so far have succeeded.
+	bool status() const;
+
 	//! Whether a boolean is 32-bit.
 	bool bool32bit;
 	//! Whether link adjustment is required.
@@ -454,6 +597,8 @@ public:
 
 	//! Writes a NifValue to the underlying device. Returns true if successful.
 	bool write( const NifValue & );
+	//! Writes every element of an array of fixed size values in one pass. Returns true if successful.
+	bool writeArray( NifItem * array );
 
 private:
 	//! The model that data is being read from.
@@ -577,7 +722,7 @@ inline bool NifValue::setFileVersion( quint32 v )
 template <typename T> inline T NifValue::getType( Type t ) const
 {
 	if ( typ == t )
-		return *static_cast<T *>( val.data ); // WARNING: this throws an exception if the type of v is not the original type by which val.data was initialized; the programmer must make sure that T matches t.
+		return *ptr<T>(); // WARNING: this throws an exception if the type of v is not the original type by which val.data was initialized; the programmer must make sure that T matches t.
 
 	return T();
 }
@@ -585,7 +730,7 @@ template <typename T> inline T NifValue::getType( Type t ) const
 template <typename T> inline bool NifValue::setType( Type t, T v )
 {
 	if ( typ == t ) {
-		*static_cast<T *>( val.data ) = v; // WARNING: this throws an exception if the type of v is not the original type by which val.data was initialized; the programmer must make sure that T matches t.
+		*ptr<T>() = v; // WARNING: this throws an exception if the type of v is not the original type by which val.data was initialized; the programmer must make sure that T matches t.
 		return true;
 	}
 
@@ -644,7 +789,7 @@ template <> inline Vector4 NifValue::get() const
 template <> inline Vector3 NifValue::get() const
 {
 	if ( typ == tVector3 || typ == tHalfVector3 )
-		return *static_cast<Vector3 *>(val.data);
+		return *ptr<Vector3>();
 
 	return Vector3();
 }
@@ -663,7 +808,7 @@ template <> inline HalfVector2 NifValue::get() const
 template <> inline Vector2 NifValue::get() const
 {
 	if ( typ == tVector2 || typ == tHalfVector2 )
-		return *static_cast<Vector2 *>(val.data);
+		return *ptr<Vector2>();
 
 	return Vector2();
 }
@@ -686,35 +831,35 @@ template <> inline Triangle NifValue::get() const
 template <> inline QString NifValue::get() const
 {
 	if ( isString() )
-		return *static_cast<QString *>( val.data );
+		return *ptr<QString>();
 
 	return QString();
 }
 template <> inline QByteArray NifValue::get() const
 {
 	if ( isByteArray() )
-		return *static_cast<QByteArray *>( val.data );
+		return *ptr<QByteArray>();
 
 	return QByteArray();
 }
 template <> inline QByteArray * NifValue::get() const
 {
 	if ( isByteArray() )
-		return static_cast<QByteArray *>( val.data );
+		return ptr<QByteArray>();
 
 	return nullptr;
 }
 template <> inline Quat NifValue::get() const
 {
 	if ( isQuat() )
-		return *static_cast<Quat *>( val.data );
+		return *ptr<Quat>();
 
 	return Quat();
 }
 template <> inline ByteMatrix * NifValue::get() const
 {
 	if ( isByteMatrix() )
-		return static_cast<ByteMatrix *>( val.data );
+		return ptr<ByteMatrix>();
 
 	return nullptr;
 }
@@ -820,9 +965,10 @@ template <> inline bool NifValue::set( const QString & x )
 	if ( isString() ) {
 		if ( !val.data ) {
 			val.data = new QString;
+			NIFVALUE_COUNT( heapAllocations );
 		}
 
-		*static_cast<QString *>( val.data ) = x;
+		*ptr<QString>() = x;
 		return true;
 	}
 
@@ -832,7 +978,7 @@ template <> inline bool NifValue::set( const QString & x )
 template <> inline bool NifValue::set( const QByteArray & x )
 {
 	if ( isByteArray() ) {
-		*static_cast<QByteArray *>( val.data ) = x;
+		*ptr<QByteArray>() = x;
 		return true;
 	}
 
@@ -842,7 +988,7 @@ template <> inline bool NifValue::set( const QByteArray & x )
 template <> inline bool NifValue::set( const Quat & x )
 {
 	if ( isQuat() ) {
-		*static_cast<Quat *>( val.data ) = x;
+		*ptr<Quat>() = x;
 		return true;
 	}
 
@@ -945,4 +1091,55 @@ template <> inline bool NifValue::ask( QByteArray * ) const
 	return isByteArray();
 }
 
+template <typename T> inline bool NifValue::isPacked( const QVector<NifValue> & values )
+{
+	if ( values.isEmpty() || !values.first().ask<T>() )
+		return false;
+
+	// Packed elements share their type, unless one was changed through its own item
+	const Type t = values.first().typ;
+	for ( const NifValue & v : values ) {
+		if ( v.typ != t )
+			return false;
+	}
+
+	return true;
+}
+
+template <typename T> inline bool NifValue::getPacked( const QVector<NifValue> & values, QVector<T> & array )
+{
+	return getPacked( values, array, std::integral_constant<bool, NifValueInline<T>::value>() );
+}
+
+template <typename T> inline bool NifValue::getPacked( const QVector<NifValue> & values, QVector<T> & array, std::true_type )
+{
+	if ( !isPacked<T>( values ) )
+		return false;
+
+	array.resize( values.count() );
+
+	T * dst = array.data();
+	for ( const NifValue & v : values )
+		*dst++ = *v.ptr<T>();
+
+	return true;
+}
+
+template <typename T> inline bool NifValue::setPacked( QVector<NifValue> & values, const QVector<T> & array )
+{
+	return setPacked( values, array, std::integral_constant<bool, NifValueInline<T>::value>() );
+}
+
+template <typename T> inline bool NifValue::setPacked( QVector<NifValue> & values, const QVector<T> & array, std::true_type )
+{
+	if ( array.count() < values.count() || !isPacked<T>( values ) )
+		return false;
+
+	const T * src = array.constData();
+	for ( NifValue & v : values )
+		*v.ptr<T>() = *src++;
+
+	return true;
+}
+
 #endif
@@ -33,10 +33,13 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "message.h"
 #include "nifmodel.h"
 #include "niftypes.h"
+#include "xmlcache.h"
 
 #include <QtXml> // QXmlDefaultHandler Inherited
 #include <QApplication>
+#include <QElapsedTimer>
 #include <QMessageBox>
+#include <QSettings>
 
 
 //! \file nifxml.cpp NifXmlHandler, NifModel XML
@@ -547,6 +550,9 @@ public:
 			}
 		}
 
+		// Index the field rows of each type and resolve expression references to them
+		NifModel::indexTemplates( NifModel::compounds, NifModel::blocks );
+
 		return true;
 	}
 
@@ -593,13 +599,133 @@ bool NifModel::loadXML()
 	return true;
 }
 
+//! Names of the rows inserted for a block or compound, including those of its ancestors
+static QStringList fieldLayout( const NifBlockPtr & blk, const QHash<QString, NifBlockPtr> & blocks )
+{
+	QStringList layout;
+
+	if ( !blk )
+		return layout;
+
+	if ( !blk->ancestor.isEmpty() )
+		layout = fieldLayout( blocks.value( blk->ancestor ), blocks );
+
+	for ( const NifData & data : blk->types )
+		layout << data.name();
+
+	return layout;
+}
+
+//! Fields inserted for a block or compound, including those of its ancestors
+static QList<NifData> fieldData( const NifBlockPtr & blk, const QHash<QString, NifBlockPtr> & blocks )
+{
+	QList<NifData> fields;
+
+	if ( !blk )
+		return fields;
+
+	if ( !blk->ancestor.isEmpty() )
+		fields = fieldData( blocks.value( blk->ancestor ), blocks );
+
+	fields << blk->types;
+	return fields;
+}
+
+//! Index the first row of each name in the layout of a block or compound
+static void indexFields( const NifBlockPtr & blk, const QStringList & layout )
+{
+	blk->fieldRows.clear();
+	for ( int row = layout.count() - 1; row >= 0; row-- )
+		blk->fieldRows.insert( NifAtom( layout.at( row ) ), row );
+}
+
+//! Index the rows of a block or compound whose condition or argument reads another field
+static void indexDependents( const NifBlockPtr & blk, const QList<NifData> & fields )
+{
+	NifDependents & deps = blk->dependents;
+	deps = NifDependents();
+
+	for ( const NifData & data : fields )
+		deps.layout << data.atom();
+
+	for ( int row = 0; row < fields.count(); row++ ) {
+		const NifData & data = fields.at( row );
+		bool unresolved = false;
+
+		for ( const Expression::Field & f : data.condexpr().references() ) {
+			// "ARG" is read from the parent, which passes it on through an argument
+			if ( f.name == QLatin1String( "ARG" ) )
+				continue;
+
+			if ( f.name.contains( "/" ) ) {
+				unresolved = true;
+				continue;
+			}
+
+			QVector<int> & rows = deps.conditions[NifAtom( f.name )];
+			if ( !rows.contains( row ) )
+				rows << row;
+		}
+
+		if ( !data.arg().isEmpty() && data.isCompound() ) {
+			if ( deps.layout.contains( NifAtom( data.arg() ) ) )
+				deps.arguments[NifAtom( data.arg() )] << row;
+			else if ( data.arg() != QLatin1String( "ARG" ) )
+				unresolved = true;
+		}
+
+		if ( unresolved )
+			deps.unresolved << row;
+	}
+}
+
+//! Index the rows of the fields of each type, and resolve the fields referenced by expressions to rows
+static void indexTypes( const NifBlockPtr & blk, const QStringList & layout, const QStringList & header,
+	const QHash<QString, NifBlockPtr> & compounds )
+{
+	indexFields( blk, layout );
+
+	for ( NifData & data : blk->types ) {
+		data.resolveFields( layout, header );
+
+		// Point compound fields to the index of their type
+		if ( data.isCompound() ) {
+			if ( NifBlockPtr compound = compounds.value( data.type() ) ) {
+				data.setFieldIndex( compound );
+			}
+		}
+	}
+}
+
+// documented in nifmodel.h
+void NifModel::indexTemplates( QHash<QString, NifBlockPtr> & compounds, QHash<QString, NifBlockPtr> & blocks )
+{
+	// vercond is always evaluated against the complete header
+	QStringList header = fieldLayout( NifModel::compounds.value( "Header" ), blocks );
+
+	for ( NifBlockPtr c : compounds )
+		indexTypes( c, fieldLayout( c, blocks ), header, compounds );
+
+	for ( NifBlockPtr blk : blocks )
+		indexTypes( blk, fieldLayout( blk, blocks ), header, compounds );
+
+	// After the fields are resolved, ancestors are indexed with their descendants
+	for ( NifBlockPtr c : compounds )
+		indexDependents( c, fieldData( c, blocks ) );
+
+	for ( NifBlockPtr blk : blocks )
+		indexDependents( blk, fieldData( blk, blocks ) );
+}
+
 // documented in nifmodel.h
 QString NifModel::parseXmlDescription( const QString & filename )
 {
 	QWriteLocker lck( &XMLlock );
 
 	compounds.clear();
+	fixedCompounds.clear();
 	blocks.clear();
+	clearVersionTemplates();
 
 	supportedVersions.clear();
 
@@ -613,19 +739,96 @@ QString NifModel::parseXmlDescription( const QString & filename )
 	if ( !f.open( QIODevice::ReadOnly | QIODevice::Text ) )
 		return tr( "Couldn't open NIF XML description file: %1" ).arg( filename );
 
+	QElapsedTimer timer;
+	timer.start();
+
+	QByteArray xml = f.readAll();
+	XmlCache cache( filename, xml );
+
+	bool useCache = QSettings().value( "Use XML Cache", true ).toBool();
+
+	if ( useCache && loadXmlCache( cache ) ) {
+		qCDebug( nsNif ) << "Loaded" << filename << "from its cache in" << timer.elapsed() << "ms";
+		return QString();
+	}
+
 	NifXmlHandler handler;
 	QXmlSimpleReader reader;
 	reader.setContentHandler( &handler );
 	reader.setErrorHandler( &handler );
-	QXmlInputSource source( &f );
+	QXmlInputSource source;
+	source.setData( xml );
 	reader.parse( source );
 
 	if ( !handler.errorString().isEmpty() ) {
 		compounds.clear();
+		fixedCompounds.clear();
 		blocks.clear();
 		supportedVersions.clear();
+
+		return handler.errorString();
 	}
 
-	return handler.errorString();
+	qCDebug( nsNif ) << "Parsed" << filename << "in" << timer.elapsed() << "ms";
+
+	if ( useCache )
+		saveXmlCache( cache );
+
+	return QString();
+}
+
+// documented in nifmodel.h
+bool NifModel::loadXmlCache( XmlCache & cache )
+{
+	QDataStream * ds = cache.read();
+	if ( !ds )
+		return false;
+
+	QList<quint32> versions;
+	QStringList fixed;
+
+	*ds >> versions;
+
+	bool ok = NifValue::loadTypes( *ds )
+		&& XmlCache::loadBlocks( *ds, compounds )
+		&& XmlCache::loadBlocks( *ds, blocks );
+
+	*ds >> fixed;
+
+	if ( !ok || ds->status() != QDataStream::Ok ) {
+		// Start over from the XML
+		compounds.clear();
+		blocks.clear();
+		NifValue::initialize();
+		return false;
+	}
+
+	supportedVersions = versions;
+
+	for ( const QString & id : fixed ) {
+		if ( NifBlockPtr compound = compounds.value( id ) )
+			fixedCompounds.insert( id, compound );
+	}
+
+	indexTemplates( compounds, blocks );
+
+	return true;
+}
+
+// documented in nifmodel.h
+void NifModel::saveXmlCache( XmlCache & cache )
+{
+	QDataStream * ds = cache.write();
+
+	*ds << supportedVersions;
+
+	NifValue::saveTypes( *ds );
+	XmlCache::saveBlocks( *ds, compounds );
+	XmlCache::saveBlocks( *ds, blocks );
+
+	*ds << QStringList( fixedCompounds.keys() );
+
+	if ( !cache.commit() )
+		qCDebug( nsNif ) << "Could not store the cache of the XML description";
 }
 
@@ -22,6 +22,7 @@
 #include <QRadioButton>
 #include <QRegularExpression>
 #include <QSettings>
+#include <QSpinBox>
 #include <QStringListModel>
 #include <QTimer>
 
@@ -529,6 +530,9 @@ SettingsResources::SettingsResources( QWidget * parent ) :
 			ui->btnArchiveDown->setEnabled( idx.row() < archives->rowCount() - 1 );
 		}
 	);
+
+	connect( ui->spnArchiveCache, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &SettingsPane::modifyPane );
+	connect( ui->chkPinDependencies, &QCheckBox::stateChanged, this, &SettingsPane::modifyPane );
 }
 
 SettingsResources::~SettingsResources()
@@ -550,9 +554,31 @@ void SettingsResources::read()
 
 	ui->chkAlternateExt->setChecked( settings.value( "Settings/Resources/Alternate Extensions", true ).toBool() );
 
+	ui->spnArchiveCache->setValue( settings.value( "Settings/Resources/Archive Cache", 256 ).toInt() );
+	ui->chkPinDependencies->setChecked( settings.value( "Settings/Resources/Pin Dependencies", true ).toBool() );
+	updateCacheStats();
+
 	setModified( false );
 }
 
+void SettingsResources::updateCacheStats()
+{
+	auto stats = FSManager::cacheStats();
+
+	ui->lblCacheStats->setText( tr( "%1 files (%2 pinned) using %3 of %4 MiB: %5 hits, %6 misses, %7 evictions" )
+		.arg( stats.files ).arg( stats.pinned )
+		.arg( stats.bytes / 1048576.0, 0, 'f', 1 ).arg( stats.budget / 1048576 )
+		.arg( stats.hits ).arg( stats.misses ).arg( stats.evictions )
+	);
+}
+
+void SettingsResources::showEvent( QShowEvent * e )
+{
+	updateCacheStats();
+
+	SettingsPane::showEvent( e );
+}
+
 void SettingsResources::write()
 {
 	if ( !isModified() )
@@ -565,6 +591,7 @@ void SettingsResources::write()
 
 	// Sync FSManager to Archives list
 	archiveMgr->archives.clear();
+	FSManager::clearCache();
 	for ( const QString an : archives->stringList() ) {
 		if ( !archiveMgr->archives.contains( an ) )
 			if ( auto a = FSArchiveHandler::openArchive( an ) )
@@ -573,6 +600,11 @@ void SettingsResources::write()
 
 	settings.setValue( "Settings/Resources/Alternate Extensions", ui->chkAlternateExt->isChecked() );
 
+	settings.setValue( "Settings/Resources/Archive Cache", ui->spnArchiveCache->value() );
+	settings.setValue( "Settings/Resources/Pin Dependencies", ui->chkPinDependencies->isChecked() );
+	FSManager::setCacheBudget( qint64( ui->spnArchiveCache->value() ) * 1048576 );
+	updateCacheStats();
+
 	setModified( false );
 
 	emit dlg->flush3D();
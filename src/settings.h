@@ -13,6 +13,7 @@
 class FSManager;
 
 class QListWidgetItem;
+class QShowEvent;
 class QStringListModel;
 
 namespace Ui {
@@ -107,7 +108,13 @@ public slots:
 	void on_btnArchiveUp_clicked();
 	void on_btnArchiveAutoDetect_clicked();
 
+protected:
+	void showEvent( QShowEvent * ) override;
+
 private:
+	//! Shows the counters of the FSManager file cache
+	void updateCacheStats();
+
 	std::unique_ptr<Ui::SettingsResources> ui;
 
 	FSManager * archiveMgr;
@@ -1,6 +1,7 @@
 #include "misc.h"
 
 #include <QFileDialog>
+#include <QInputDialog>
 
 // Brief description is deliberately not autolinked to class Spell
 /*! \file misc.cpp
@@ -149,6 +150,103 @@ public:
 
 REGISTER_SPELL( spFileOffset )
 
+//! Selects the item at a file offset, e.g. one reported by a hex editor
+class spGoToOffset final : public Spell
+{
+public:
+	QString name() const override final { return Spell::tr( "Go To Offset" ); }
+
+	bool isApplicable( const NifModel * nif, const QModelIndex & index ) override final
+	{
+		Q_UNUSED( index );
+		return nif && nif->getBlockCount() > 0;
+	}
+
+	QModelIndex cast( NifModel * nif, const QModelIndex & index ) override final
+	{
+		bool ok = false;
+		QString text = QInputDialog::getText( 0, Spell::tr( "Go To Offset" ), Spell::tr( "Enter a file offset, e.g. 1234 or 0x4d2:" ),
+			QLineEdit::Normal, QString(), &ok );
+
+		if ( !ok )
+			return index;
+
+		int ofs = text.trimmed().toInt( &ok, 0 );
+		QModelIndex idx = ok ? nif->indexAtOffset( ofs ) : QModelIndex();
+		if ( !idx.isValid() ) {
+			Message::warning( nif->getWindow(), Spell::tr( "No item is stored at offset %1." ).arg( text ) );
+			return index;
+		}
+
+		return idx;
+	}
+};
+
+REGISTER_SPELL( spGoToOffset )
+
+//! Times the evaluation of all conditions in the model per block type
+class spBenchmarkConditions final : public Spell
+{
+public:
+	QString name() const override final { return Spell::tr( "Benchmark Conditions" ); }
+	QString page() const override final { return Spell::tr( "Block" ); }
+
+	bool isApplicable( const NifModel * nif, const QModelIndex & index ) override final
+	{
+		Q_UNUSED( index );
+		return nif && nif->getBlockCount() > 0;
+	}
+
+	QModelIndex cast( NifModel * nif, const QModelIndex & index ) override final
+	{
+		QString report = nif->benchmarkConditions();
+		Message::info( nif->getWindow(), Spell::tr( "Condition evaluation timings per block type" ), report );
+		return index;
+	}
+};
+
+REGISTER_SPELL( spBenchmarkConditions )
+
+//! Reports the memory used by the items of the model and by its undo stack
+class spItemStatistics final : public Spell
+{
+public:
+	QString name() const override final { return Spell::tr( "Item Memory" ); }
+	QString page() const override final { return Spell::tr( "Block" ); }
+
+	bool isApplicable( const NifModel * nif, const QModelIndex & index ) override final
+	{
+		Q_UNUSED( index );
+		return nif && nif->getBlockCount() > 0;
+	}
+
+	QModelIndex cast( NifModel * nif, const QModelIndex & index ) override final
+	{
+		NifItemArena::Statistics stats = nif->itemStatistics();
+
+		QString report = Spell::tr( "Items: %1 (peak %2)\nAllocations: %3\nChunks: %4\nBytes reserved: %5" )
+			.arg( stats.items ).arg( stats.peakItems ).arg( stats.allocations )
+			.arg( stats.chunks ).arg( stats.bytes );
+
+#ifdef NIF_BENCH
+		// Process wide, the values of all open files and their undo stacks are counted
+		NifValue::AllocationStatistics values = NifValue::allocationStatistics();
+		report += Spell::tr( "\n\nValue heap allocations: %1\nValues stored inline: %2\nHeap allocations without inline storage: %3" )
+			.arg( values.heap ).arg( values.inlined ).arg( values.heap + values.inlined );
+#endif
+
+		if ( nif->undoStack ) {
+			report += Spell::tr( "\n\nUndo commands: %1\nUndo bytes: %2" )
+				.arg( nif->undoStack->count() ).arg( nif->undoMemory() );
+		}
+
+		Message::info( nif->getWindow(), Spell::tr( "Item arena statistics" ), report );
+		return index;
+	}
+};
+
+REGISTER_SPELL( spItemStatistics )
+
 //! Exports the binary data of a binary row to a file
 class spExportBinary final : public Spell
 {
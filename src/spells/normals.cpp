@@ -103,13 +103,9 @@ public:
 
 			faceNormals( verts, triangles, norms );
 
-			// Pause updates between model/view
-			nif->setEmitChanges( false );
+			// One update between model/view for all vertices
+			NifTransaction transaction( nif, Spell::tr( "Face Normals" ) );
 			for ( int i = 0; i < numVerts; i++ ) {
-				// Unpause updates if last
-				if ( i == numVerts - 1 )
-					nif->setEmitChanges( true );
-
 				auto idx = nif->index( i, 0, iData );
 
 				nif->set<ByteVector3>( idx, "Normal", *static_cast<ByteVector3 *>(&norms[i]) );
@@ -144,6 +140,7 @@ public:
 		for ( int n = 0; n < norms.count(); n++ )
 			norms[n] = -norms[n];
 
+		NifTransaction transaction( nif, Spell::tr( "Flip Normals" ) );
 		nif->setArray<Vector3>( iData, "Normals", norms );
 
 		return index;
@@ -251,17 +248,14 @@ public:
 		for ( int i = 0; i < verts.count(); i++ )
 			snorms[i].normalize();
 
+		// One update between model/view for all vertices
+		NifTransaction transaction( nif, Spell::tr( "Smooth Normals" ) );
+
 		if ( nif->getUserVersion2() < 130 ) {
 			nif->setArray<Vector3>( iData, "Normals", snorms );
 		} else {
 			int numVerts = nif->get<int>( index, "Num Vertices" );
-			// Pause updates between model/view
-			nif->setEmitChanges( false );
 			for ( int i = 0; i < numVerts; i++ ) {
-				// Unpause updates if last
-				if ( i == numVerts - 1 )
-					nif->setEmitChanges( true );
-
 				auto idx = nif->index( i, 0, iData );
 
 				nif->set<ByteVector3>( idx, "Normal", *static_cast<ByteVector3 *>(&snorms[i]) );
@@ -298,6 +292,7 @@ public:
 			for ( int n = 0; n < norms.count(); n++ )
 				norms[n].normalize();
 
+			NifTransaction transaction( nif, Spell::tr( "Normalize" ) );
 			nif->setArray<Vector3>( index, norms );
 		} else {
 			Vector3 n = nif->get<Vector3>( index );
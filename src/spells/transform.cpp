@@ -385,6 +385,8 @@ public:
 
 		QModelIndex iData = nif->getBlock( nif->getLink( nif->getBlock( index ), "Data" ), "NiGeometryData" );
 
+		NifTransaction transaction( nif, Spell::tr( "Scale Vertices" ) );
+
 		QVector<Vector3> vertices = nif->getArray<Vector3>( iData, "Vertices" );
 		QMutableVectorIterator<Vector3> it( vertices );
 
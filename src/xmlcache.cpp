@@ -0,0 +1,192 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#include "xmlcache.h"
+#include "nifitem.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QSaveFile>
+
+
+//! @file xmlcache.cpp Binary snapshots of XML descriptions
+
+//! Identifies a snapshot file
+static const quint32 XmlCacheMagic = 0x4358534E; // "NSXC"
+//! Changes whenever the layout of a snapshot changes
+static const quint32 XmlCacheFormat = 1;
+
+XmlCache::XmlCache( const QString & filename, const QByteArray & xml )
+	: path( filename + ".cache" )
+{
+	QCryptographicHash hash( QCryptographicHash::Sha1 );
+	hash.addData( QByteArray::number( XmlCacheFormat ) );
+	hash.addData( QCoreApplication::applicationVersion().toUtf8() );
+	hash.addData( xml );
+	key = hash.result();
+}
+
+QDataStream * XmlCache::read()
+{
+	QFile f( path );
+	if ( !f.open( QIODevice::ReadOnly ) )
+		return nullptr;
+
+	data = f.readAll();
+	stream.reset( new QDataStream( &data, QIODevice::ReadOnly ) );
+	stream->setVersion( QDataStream::Qt_5_0 );
+
+	quint32 magic = 0;
+	QByteArray fileKey;
+	*stream >> magic >> fileKey;
+
+	if ( stream->status() != QDataStream::Ok || magic != XmlCacheMagic || fileKey != key ) {
+		stream.reset();
+		return nullptr;
+	}
+
+	return stream.get();
+}
+
+QDataStream * XmlCache::write()
+{
+	data.clear();
+	stream.reset( new QDataStream( &data, QIODevice::WriteOnly ) );
+	stream->setVersion( QDataStream::Qt_5_0 );
+
+	*stream << XmlCacheMagic << key;
+
+	return stream.get();
+}
+
+bool XmlCache::commit()
+{
+	if ( !stream || stream->status() != QDataStream::Ok )
+		return false;
+
+	stream.reset();
+
+	// Replace the snapshot in one step, another instance may be reading it
+	QSaveFile f( path );
+	if ( !f.open( QIODevice::WriteOnly ) )
+		return false;
+
+	f.write( data );
+	return f.commit();
+}
+
+//! Write the data of a field
+static void saveData( QDataStream & ds, const NifData & data )
+{
+	ds << data.name() << data.type() << data.temp() << data.arg() << data.arr1() << data.arr2() << data.cond()
+	   << data.ver1() << data.ver2() << data.text() << data.vercond();
+
+	ds << data.isAbstract() << data.isBinary() << data.isTemplated() << data.isCompound()
+	   << data.isArray() << data.isMultiArray() << data.isConditionless();
+
+	data.value.saveDefault( ds );
+}
+
+//! Read the data of a field written by saveData()
+static bool loadData( QDataStream & ds, NifData & data )
+{
+	QString name, type, temp, arg, arr1, arr2, cond, text, vercond;
+	quint32 ver1, ver2;
+	ds >> name >> type >> temp >> arg >> arr1 >> arr2 >> cond >> ver1 >> ver2 >> text >> vercond;
+
+	bool abstract, binary, templated, compound, array, multiArray, conditionless;
+	ds >> abstract >> binary >> templated >> compound >> array >> multiArray >> conditionless;
+
+	NifValue value;
+	if ( !value.loadDefault( ds ) )
+		return false;
+
+	data = NifData( name, type, temp, value, arg, arr1, arr2, cond, ver1, ver2 );
+	data.setText( text );
+
+	if ( !vercond.isEmpty() )
+		data.setVerCond( vercond );
+
+	data.setAbstract( abstract );
+	data.setBinary( binary );
+	data.setTemplated( templated );
+	data.setIsCompound( compound );
+	data.setIsArray( array );
+	data.setIsMultiArray( multiArray );
+	data.setIsConditionless( conditionless );
+
+	return ds.status() == QDataStream::Ok;
+}
+
+void XmlCache::saveBlocks( QDataStream & ds, const QHash<QString, NifBlockPtr> & blocks )
+{
+	ds << quint32( blocks.count() );
+
+	for ( const NifBlockPtr & blk : blocks ) {
+		ds << blk->id << blk->ancestor << blk->text << blk->abstract;
+
+		ds << quint32( blk->types.count() );
+		for ( const NifData & data : blk->types )
+			saveData( ds, data );
+	}
+}
+
+bool XmlCache::loadBlocks( QDataStream & ds, QHash<QString, NifBlockPtr> & blocks )
+{
+	quint32 count = 0;
+	ds >> count;
+
+	for ( ; count > 0; count-- ) {
+		NifBlockPtr blk = NifBlockPtr( new NifBlock );
+		ds >> blk->id >> blk->ancestor >> blk->text >> blk->abstract;
+
+		quint32 types = 0;
+		ds >> types;
+
+		if ( ds.status() != QDataStream::Ok )
+			return false;
+
+		blk->types.reserve( int( types ) );
+		for ( ; types > 0; types-- ) {
+			NifData data;
+			if ( !loadData( ds, data ) )
+				return false;
+
+			blk->types.append( data );
+		}
+
+		blocks.insert( blk->id, blk );
+	}
+
+	return ds.status() == QDataStream::Ok;
+}
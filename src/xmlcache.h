@@ -0,0 +1,88 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#ifndef XMLCACHE_H
+#define XMLCACHE_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QHash>
+#include <QString>
+
+#include <memory>
+
+
+//! @file xmlcache.h XmlCache
+
+struct NifBlock;
+using NifBlockPtr = std::shared_ptr<NifBlock>;
+
+/*! A binary snapshot of the schema parsed from an XML description
+ *
+ * The snapshot is stored next to the XML file and is keyed by a hash of the XML,
+ * the version of the application and the layout of the snapshot. It is stale as
+ * soon as any of them changes, and the XML is parsed again.
+ */
+class XmlCache final
+{
+public:
+	/*! Constructs the cache of an XML description.
+	 *
+	 * @param filename	The XML file, the cache is stored next to it
+	 * @param xml		The contents of the XML file
+	 */
+	XmlCache( const QString & filename, const QByteArray & xml );
+
+	//! Read the snapshot. Returns the stream of the schema, or null if the snapshot is missing or stale.
+	QDataStream * read();
+	//! Start a new snapshot. Returns the stream to write the schema to.
+	QDataStream * write();
+	//! Store the written snapshot next to the XML. Returns true if successful.
+	bool commit();
+
+	//! Write the blocks or compounds of a schema
+	static void saveBlocks( QDataStream & ds, const QHash<QString, NifBlockPtr> & blocks );
+	//! Read the blocks or compounds written by saveBlocks(). Returns true if successful.
+	static bool loadBlocks( QDataStream & ds, QHash<QString, NifBlockPtr> & blocks );
+
+private:
+	//! The path of the snapshot
+	QString path;
+	//! The key of the XML
+	QByteArray key;
+	//! The snapshot being read or written
+	QByteArray data;
+	//! The stream on the snapshot
+	std::unique_ptr<QDataStream> stream;
+};
+
+#endif